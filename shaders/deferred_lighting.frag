@@ -0,0 +1,51 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// Lighting subpass of the deferred path: same shading as scene.frag, evaluated once per pixel from the G-buffer
+// Point lights always come from the light clusters, there are no objects left to hold per object lists
+layout(location = 0) in vec2 fragNDC;
+layout(location = 1) flat in mat4 invProjMat;
+
+layout(location = 0) out vec4 outColor;
+
+// G-buffer (see GBuffer)
+layout (input_attachment_index = 0, set = 1, binding = 0) uniform subpassInput inAlbedo;
+layout (input_attachment_index = 1, set = 1, binding = 1) uniform subpassInput inNormal;
+layout (input_attachment_index = 2, set = 1, binding = 2) uniform subpassInput inDepth;
+
+// Reconstructed from depth in main()
+vec3 fragPosWorld;
+vec4 fragPosView;
+float fragRadialDepth;
+
+#include "lighting.glsl"
+
+vec3 shade()
+{
+	vec3 shadeColor = shadeDirectionalLights();
+
+	if (POINT_LIGHTS_ENABLED)
+		shadeColor += shadeClusterLights();
+
+	return shadeColor;
+}
+
+void main() {
+	// Background keeps the clear color
+	float depth = subpassLoad(inDepth).r;
+	if (depth >= 1.0)
+		discard;
+
+	vec4 posView = invProjMat * vec4(fragNDC, depth, 1.0);
+	fragPosView = vec4(posView.xyz / posView.w, 1.0);
+	fragPosWorld = (ubo.invViewMat * fragPosView).xyz;
+	fragRadialDepth = length(fragPosView); // Same as scene.frag, so that both paths pick the same cascades
+
+	surfaceNormal = normalize(subpassLoad(inNormal).xyz * 2.0 - 1.0);
+
+	outColor = vec4(subpassLoad(inAlbedo).rgb * shade(), 1.0);
+
+	// Debugging
+	if (DEBUG_CASCADES)
+		debugCascades(outColor);
+}
\ No newline at end of file
@@ -0,0 +1,31 @@
+#version 450
+
+// Fullscreen triangle of the deferred lighting subpass, no vertex input
+layout(location = 0) out vec2 fragNDC;
+layout(location = 1) flat out mat4 invProjMat;
+
+// Sizes UBO arrays, whose layout a specialization constant can't change. Must match SHADOWMAP_CASCADE_COUNT
+#define SHADOW_MAP_CASCADE_COUNT 4
+
+layout(set = 0, binding = 0) uniform GlobalUbo {
+	mat4 viewMat;
+	mat4 invViewMat;
+	mat4 projMat;
+	mat4 lightSpaceMats[SHADOW_MAP_CASCADE_COUNT];
+	vec4 cascadeSplits;
+	vec4 ambientLightColor; // w is intensity
+	uvec4 clusterGrid; // w is the number of directional lights
+	vec4 clusterParams; // Depth slice scale & bias, cluster size in pixels
+	vec4 cascadeAtlasRects[SHADOW_MAP_CASCADE_COUNT]; // Region of each cascade in its atlas layer: uv offset, uv scale
+	uvec4 cascadeLayers; // Atlas layer of each cascade
+} ubo;
+
+void main() {
+	vec2 uv = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+	fragNDC = uv * 2.0 - 1.0;
+
+	// Once per vertex instead of once per pixel
+	invProjMat = inverse(ubo.projMat);
+
+	gl_Position = vec4(fragNDC, 0.0, 1.0);
+}
@@ -0,0 +1,15 @@
+#version 450
+
+// Geometry subpass of the deferred path, after scene.vert. Lighting happens later, once per pixel (deferred_lighting.frag)
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec3 fragPosWorld;
+layout(location = 2) in vec3 fragNormalWorld;
+layout(location = 3) in vec4 fragPosView;
+
+layout(location = 0) out vec4 outAlbedo;
+layout(location = 1) out vec4 outNormal; // World space, remapped to [0, 1]
+
+void main() {
+	outAlbedo = vec4(fragColor, 1.0);
+	outNormal = vec4(normalize(fragNormalWorld) * 0.5 + 0.5, 0.0);
+}
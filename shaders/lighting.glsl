@@ -0,0 +1,272 @@
+// Lighting shared by scene.frag (forward) and deferred_lighting.frag: global resources, shadow filtering and light shading
+// The including shader declares fragPosWorld, fragPosView and fragRadialDepth beforehand, and sets surfaceNormal before shading
+
+// Sizes UBO arrays, whose layout a specialization constant can't change. Must match SHADOWMAP_CASCADE_COUNT
+#define SHADOW_MAP_CASCADE_COUNT 4
+
+struct Light {
+	int type;
+	vec4 position; // ignore w
+	vec4 color; // w is intensity
+	float radius;
+};
+
+layout(set = 0, binding = 0) uniform GlobalUbo {
+	mat4 viewMat;
+	mat4 invViewMat;
+	mat4 projMat;
+	mat4 lightSpaceMats[SHADOW_MAP_CASCADE_COUNT];
+	vec4 cascadeSplits;
+	vec4 ambientLightColor; // w is intensity
+	uvec4 clusterGrid; // w is the number of directional lights
+	vec4 clusterParams; // Depth slice scale & bias, cluster size in pixels
+	vec4 cascadeAtlasRects[SHADOW_MAP_CASCADE_COUNT]; // Region of each cascade in its atlas layer: uv offset, uv scale
+	uvec4 cascadeLayers; // Atlas layer of each cascade
+} ubo;
+
+layout (binding = 1) uniform sampler2DArrayShadow shadowMap; // Compares against the reference depth (LESS_OR_EQUAL = lit)
+
+// Specialization constants, set per frame by the render system (SimpleRenderSystem, DeferredRenderSystem). Disabled paths are compiled out of the permutation
+layout (constant_id = 0) const uint SHADOW_FILTER = 1u;
+layout (constant_id = 1) const bool SHADOWS_ENABLED = true;
+layout (constant_id = 2) const bool POINT_LIGHTS_ENABLED = true;
+layout (constant_id = 3) const uint MAX_DIRECTIONAL_LIGHTS = 0xFFFFFFFFu; // Upper bound of ubo.clusterGrid.w
+layout (constant_id = 4) const bool DEBUG_CASCADES = false;
+
+// Directional lights first (ubo.clusterGrid.w of them), then point lights
+layout(std430, set = 0, binding = 2) readonly buffer Lights {
+	Light lights[];
+};
+
+// {offset, count} into lightIndices, per cluster
+layout(std430, set = 0, binding = 3) readonly buffer Clusters {
+	uvec2 clusters[];
+};
+
+layout(std430, set = 0, binding = 4) readonly buffer ClusterLightIndices {
+	uint lightIndices[];
+};
+
+// Auxiliar variables
+vec3 surfaceNormal;
+vec3 viewDirection;
+
+float glossiness = 60.0; // higher values -> sharper highlight
+float d0 = 1.0; // Distance at which the light intensity is defined (reference point for attenuation)
+
+const mat4 biasMat = mat4( 
+	0.5, 0.0, 0.0, 0.0,
+	0.0, 0.5, 0.0, 0.0,
+	0.0, 0.0, 1.0, 0.0,
+	0.5, 0.5, 0.0, 1.0 );
+
+///////////// Useful functions /////////////
+
+// Shadow filtering kernel (see ShadowFilter)
+#define SHADOW_FILTER_BILINEAR 0u
+#define SHADOW_FILTER_GATHER 1u
+#define SHADOW_FILTER_POISSON 2u
+
+const vec2 poissonDisk[8] = vec2[](
+	vec2(-0.7071, 0.7071), vec2(-0.0000, -0.8750), vec2(0.5303, 0.5303), vec2(-0.6250, -0.0000),
+	vec2(0.3536, -0.3536), vec2(-0.0000, 0.3750), vec2(-0.1768, -0.1768), vec2(0.1250, 0.0000));
+
+// Moves a cascade space uv into the cascade's atlas region, at least "margin" away from its border so that no texel of a neighbour is read
+vec2 toAtlasUV(vec2 uv, uint cascadeIndex, vec2 margin)
+{
+	vec4 rect = ubo.cascadeAtlasRects[cascadeIndex];
+	return clamp(uv * rect.zw + rect.xy, rect.xy + margin, rect.xy + rect.zw - margin);
+}
+
+// Single comparison tap, bilinearly filtered by the sampler (2x2 PCF)
+// Returns a value between 0.0 and 1.0 (0.0 = Fully in shadow, 1.0 = Fully out of shadow)
+float shadowTap(vec2 uv, float depth, uint cascadeIndex, vec2 atlasTexelSize)
+{
+	vec2 atlasUV = toAtlasUV(uv, cascadeIndex, 0.5 * atlasTexelSize);
+	return texture(shadowMap, vec4(atlasUV, ubo.cascadeLayers[cascadeIndex], depth));
+}
+
+// Filtered shadow factor, with the kernel picked by SHADOW_FILTER
+float shadowFuncPCF(vec4 fragPosLS, uint cascadeIndex)
+{
+	fragPosLS = fragPosLS / fragPosLS.w;
+
+	// Outside of the cascade reads as lit, like the sampler's border
+	if (fragPosLS.z <= -1.0 || fragPosLS.z >= 1.0 || any(lessThan(fragPosLS.st, vec2(0.0))) || any(greaterThan(fragPosLS.st, vec2(1.0))))
+		return 1.0;
+
+	vec2 atlasTexelSize = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+	vec2 texelSize = atlasTexelSize / ubo.cascadeAtlasRects[cascadeIndex].zw; // In cascade space
+	float layer = float(ubo.cascadeLayers[cascadeIndex]);
+
+	if (SHADOW_FILTER == SHADOW_FILTER_BILINEAR)
+		return shadowTap(fragPosLS.st, fragPosLS.z, cascadeIndex, atlasTexelSize);
+
+	if (SHADOW_FILTER == SHADOW_FILTER_GATHER)
+	{
+		// 4x4 texels around the fragment, 4 comparisons per gather
+		float shadowFactor = 0.0;
+		for (int x = -1; x <= 1; x += 2)
+		{
+			for (int y = -1; y <= 1; y += 2)
+			{
+				vec2 atlasUV = toAtlasUV(fragPosLS.st + vec2(x, y) * texelSize, cascadeIndex, atlasTexelSize);
+				shadowFactor += dot(textureGather(shadowMap, vec3(atlasUV, layer), fragPosLS.z), vec4(0.25));
+			}
+		}
+		return shadowFactor * 0.25;
+	}
+
+	// Poisson disk, rotated per pixel so that the pattern turns into noise instead of banding
+	float angle = 6.2831853 * fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))));
+	mat2 rotation = mat2(cos(angle), sin(angle), -sin(angle), cos(angle));
+
+	float shadowFactor = 0.0;
+	for (int i = 0; i < 8; i++)
+		shadowFactor += shadowTap(fragPosLS.st + rotation * poissonDisk[i] * 2.0 * texelSize, fragPosLS.z, cascadeIndex, atlasTexelSize);
+
+	return shadowFactor * 0.125;
+}
+
+// Window function, to avoid a sharp cutoff at the boundary of the light's influence area
+float winFunc(float fallOffDist, float maxFallOffDist)
+{
+	return pow(max(0, 1.0 - pow(fallOffDist/maxFallOffDist, 4)), 2);
+}
+
+// Inverse-square light attenuation function (lightly modified)
+float falloffFunc(float squaredDistance, float lightRadius)
+{
+	return (d0 + lightRadius) / max(squaredDistance, lightRadius);
+}
+
+float attenuation(float squaredDistance, float lightRadius)
+{
+	// lightInfluenceRadius should be an exposed value for the user to tweak per light
+	float lightInfluenceRadius = lightRadius * 100.0f;
+
+	float fallOff = falloffFunc(squaredDistance, lightRadius);
+	return winFunc(squaredDistance, lightInfluenceRadius) * fallOff;
+}
+
+vec3 pointLightShade(Light light)
+{
+	vec3 shadeColor = vec3(0.0);
+
+	if(length(light.color.xyz) <= 0 || light.color.w == 0)
+		return shadeColor;
+
+	vec3 lightVec = light.position.xyz - fragPosWorld;
+	vec3 lightDir = normalize(lightVec);
+
+	vec3 lightIntensity = light.color.xyz * light.color.w;
+	
+	/// Diffuse
+	float cosAngIncidence = max(dot(surfaceNormal, lightDir), 0);
+
+	shadeColor += lightIntensity * cosAngIncidence;
+
+	/// Specular
+	vec3 halfAngle = normalize(lightDir + viewDirection);
+	float blinnTerm = dot(surfaceNormal, halfAngle);
+	blinnTerm = pow(max(blinnTerm, 0), glossiness);
+
+	shadeColor += lightIntensity * blinnTerm;
+
+	return shadeColor * attenuation(dot(lightVec, lightVec), light.radius);
+}
+
+vec3 directionalLightShade(Light light)
+{
+	vec3 shadeColor = vec3(0.0);
+
+	if(length(light.color.xyz) <= 0 || light.color.w == 0)
+		return shadeColor;
+
+	// light.position is actually the direction vector
+	vec3 lightDir = normalize(-light.position.xyz);
+
+	vec3 lightIntensity = light.color.xyz * light.color.w;
+
+	/// Diffuse
+	float cosAngIncidence = max(dot(surfaceNormal, lightDir), 0);
+
+	shadeColor += lightIntensity * cosAngIncidence;
+
+	/// Specular
+	vec3 halfAngle = normalize(lightDir + viewDirection);
+	float blinnTerm = dot(surfaceNormal, halfAngle);
+	blinnTerm = pow(max(blinnTerm, 0), glossiness);
+
+	shadeColor += lightIntensity * blinnTerm;
+
+	/// SHADOWS
+	if (!SHADOWS_ENABLED)
+		return shadeColor;
+
+	// Get cascade index for the current fragment's view position
+	uint cascadeIndex = 0;
+	for(uint i = 0; i < SHADOW_MAP_CASCADE_COUNT - 1; ++i) {
+		if(fragRadialDepth > ubo.cascadeSplits[i]) {
+			cascadeIndex = i + 1;
+		}
+	}
+
+	// Apply shadowmap
+	vec4 fragPosLightSpace = (biasMat * ubo.lightSpaceMats[cascadeIndex]) * vec4(fragPosWorld, 1.0);
+	shadeColor *= shadowFuncPCF(fragPosLightSpace, cascadeIndex);
+
+	return shadeColor;
+}
+
+// Ambient and directional lights
+vec3 shadeDirectionalLights()
+{
+	vec3 shadeColor = vec3(0.0);
+	vec3 camPosWorld = ubo.invViewMat[3].xyz;
+	viewDirection = normalize(camPosWorld - fragPosWorld);
+
+	////// Ambient light //////
+	shadeColor += ubo.ambientLightColor.xyz * ubo.ambientLightColor.w;
+
+	////// Emissive light //////
+	//shadeColor += Ke;
+
+	////// Lights //////
+	// Directional lights
+	for (uint i = 0; i < min(ubo.clusterGrid.w, MAX_DIRECTIONAL_LIGHTS); i++)
+		shadeColor += directionalLightShade(lights[i]);
+
+	return shadeColor;
+}
+
+// Point lights overlapping this fragment's cluster. shadeDirectionalLights() sets viewDirection first
+vec3 shadeClusterLights()
+{
+	vec3 shadeColor = vec3(0.0);
+
+	uvec3 cluster;
+	cluster.xy = uvec2(gl_FragCoord.xy / ubo.clusterParams.zw);
+	cluster.z = uint(max(log(fragPosView.z) * ubo.clusterParams.x + ubo.clusterParams.y, 0.0));
+	cluster = min(cluster, ubo.clusterGrid.xyz - 1u);
+
+	uvec2 clusterLights = clusters[cluster.x + ubo.clusterGrid.x * (cluster.y + ubo.clusterGrid.y * cluster.z)];
+	for (uint i = 0; i < clusterLights.y; i++)
+		shadeColor += pointLightShade(lights[lightIndices[clusterLights.x + i]]);
+
+	return shadeColor;
+}
+
+// Tints "color" by shadow cascade
+void debugCascades(inout vec4 color)
+{
+	if(fragRadialDepth < ubo.cascadeSplits[0]) {
+		color *= vec4(1.0, 0.0, 0.0, 1.0);
+	} else if(fragRadialDepth < ubo.cascadeSplits[1]) {
+		color *= vec4(1.0, 1.0, 0.0, 1.0);
+	} else if(fragRadialDepth < ubo.cascadeSplits[2]) {
+		color *= vec4(0.0, 1.0, 0.0, 1.0);
+	} else if(fragRadialDepth < ubo.cascadeSplits[3]) {
+		color *= vec4(0.0, 0.0, 1.0, 1.0);
+	}
+}
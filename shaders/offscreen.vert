@@ -2,16 +2,8 @@
 
 layout(location = 0) in vec3 position;
 
-// todo: pass via specialization constant
+// Sizes UBO arrays, whose layout a specialization constant can't change. Must match SHADOWMAP_CASCADE_COUNT
 #define SHADOW_MAP_CASCADE_COUNT 4
-#define MAX_LIGHTS 10
-
-struct Light {
-	int type;
-	vec4 position; // ignore w
-	vec4 color; // w is intensity
-	float radius;
-};
 
 layout(set = 0, binding = 0) uniform GlobalUbo {
 	mat4 viewMat;
@@ -20,16 +12,42 @@ layout(set = 0, binding = 0) uniform GlobalUbo {
 	mat4 lightSpaceMats[SHADOW_MAP_CASCADE_COUNT];
 	vec4 cascadeSplits;
 	vec4 ambientLightColor; // w is intensity
-	Light lights[MAX_LIGHTS];
-	int numLights;
+	uvec4 clusterGrid; // w is the number of directional lights
+	vec4 clusterParams; // Depth slice scale & bias, cluster size in pixels
+	vec4 cascadeAtlasRects[SHADOW_MAP_CASCADE_COUNT]; // Region of each cascade in its atlas layer: uv offset, uv scale
+	uvec4 cascadeLayers; // Atlas layer of each cascade
 } ubo;
 
-layout(push_constant) uniform Push {
+// Must match ObjectData, only the model matrix is read
+struct ObjectData {
 	mat4 modelMat;
-	mat4 normalMat;
+	mat3x4 normalMat;
+	uint lightListOffset;
+	uint lightListCount; // USE_LIGHT_CLUSTERS: point lights come from the fragment's cluster
+	uvec2 padding;
+};
+
+layout(std430, set = 0, binding = 6) readonly buffer Objects {
+	ObjectData objects[];
+};
+
+layout(push_constant) uniform Push {
 	uint cascadeIndex;
 } push;
 
+// Camera depth pre-pass instead of a shadow cascade (see DepthPrepassRenderSystem)
+layout (constant_id = 0) const bool CAMERA_VIEW = false;
+
+// The main pass tests the pre-pass depth for equality, both have to compute the exact same positions
+invariant gl_Position;
+
 void main() {
-	gl_Position = ubo.lightSpaceMats[push.cascadeIndex] * push.modelMat * vec4(position, 1.0);
+	if (CAMERA_VIEW) {
+		// Same operations as scene.vert
+		vec4 positionWorld = objects[gl_InstanceIndex].modelMat * vec4(position, 1.0);
+		gl_Position = ubo.projMat * ubo.viewMat * vec4(positionWorld.xyz, 1.0);
+	}
+	else {
+		gl_Position = ubo.lightSpaceMats[push.cascadeIndex] * objects[gl_InstanceIndex].modelMat * vec4(position, 1.0);
+	}
 }
\ No newline at end of file
@@ -1,36 +1,26 @@
 #version 450
 
 layout (location = 0) in vec2 fragOffset;
+layout (location = 1) flat in vec4 fragColor;
 
 layout (location = 0) out vec4 outColor;
 
-// todo: pass via specialization constant
+// Sizes UBO arrays, whose layout a specialization constant can't change. Must match SHADOWMAP_CASCADE_COUNT
 #define SHADOW_MAP_CASCADE_COUNT 4
-#define MAX_LIGHTS 10
-
-struct Light {
-	int type;
-	vec4 position; // ignore w
-	vec4 color; // w is intensity
-	float radius;
-};
 
 layout(set = 0, binding = 0) uniform GlobalUbo {
 	mat4 viewMat;
 	mat4 invViewMat;
 	mat4 projMat;
 	mat4 lightSpaceMats[SHADOW_MAP_CASCADE_COUNT];
+	vec4 cascadeSplits;
 	vec4 ambientLightColor; // w is intensity
-	Light lights[MAX_LIGHTS];
-	int numLights;
+	uvec4 clusterGrid; // w is the number of directional lights
+	vec4 clusterParams; // Depth slice scale & bias, cluster size in pixels
+	vec4 cascadeAtlasRects[SHADOW_MAP_CASCADE_COUNT]; // Region of each cascade in its atlas layer: uv offset, uv scale
+	uvec4 cascadeLayers; // Atlas layer of each cascade
 } ubo;
 
-layout(push_constant) uniform Push {
-	vec4 position;
-	vec4 color;
-	float radius;
-} push;
-
 const float M_PI = 3.1415926538;
 
 void main() {
@@ -43,5 +33,5 @@ void main() {
 
 	float cosDis = 0.5 * (cos(dis * M_PI) + 1.0); // ranges from 1 -> 0
 
-	outColor = vec4(push.color.xyz + 0.5 * cosDis, cosDis);
+	outColor = vec4(fragColor.xyz + 0.5 * cosDis, cosDis);
 }
\ No newline at end of file
@@ -9,43 +9,39 @@ const vec2 OFFSETS[6] = vec2[](
 	vec2(1.0, 1.0)
 );
 
+// One instance per light
+layout (location = 0) in vec4 positionRadius; // w is the radius
+layout (location = 1) in vec4 color;
+
 layout (location = 0) out vec2 fragOffset;
+layout (location = 1) flat out vec4 fragColor;
 
-// todo: pass via specialization constant
+// Sizes UBO arrays, whose layout a specialization constant can't change. Must match SHADOWMAP_CASCADE_COUNT
 #define SHADOW_MAP_CASCADE_COUNT 4
-#define MAX_LIGHTS 10
-
-struct Light {
-	int type;
-	vec4 position; // ignore w
-	vec4 color; // w is intensity
-	float radius;
-};
 
 layout(set = 0, binding = 0) uniform GlobalUbo {
 	mat4 viewMat;
 	mat4 invViewMat;
 	mat4 projMat;
 	mat4 lightSpaceMats[SHADOW_MAP_CASCADE_COUNT];
+	vec4 cascadeSplits;
 	vec4 ambientLightColor; // w is intensity
-	Light lights[MAX_LIGHTS];
-	int numLights;
+	uvec4 clusterGrid; // w is the number of directional lights
+	vec4 clusterParams; // Depth slice scale & bias, cluster size in pixels
+	vec4 cascadeAtlasRects[SHADOW_MAP_CASCADE_COUNT]; // Region of each cascade in its atlas layer: uv offset, uv scale
+	uvec4 cascadeLayers; // Atlas layer of each cascade
 } ubo;
 
-layout(push_constant) uniform Push {
-	vec4 position;
-	vec4 color;
-	float radius;
-} push;
-
 void main() {
 	// Offset from center of pointLight to current vertex (disregarding light radius, so normalized)
 	fragOffset = OFFSETS[gl_VertexIndex];
+	fragColor = color;
 
 	vec3 cameraRightWorld = { ubo.viewMat[0][0], ubo.viewMat[1][0], ubo.viewMat[2][0] };
 	vec3 cameraUpWorld = { ubo.viewMat[0][1], ubo.viewMat[1][1], ubo.viewMat[2][1] };
 
-	vec3 positionWorld = push.position.xyz + push.radius * fragOffset.x * cameraRightWorld + push.radius * fragOffset.y * cameraUpWorld;
+	float radius = positionRadius.w;
+	vec3 positionWorld = positionRadius.xyz + radius * fragOffset.x * cameraRightWorld + radius * fragOffset.y * cameraUpWorld;
 
 	gl_Position = ubo.projMat * ubo.viewMat * vec4(positionWorld, 1.0);
 }
\ No newline at end of file
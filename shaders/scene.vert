@@ -9,17 +9,10 @@ layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec3 fragPosWorld;
 layout(location = 2) out vec3 fragNormalWorld;
 layout(location = 3) out vec4 fragPosView;
+layout(location = 4) flat out uint fragObjectIndex; // For the per object light lists of scene.frag
 
-// todo: pass via specialization constant
+// Sizes UBO arrays, whose layout a specialization constant can't change. Must match SHADOWMAP_CASCADE_COUNT
 #define SHADOW_MAP_CASCADE_COUNT 4
-#define MAX_LIGHTS 10
-
-struct Light {
-	int type;
-	vec4 position; // ignore w
-	vec4 color; // w is intensity
-	float radius;
-};
 
 layout(set = 0, binding = 0) uniform GlobalUbo {
 	mat4 viewMat;
@@ -28,21 +21,36 @@ layout(set = 0, binding = 0) uniform GlobalUbo {
 	mat4 lightSpaceMats[SHADOW_MAP_CASCADE_COUNT];
 	vec4 cascadeSplits;
 	vec4 ambientLightColor; // w is intensity
-	Light lights[MAX_LIGHTS];
-	int numLights;
+	uvec4 clusterGrid; // w is the number of directional lights
+	vec4 clusterParams; // Depth slice scale & bias, cluster size in pixels
+	vec4 cascadeAtlasRects[SHADOW_MAP_CASCADE_COUNT]; // Region of each cascade in its atlas layer: uv offset, uv scale
+	uvec4 cascadeLayers; // Atlas layer of each cascade
 } ubo;
 
-layout(push_constant) uniform Push {
+// Written once per frame, shared by every pass. Draws start their instances at their render queue packet. Must match ObjectData
+struct ObjectData {
 	mat4 modelMat;
-	mat4 normalMat;
-} push;
+	mat3x4 normalMat;
+	uint lightListOffset;
+	uint lightListCount; // USE_LIGHT_CLUSTERS: point lights come from the fragment's cluster
+	uvec2 padding;
+};
+
+layout(std430, set = 0, binding = 6) readonly buffer Objects {
+	ObjectData objects[];
+};
+
+// Must match the depth pre-pass (offscreen.vert), whose depth the main pass tests for equality
+invariant gl_Position;
 
 void main() {
-	vec4 positionWorld = push.modelMat * vec4(position, 1.0);
+	ObjectData object = objects[gl_InstanceIndex];
+	vec4 positionWorld = object.modelMat * vec4(position, 1.0);
 
 	fragColor = color;
 	fragPosWorld = positionWorld.xyz;
-	fragNormalWorld = normalize(mat3(push.normalMat) * normal);
+	fragNormalWorld = normalize(mat3(object.normalMat) * normal);
+	fragObjectIndex = uint(gl_InstanceIndex);
 	fragPosView = ubo.viewMat * vec4(fragPosWorld, 1.0);
 
 	gl_Position = ubo.projMat * ubo.viewMat * vec4(fragPosWorld, 1.0);
@@ -0,0 +1,67 @@
+#version 450
+#extension GL_ARB_shader_viewport_layer_array : require
+
+layout(location = 0) in vec3 position;
+
+// Sizes UBO arrays, whose layout a specialization constant can't change. Must match SHADOWMAP_CASCADE_COUNT
+#define SHADOW_MAP_CASCADE_COUNT 4
+
+layout(set = 0, binding = 0) uniform GlobalUbo {
+	mat4 viewMat;
+	mat4 invViewMat;
+	mat4 projMat;
+	mat4 lightSpaceMats[SHADOW_MAP_CASCADE_COUNT];
+	vec4 cascadeSplits;
+	vec4 ambientLightColor; // w is intensity
+	uvec4 clusterGrid; // w is the number of directional lights
+	vec4 clusterParams; // Depth slice scale & bias, cluster size in pixels
+	vec4 cascadeAtlasRects[SHADOW_MAP_CASCADE_COUNT]; // Region of each cascade in its atlas layer: uv offset, uv scale
+	uvec4 cascadeLayers; // Atlas layer of each cascade
+} ubo;
+
+// Must match ObjectData, only the model matrix is read
+struct ObjectData {
+	mat4 modelMat;
+	mat3x4 normalMat;
+	uint lightListOffset;
+	uint lightListCount; // USE_LIGHT_CLUSTERS: point lights come from the fragment's cluster
+	uvec2 padding;
+};
+
+layout(std430, set = 0, binding = 6) readonly buffer Objects {
+	ObjectData objects[];
+};
+
+layout(push_constant) uniform Push {
+	uint cascadeMask; // Cascades updated this frame
+} push;
+
+out float gl_ClipDistance[4];
+
+// One instance per cascade, fallback for devices without multiview (or atlases where cascades share layers)
+// Instances start at the packet index times the cascade count, so that both can be recovered
+void main() {
+	uint objectIndex = uint(gl_InstanceIndex) / uint(SHADOW_MAP_CASCADE_COUNT);
+	uint cascadeIndex = uint(gl_InstanceIndex) % uint(SHADOW_MAP_CASCADE_COUNT);
+
+	// Cascades that are not updated this frame keep their contents, their triangles are collapsed outside of the clip volume
+	if ((push.cascadeMask & (1u << cascadeIndex)) == 0u) {
+		gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+		return;
+	}
+
+	vec4 clipPos = ubo.lightSpaceMats[cascadeIndex] * objects[objectIndex].modelMat * vec4(position, 1.0);
+
+	// Clip to the cascade's own frustum, since its region doesn't cover the whole layer
+	gl_ClipDistance[0] = clipPos.w - clipPos.x;
+	gl_ClipDistance[1] = clipPos.w + clipPos.x;
+	gl_ClipDistance[2] = clipPos.w - clipPos.y;
+	gl_ClipDistance[3] = clipPos.w + clipPos.y;
+
+	// Then move it into that region: uv = ndc * 0.5 + 0.5 is scaled and offset, the same way the main pass reads it back
+	vec4 rect = ubo.cascadeAtlasRects[cascadeIndex];
+	clipPos.xy = clipPos.xy * rect.zw + clipPos.w * (rect.zw + 2.0 * rect.xy - 1.0);
+
+	gl_Layer = int(ubo.cascadeLayers[cascadeIndex]);
+	gl_Position = clipPos;
+}
\ No newline at end of file
@@ -0,0 +1,48 @@
+#version 450
+#extension GL_EXT_multiview : require
+
+layout(location = 0) in vec3 position;
+
+// Sizes UBO arrays, whose layout a specialization constant can't change. Must match SHADOWMAP_CASCADE_COUNT
+#define SHADOW_MAP_CASCADE_COUNT 4
+
+layout(set = 0, binding = 0) uniform GlobalUbo {
+	mat4 viewMat;
+	mat4 invViewMat;
+	mat4 projMat;
+	mat4 lightSpaceMats[SHADOW_MAP_CASCADE_COUNT];
+	vec4 cascadeSplits;
+	vec4 ambientLightColor; // w is intensity
+	uvec4 clusterGrid; // w is the number of directional lights
+	vec4 clusterParams; // Depth slice scale & bias, cluster size in pixels
+	vec4 cascadeAtlasRects[SHADOW_MAP_CASCADE_COUNT]; // Region of each cascade in its atlas layer: uv offset, uv scale
+	uvec4 cascadeLayers; // Atlas layer of each cascade
+} ubo;
+
+// Must match ObjectData, only the model matrix is read
+struct ObjectData {
+	mat4 modelMat;
+	mat3x4 normalMat;
+	uint lightListOffset;
+	uint lightListCount; // USE_LIGHT_CLUSTERS: point lights come from the fragment's cluster
+	uvec2 padding;
+};
+
+layout(std430, set = 0, binding = 6) readonly buffer Objects {
+	ObjectData objects[];
+};
+
+layout(push_constant) uniform Push {
+	uint cascadeMask; // Cascades updated this frame
+} push;
+
+// One view per cascade
+void main() {
+	// Cascades that are not updated this frame keep their contents, their triangles are collapsed outside of the clip volume
+	if ((push.cascadeMask & (1u << gl_ViewIndex)) == 0u) {
+		gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+		return;
+	}
+
+	gl_Position = ubo.lightSpaceMats[gl_ViewIndex] * objects[gl_InstanceIndex].modelMat * vec4(position, 1.0);
+}
\ No newline at end of file
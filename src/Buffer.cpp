@@ -48,8 +48,12 @@ namespace OmniV {
 
 	Buffer::~Buffer() {
 		unmap();
-		vkDestroyBuffer(m_device.device(), m_buffer, nullptr);
-		vkFreeMemory(m_device.device(), m_memory, nullptr);
+
+		// Frames in flight may still read it
+		m_device.deferDestruction([device = m_device.device(), buffer = m_buffer, memory = m_memory]() {
+			vkDestroyBuffer(device, buffer, nullptr);
+			vkFreeMemory(device, memory, nullptr);
+		});
 	}
 
 	/**
@@ -0,0 +1,26 @@
+#include "CascadeScheduler.hpp"
+
+// std
+#include <cassert>
+
+namespace OmniV {
+
+	CascadeScheduler::CascadeScheduler(const std::array<uint32, SHADOWMAP_CASCADE_COUNT>& periods) : m_periods{ periods } {
+		for (uint32 period : m_periods)
+			assert(period > 0 && "Cascade update period must be at least 1 frame");
+	}
+
+	void CascadeScheduler::update(glm::mat4* cascadeMats) {
+		for (uint32 i = 0; i < SHADOWMAP_CASCADE_COUNT; i++) {
+			m_updated[i] = !m_valid || (m_frame + i) % m_periods[i] == 0;
+
+			if (m_updated[i])
+				m_cascadeMats[i] = cascadeMats[i];
+			else
+				cascadeMats[i] = m_cascadeMats[i];
+		}
+
+		m_valid = true;
+		m_frame++;
+	}
+}
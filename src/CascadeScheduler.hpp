@@ -0,0 +1,29 @@
+#pragma once
+
+#include "defines.hpp"
+
+namespace OmniV {
+
+	/// <summary>
+	/// <para> Decides which shadow cascades are re-rendered each frame. Cascade i is updated every m_periods[i] frames,
+	/// and skipped cascades keep both their shadowmap layer and the matrix it was rendered with </para>
+	/// <para> Updates are staggered (cascade i is offset by i frames), so that far cascades with long periods don't all land on the same frame </para>
+	/// </summary>
+	class CascadeScheduler {
+	public:
+		CascadeScheduler(const std::array<uint32, SHADOWMAP_CASCADE_COUNT>& periods);
+
+		// Picks this frame's cascades. "cascadeMats" holds the up to date matrices, the ones of skipped cascades are replaced by their stale ones
+		void update(glm::mat4* cascadeMats);
+
+		bool isCascadeUpdated(uint32 cascadeIndex) const { return m_updated[cascadeIndex]; }
+
+	private:
+		std::array<uint32, SHADOWMAP_CASCADE_COUNT> m_periods;
+		std::array<glm::mat4, SHADOWMAP_CASCADE_COUNT> m_cascadeMats;
+		std::array<bool, SHADOWMAP_CASCADE_COUNT> m_updated{};
+
+		uint64 m_frame = 0;
+		bool m_valid = false; // False until every cascade was rendered once
+	};
+}
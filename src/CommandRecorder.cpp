@@ -0,0 +1,167 @@
+#include "CommandRecorder.hpp"
+
+// std
+#include <cassert>
+#include <chrono>
+
+namespace OmniV {
+
+	CommandRecorder::CommandRecorder(Device& device, JobSystem& jobSystem, uint32 framesInFlight, uint32 threadCount)
+		: m_device{ device }, m_jobSystem{ jobSystem }, m_threadCount{ threadCount } {
+		if (!isParallel())
+			return;
+
+		m_device.createRecordingPools(m_threadCount, framesInFlight);
+		m_secondaries.resize(framesInFlight, std::vector<std::vector<VkCommandBuffer>>(m_threadCount));
+	}
+
+	void CommandRecorder::begin(int frameIndex) {
+		m_frameIndex = frameIndex;
+		m_steps.clear();
+		m_subpasses.clear();
+		m_contentCount = 0;
+
+		if (isParallel())
+			m_device.resetRecordingPools(frameIndex);
+	}
+
+	void CommandRecorder::addPrimary(RecordFunction record) {
+		m_steps.push_back({ std::move(record), false, 0 });
+	}
+
+	void CommandRecorder::setSubpass(VkRenderPass renderPass, uint32_t subpass, RecordFunction passState) {
+		m_subpasses.push_back({ renderPass, subpass, std::move(passState) });
+	}
+
+	void CommandRecorder::addContent(RecordFunction record) {
+		assert(!m_subpasses.empty() && "Contents must follow a setSubpass");
+
+		m_steps.push_back({ std::move(record), true, static_cast<uint32>(m_subpasses.size() - 1) });
+		m_contentCount++;
+	}
+
+	void CommandRecorder::record(VkCommandBuffer primary, RenderQueue& renderQueue) {
+		const auto startTime = std::chrono::high_resolution_clock::now();
+
+		if (!isParallel()) {
+			for (Step& step : m_steps)
+				step.record(primary);
+		}
+		else {
+			allocateSecondaries();
+
+			// Registered before the jobs start, so that they only look their bind state up
+			std::vector<Step*> contents;
+			contents.reserve(m_contentCount);
+			for (Step& step : m_steps) {
+				if (step.isContent) {
+					renderQueue.resetBindState(step.secondary);
+					contents.push_back(&step);
+				}
+			}
+
+			// Content k is recorded by lane k % threadCount, with a command buffer of that lane's pool. Each lane is a single job,
+			// so a pool is never used by two threads at once, whichever threads end up running the lanes
+			JobCounter recording;
+			m_jobSystem.parallelFor(m_threadCount, 1, [this, &contents](uint32 firstLane, uint32 endLane) {
+				for (uint32 lane = firstLane; lane < endLane; lane++)
+					for (size_t i = lane; i < contents.size(); i += m_threadCount)
+						recordSecondary(*contents[i]);
+			}, recording, "Record secondaries");
+
+			m_jobSystem.wait(recording);
+
+			// Consecutive contents are executed with a single call
+			std::vector<VkCommandBuffer> pending;
+			auto executePending = [&]() {
+				if (pending.empty())
+					return;
+
+				vkCmdExecuteCommands(primary, static_cast<uint32_t>(pending.size()), pending.data());
+				pending.clear();
+
+				// Executing secondaries leaves the primary's bound state undefined
+				renderQueue.resetBindState(primary);
+			};
+
+			for (Step& step : m_steps) {
+				if (step.isContent) {
+					pending.push_back(step.secondary);
+					continue;
+				}
+
+				executePending();
+				step.record(primary);
+			}
+
+			executePending();
+		}
+
+		const auto endTime = std::chrono::high_resolution_clock::now();
+		m_recordTime = std::chrono::duration<float, std::chrono::milliseconds::period>(endTime - startTime).count();
+	}
+
+	void CommandRecorder::allocateSecondaries() {
+		std::vector<std::vector<VkCommandBuffer>>& frameSecondaries = m_secondaries[m_frameIndex];
+
+		// Contents per lane, rounded up
+		uint32 required = (m_contentCount + m_threadCount - 1) / m_threadCount;
+
+		for (uint32 lane = 0; lane < m_threadCount; lane++) {
+			std::vector<VkCommandBuffer>& secondaries = frameSecondaries[lane];
+			if (secondaries.size() >= required)
+				continue;
+
+			uint32 previousCount = static_cast<uint32>(secondaries.size());
+			secondaries.resize(required);
+
+			VkCommandBufferAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+			allocInfo.commandPool = m_device.getRecordingPool(lane, m_frameIndex);
+			allocInfo.commandBufferCount = required - previousCount;
+
+			if (vkAllocateCommandBuffers(m_device.device(), &allocInfo, secondaries.data() + previousCount) != VK_SUCCESS) {
+				throw std::runtime_error("failed to allocate secondary command buffers!");
+			}
+		}
+
+		uint32 contentIndex = 0;
+		for (Step& step : m_steps) {
+			if (!step.isContent)
+				continue;
+
+			step.secondary = frameSecondaries[contentIndex % m_threadCount][contentIndex / m_threadCount];
+			contentIndex++;
+		}
+	}
+
+	void CommandRecorder::recordSecondary(Step& step) {
+		const Subpass& subpass = m_subpasses[step.subpassIndex];
+
+		// The framebuffer is left unknown, it's only a hint
+		VkCommandBufferInheritanceInfo inheritanceInfo{};
+		inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritanceInfo.renderPass = subpass.renderPass;
+		inheritanceInfo.subpass = subpass.subpass;
+		inheritanceInfo.framebuffer = VK_NULL_HANDLE;
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+		if (vkBeginCommandBuffer(step.secondary, &beginInfo) != VK_SUCCESS) {
+			throw std::runtime_error("failed to begin recording secondary command buffer!");
+		}
+
+		if (subpass.passState)
+			subpass.passState(step.secondary);
+
+		step.record(step.secondary);
+
+		if (vkEndCommandBuffer(step.secondary) != VK_SUCCESS) {
+			throw std::runtime_error("failed to record secondary command buffer!");
+		}
+	}
+}
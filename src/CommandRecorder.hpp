@@ -0,0 +1,85 @@
+#pragma once
+
+#include "Device.hpp"
+#include "JobSystem.hpp"
+#include "RenderQueue.hpp"
+
+// std
+#include <functional>
+
+namespace OmniV {
+
+	/// <summary>
+	/// <para> Records a frame as a sequence of primary commands (barriers, dispatches, render pass begin/end) and subpass contents </para>
+	/// <para> In parallel mode, every subpass content is recorded into its own secondary command buffer by jobs, all at once,
+	/// then the primary commands are recorded in order and execute the secondaries where they were added. Contents are spread over
+	/// recording lanes, each recorded by a single job from its own command pool of the frame (Device::getRecordingPool), so that no pool is
+	/// shared between threads </para>
+	/// <para> Without recording lanes, everything is recorded inline into the primary command buffer, in the same order </para>
+	/// </summary>
+	class CommandRecorder {
+	public:
+		using RecordFunction = std::function<void(VkCommandBuffer)>;
+
+		// "threadCount" is the number of recording lanes, 0 records everything inline
+		CommandRecorder(Device& device, JobSystem& jobSystem, uint32 framesInFlight, uint32 threadCount);
+
+		CommandRecorder(const CommandRecorder&) = delete;
+		CommandRecorder& operator=(const CommandRecorder&) = delete;
+
+		bool isParallel() const { return m_threadCount > 0; }
+		uint32 getThreadCount() const { return std::max(m_threadCount, 1u); }
+
+		// How render passes (and subpasses) holding added contents must be begun
+		VkSubpassContents getSubpassContents() const { return isParallel() ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE; }
+
+		// Starts a new frame. Its previous submission must be finished, as the frame's command pools are reset
+		void begin(int frameIndex);
+
+		// Recorded into the primary command buffer, in order
+		void addPrimary(RecordFunction record);
+
+		// Subpass that the next contents belong to. "passState" records the dynamic state (viewport, scissor...) at the start of every secondary,
+		// as they don't inherit it from the primary
+		void setSubpass(VkRenderPass renderPass, uint32_t subpass, RecordFunction passState);
+
+		// Draws of the current subpass. Several contents of the same subpass are executed in the order they were added
+		void addContent(RecordFunction record);
+
+		// Records the frame into "primary". Secondaries get their own bind state in "renderQueue"
+		void record(VkCommandBuffer primary, RenderQueue& renderQueue);
+
+		float getRecordTime() const { return m_recordTime; } // ms, wall time of the last record()
+
+	private:
+		struct Subpass {
+			VkRenderPass renderPass;
+			uint32_t subpass;
+			RecordFunction passState;
+		};
+
+		struct Step {
+			RecordFunction record;
+			bool isContent;
+			uint32 subpassIndex; // Contents only
+			VkCommandBuffer secondary = VK_NULL_HANDLE;
+		};
+
+		void allocateSecondaries();
+		void recordSecondary(Step& step);
+
+		Device& m_device;
+		JobSystem& m_jobSystem;
+		uint32 m_threadCount;
+
+		int m_frameIndex = 0;
+		std::vector<Step> m_steps;
+		std::vector<Subpass> m_subpasses;
+		uint32 m_contentCount = 0;
+
+		// Per frame in flight and lane, grown when a frame needs more. Their pool is reset as a whole every time the frame starts again
+		std::vector<std::vector<std::vector<VkCommandBuffer>>> m_secondaries;
+
+		float m_recordTime = 0.0f;
+	};
+}
@@ -82,7 +82,10 @@ namespace OmniV {
 	}
 
 	DescriptorPool::~DescriptorPool() {
-		vkDestroyDescriptorPool(m_device.device(), m_descriptorPool, nullptr);
+		// Frames in flight may still use its sets
+		m_device.deferDestruction([device = m_device.device(), descriptorPool = m_descriptorPool]() {
+			vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+		});
 	}
 
 	bool DescriptorPool::allocateDescriptor(const VkDescriptorSetLayout descriptorSetLayout, VkDescriptorSet& descriptor) const {
@@ -1,6 +1,7 @@
 #include "device.hpp"
 
 // std headers
+#include <cassert>
 #include <cstring>
 
 namespace OmniV {
@@ -42,7 +43,12 @@ namespace OmniV {
     }
 
     Device::~Device() {
+        vkDeviceWaitIdle(m_device);
+        flushDeferredDestruction();
+
         vkDestroyCommandPool(m_device, m_commandPool, nullptr);
+        for (VkCommandPool pool : m_recordingPools)
+            vkDestroyCommandPool(m_device, pool, nullptr);
         vkDestroyDevice(m_device, nullptr);
 
         if (m_enableValidationLayers) {
@@ -64,7 +70,7 @@ namespace OmniV {
         appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
         appInfo.pEngineName = "Engine";
         appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-        appInfo.apiVersion = VK_API_VERSION_1_0;
+        appInfo.apiVersion = VK_API_VERSION_1_1;
 
         VkInstanceCreateInfo createInfo = {};
         createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -117,6 +123,39 @@ namespace OmniV {
 
         vkGetPhysicalDeviceProperties(m_physicalDevice, &m_properties);
         OV_DEBUG_LOG("physical device: " << m_properties.deviceName);
+
+        queryOptionalFeatures();
+    }
+
+    void Device::queryOptionalFeatures() {
+        // Multiview is core since 1.1, it only has to be queried
+        if (m_properties.apiVersion >= VK_API_VERSION_1_1) {
+            VkPhysicalDeviceMultiviewFeatures multiviewFeatures{};
+            multiviewFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES;
+
+            VkPhysicalDeviceFeatures2 features2{};
+            features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+            features2.pNext = &multiviewFeatures;
+            vkGetPhysicalDeviceFeatures2(m_physicalDevice, &features2);
+
+            m_supportsMultiview = multiviewFeatures.multiview == VK_TRUE;
+        }
+
+        uint32_t extensionCount;
+        vkEnumerateDeviceExtensionProperties(m_physicalDevice, nullptr, &extensionCount, nullptr);
+        std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(m_physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+
+        for (const auto& extension : availableExtensions) {
+            if (strcmp(extension.extensionName, VK_EXT_SHADER_VIEWPORT_INDEX_LAYER_EXTENSION_NAME) == 0)
+                m_supportsShaderLayer = true;
+        }
+
+        VkPhysicalDeviceFeatures supportedFeatures;
+        vkGetPhysicalDeviceFeatures(m_physicalDevice, &supportedFeatures);
+        m_supportsClipDistance = supportedFeatures.shaderClipDistance == VK_TRUE;
+
+        OV_DEBUG_LOG("multiview: " << m_supportsMultiview << ", shader layer output: " << m_supportsShaderLayer << ", clip distances: " << m_supportsClipDistance);
     }
 
     void Device::createLogicalDevice() {
@@ -137,6 +176,7 @@ namespace OmniV {
 
         VkPhysicalDeviceFeatures deviceFeatures = {};
         deviceFeatures.samplerAnisotropy = VK_TRUE;
+        deviceFeatures.shaderClipDistance = m_supportsClipDistance ? VK_TRUE : VK_FALSE;
 
         VkDeviceCreateInfo createInfo = {};
         createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -145,8 +185,19 @@ namespace OmniV {
         createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
         createInfo.pEnabledFeatures = &deviceFeatures;
-        createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-        createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+
+        VkPhysicalDeviceMultiviewFeatures multiviewFeatures{};
+        multiviewFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES;
+        multiviewFeatures.multiview = VK_TRUE;
+        if (m_supportsMultiview)
+            createInfo.pNext = &multiviewFeatures;
+
+        std::vector<const char*> enabledExtensions = deviceExtensions;
+        if (m_supportsShaderLayer)
+            enabledExtensions.push_back(VK_EXT_SHADER_VIEWPORT_INDEX_LAYER_EXTENSION_NAME);
+
+        createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+        createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
         // might not really be necessary anymore because device specific validation layers
         // have been deprecated
@@ -180,6 +231,31 @@ namespace OmniV {
         }
     }
 
+    void Device::createRecordingPools(uint32_t threadCount, uint32_t framesInFlight) {
+        assert(m_recordingPools.empty() && "Recording pools were already created");
+
+        QueueFamilyIndices queueFamilyIndices = findPhysicalQueueFamilies();
+
+        // Command buffers are never reset individually, the whole pool is
+        VkCommandPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+        m_recordingThreadCount = threadCount;
+        m_recordingPools.resize(threadCount * framesInFlight);
+        for (VkCommandPool& pool : m_recordingPools) {
+            if (vkCreateCommandPool(m_device, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create recording command pool!");
+            }
+        }
+    }
+
+    void Device::resetRecordingPools(uint32_t frameIndex) {
+        for (uint32_t thread = 0; thread < m_recordingThreadCount; thread++)
+            vkResetCommandPool(m_device, getRecordingPool(thread, frameIndex), 0);
+    }
+
     void Device::createSurface() { m_window.createWindowSurface(m_instance, &m_surface); }
 
     bool Device::isDeviceSuitable(VkPhysicalDevice device) {
@@ -377,6 +453,14 @@ namespace OmniV {
         throw std::runtime_error("failed to find supported format!");
     }
 
+    bool Device::isFormatSupported(VkFormat format, VkImageTiling tiling, VkFormatFeatureFlags features) {
+        VkFormatProperties props;
+        vkGetPhysicalDeviceFormatProperties(m_physicalDevice, format, &props);
+
+        VkFormatFeatureFlags supported = tiling == VK_IMAGE_TILING_LINEAR ? props.linearTilingFeatures : props.optimalTilingFeatures;
+        return (supported & features) == features;
+    }
+
     uint32_t Device::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
         VkPhysicalDeviceMemoryProperties memProperties;
         vkGetPhysicalDeviceMemoryProperties(m_physicalDevice, &memProperties);
@@ -502,4 +586,49 @@ namespace OmniV {
         }
     }
 
+    void Device::deferDestruction(std::function<void()> destroy) {
+        {
+            std::lock_guard<std::mutex> lock(m_destructionMutex);
+
+            // Frames in flight could be using it
+            if (m_submittedFrames > m_finishedFrames) {
+                m_pendingDestructions.push_back({ m_submittedFrames, std::move(destroy) });
+                return;
+            }
+        }
+
+        destroy();
+    }
+
+    void Device::addSubmittedFrame() {
+        std::lock_guard<std::mutex> lock(m_destructionMutex);
+        m_submittedFrames++;
+    }
+
+    void Device::releaseFinishedFrames(uint64_t finishedFrames) {
+        std::vector<std::function<void()>> ready;
+        {
+            std::lock_guard<std::mutex> lock(m_destructionMutex);
+            m_finishedFrames = std::max(m_finishedFrames, finishedFrames);
+
+            while (!m_pendingDestructions.empty() && m_pendingDestructions.front().submittedFrames <= m_finishedFrames) {
+                ready.push_back(std::move(m_pendingDestructions.front().destroy));
+                m_pendingDestructions.pop_front();
+            }
+        }
+
+        // Outside the lock, destroying an object may release others
+        for (auto& destroy : ready)
+            destroy();
+    }
+
+    uint64_t Device::getSubmittedFrames() {
+        std::lock_guard<std::mutex> lock(m_destructionMutex);
+        return m_submittedFrames;
+    }
+
+    void Device::flushDeferredDestruction() {
+        releaseFinishedFrames(getSubmittedFrames());
+    }
+
 }
\ No newline at end of file
@@ -2,6 +2,11 @@
 
 #include "Window.hpp"
 
+// std
+#include <deque>
+#include <functional>
+#include <mutex>
+
 namespace OmniV {
 
 	struct SwapChainSupportDetails {
@@ -36,6 +41,12 @@ namespace OmniV {
 		Device& operator=(Device&&) = delete;
 
 		VkCommandPool getCommandPool() { return m_commandPool; }
+
+		// Command pools for parallel recording, one per recording thread and frame in flight. A pool can only be used by one thread at a time,
+		// and is reset as a whole once the frame that last used it is finished
+		void createRecordingPools(uint32_t threadCount, uint32_t framesInFlight);
+		VkCommandPool getRecordingPool(uint32_t thread, uint32_t frameIndex) { return m_recordingPools[frameIndex * m_recordingThreadCount + thread]; }
+		void resetRecordingPools(uint32_t frameIndex);
 		VkDevice device() { return m_device; }
 		VkSurfaceKHR surface() { return m_surface; }
 		VkQueue graphicsQueue() { return m_graphicsQueue; }
@@ -45,6 +56,7 @@ namespace OmniV {
 		uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
 		QueueFamilyIndices findPhysicalQueueFamilies() { return findQueueFamilies(m_physicalDevice); }
 		VkFormat findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
+		bool isFormatSupported(VkFormat format, VkImageTiling tiling, VkFormatFeatureFlags features);
 
 		// Buffer Helper Functions
 		void createBuffer(
@@ -58,8 +70,26 @@ namespace OmniV {
 		void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
 		void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t layerCount);
 
+		// Optional features, enabled when available
+		bool supportsMultiview() const { return m_supportsMultiview; }
+		bool supportsShaderLayer() const { return m_supportsShaderLayer; } // gl_Layer from vertex shaders
+		bool supportsClipDistance() const { return m_supportsClipDistance; }
+
 		void createImageWithInfo(const VkImageCreateInfo& imageInfo, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory);
 
+		// Deferred destruction. Objects released while submitted frames may still use them are destroyed once those frames are finished,
+		// so that replacing or unloading resources never waits for the device. Destroyed right away when no frame is in flight
+		// Thread safe. "destroy" must only capture handles, not the objects owning them
+		void deferDestruction(std::function<void()> destroy);
+
+		// Frame tracking for the deferred destruction, by the renderer: every submitted frame, then once the first "finishedFrames" are known to be done
+		void addSubmittedFrame();
+		void releaseFinishedFrames(uint64_t finishedFrames);
+		uint64_t getSubmittedFrames();
+
+		// Destroys everything pending. The device must be idle
+		void flushDeferredDestruction();
+
 		VkPhysicalDeviceProperties m_properties;
 
 	private:
@@ -67,6 +97,7 @@ namespace OmniV {
 		void setupDebugMessenger();
 		void createSurface();
 		void pickPhysicalDevice();
+		void queryOptionalFeatures();
 		void createLogicalDevice();
 		void createCommandPool();
 
@@ -86,11 +117,29 @@ namespace OmniV {
 		Window& m_window;
 		VkCommandPool m_commandPool;
 
+		std::vector<VkCommandPool> m_recordingPools; // Frame major
+		uint32_t m_recordingThreadCount = 0;
+
 		VkDevice m_device;
 		VkSurfaceKHR m_surface;
 		VkQueue m_graphicsQueue;
 		VkQueue m_presentQueue;
 
+		// Pending destructions, in release order. Each one waits for the frames submitted before its release
+		struct PendingDestruction {
+			uint64_t submittedFrames;
+			std::function<void()> destroy;
+		};
+
+		std::mutex m_destructionMutex;
+		std::deque<PendingDestruction> m_pendingDestructions;
+		uint64_t m_submittedFrames = 0;
+		uint64_t m_finishedFrames = 0;
+
+		bool m_supportsMultiview = false;
+		bool m_supportsShaderLayer = false;
+		bool m_supportsClipDistance = false;
+
 		const std::vector<const char*> validationLayers = { "VK_LAYER_KHRONOS_validation" };
 		const std::vector<const char*> deviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
 	};
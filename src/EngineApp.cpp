@@ -5,6 +5,14 @@
 #include "RenderSystems/SimpleRenderSystem.hpp"
 #include "RenderSystems/ShadowmapRenderSystem.hpp"
 #include "RenderSystems/PointLightRenderSystem.hpp"
+#include "RenderSystems/DeferredRenderSystem.hpp"
+#include "RenderSystems/DepthPrepassRenderSystem.hpp"
+#include "GpuTimer.hpp"
+#include "CommandRecorder.hpp"
+#include "FrameSnapshot.hpp"
+#include "RenderGraph.hpp"
+#include "GpuFrameArena.hpp"
+#include "FramePacer.hpp"
 
 // libs
 #include <pugixml.hpp>
@@ -12,48 +20,77 @@
 // std
 #include <cassert>
 #include <chrono>
+#include <random>
+#include <thread>
 
 namespace OmniV {
 
-	EngineApp::EngineApp() {
+	// Packets per job when writing the frame's object data
+	static constexpr uint32 OBJECT_DATA_BATCH_SIZE = 256;
+
+	EngineApp::EngineApp() {}
+
+	EngineApp::~EngineApp() {}
+
+	void EngineApp::run() {
+		// Per frame resources, sized from the scene's swapchain settings (applied in loadScene)
+		const uint32 framesInFlight = m_renderer.getFramesInFlight();
+
 		// Build descriptor pool
 		m_globalPool = DescriptorPool::Builder(m_device)
-			.setMaxSets(SwapChain::MAX_FRAMES_IN_FLIGHT)
-			.addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, SwapChain::MAX_FRAMES_IN_FLIGHT)
-			.addPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1)
+			.setMaxSets(framesInFlight)
+			.addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, framesInFlight)
+			.addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, framesInFlight)
+			.addPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, framesInFlight)
+			.addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4 * framesInFlight)
 			.build();
-	}
 
-	EngineApp::~EngineApp() {}
+		// Data the GPU reads for a single frame (global UBO, instances...), rewound when the frame starts again
+		GpuFrameArena gpuArena{ m_device, framesInFlight, GPU_FRAME_ARENA_SIZE };
 
-	void EngineApp::run() {
+		// Lights and their per-cluster/per-object lists
+		LightClusters lightClusters{ m_device, framesInFlight };
+		LightSelector lightSelector{ m_device, framesInFlight, std::clamp(m_renderSettings.maxObjectLights, 1u, LightSelector::MAX_OBJECT_LIGHTS) };
+		std::vector<Light> frameLights;
+		frameLights.reserve(MAX_LIGHTS);
 
-		// Global UBOs and their descriptors
-		std::vector<std::unique_ptr<Buffer>> uboBuffers(SwapChain::MAX_FRAMES_IN_FLIGHT);
-		for (int i = 0; i < uboBuffers.size(); i++) {
-			uboBuffers[i] = std::make_unique<Buffer>(m_device, sizeof(GlobalUbo), 1, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-			uboBuffers[i]->map();
-		}
+		// Shadow atlas, sized from the scene's settings. The static cache is only allocated if some casters are static
+		m_shadowmapRenderer = std::make_unique<ShadowmapRenderer>(m_device, m_renderer, m_renderSettings.shadowmap, m_hasStaticCasters);
 
 		// This is temporary and should eventually be replaced with a proper class for images/samplers (similar to Buffer)
 		VkDescriptorImageInfo shadowmapImageInfo{};
-		shadowmapImageInfo.sampler = m_shadowmapRenderer.getShadowmapSampler();
-		shadowmapImageInfo.imageView = m_shadowmapRenderer.getShadowmapImageView();
+		shadowmapImageInfo.sampler = m_shadowmapRenderer->getShadowmapSampler();
+		shadowmapImageInfo.imageView = m_shadowmapRenderer->getShadowmapImageView();
 		shadowmapImageInfo.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
 
 		// Build descriptor set layout
 		auto globalSetLayout = DescriptorSetLayout::Builder(m_device)
-			.addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_ALL_GRAPHICS)
+			.addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_ALL_GRAPHICS) // Global UBO, from the GPU frame arena
 			.addBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT)
+			.addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT)
+			.addBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT)
+			.addBinding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT)
+			.addBinding(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT)
+			.addBinding(6, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT) // Object data, from the GPU frame arena
 			.build();
 
 		// Build actual descriptor sets
-		std::vector<VkDescriptorSet> globalDescriptorSets(SwapChain::MAX_FRAMES_IN_FLIGHT);
+		std::vector<VkDescriptorSet> globalDescriptorSets(framesInFlight);
 		for (int i = 0; i < globalDescriptorSets.size(); i++) {
-			auto globalBufferInfo = uboBuffers[i]->descriptorInfo();
+			auto globalBufferInfo = gpuArena.getDescriptorInfo(sizeof(GlobalUbo));
+			auto lightBufferInfo = lightClusters.getLightBufferInfo(i);
+			auto clusterBufferInfo = lightClusters.getClusterBufferInfo(i);
+			auto lightIndexBufferInfo = lightClusters.getLightIndexBufferInfo(i);
+			auto objectLightIndexBufferInfo = lightSelector.getLightIndexBufferInfo(i);
+			auto objectBufferInfo = gpuArena.getDescriptorInfo(OBJECT_DATA_RANGE);
 			DescriptorWriter(*globalSetLayout, *m_globalPool)
 				.writeBuffer(0, &globalBufferInfo)
 				.writeImage(1, &shadowmapImageInfo)
+				.writeBuffer(2, &lightBufferInfo)
+				.writeBuffer(3, &clusterBufferInfo)
+				.writeBuffer(4, &lightIndexBufferInfo)
+				.writeBuffer(5, &objectLightIndexBufferInfo)
+				.writeBuffer(6, &objectBufferInfo)
 				.build(globalDescriptorSets[i]);
 		}
 
@@ -62,89 +99,610 @@ namespace OmniV {
 		renderSystems.reserve(MAX_CONCURRENT_RENDER_SYSTEMS);
 
 		std::unique_ptr<ShadowmapRenderSystem> shadowmapRenderSystem = nullptr;
+		RenderSystem* opaqueRenderSystem = nullptr; // The only system drawn in both passes when occlusion culling is enabled
+
+		// Shadowmaps, all cascades in a single pass when requested and supported
+		ShadowLayering shadowLayering = ShadowLayering::None;
+		if (m_enabledSystems.shadowmapRenderSystemEnable) {
+			if (m_renderSettings.singlePassShadows) {
+				shadowLayering = m_shadowmapRenderer->getLayering();
+				if (shadowLayering == ShadowLayering::None)
+					OV_DEBUG_LOG("Single pass shadows are not supported by this device, rendering one pass per cascade");
+			}
 
-		// Shadowmaps
-		if (m_enabledSystems.shadowmapRenderSystemEnable)
-			shadowmapRenderSystem = std::make_unique<ShadowmapRenderSystem>(m_device, m_shadowmapRenderer.getShadowmapRenderPass(), globalSetLayout->getDescriptorSetLayout());
-
-		// Main system
-		if (m_enabledSystems.simpleRenderSystemEnable)
-			renderSystems.emplace_back(std::make_unique<SimpleRenderSystem>(m_device, m_renderer.getRenderPass(), globalSetLayout->getDescriptorSetLayout()));
+			shadowmapRenderSystem = std::make_unique<ShadowmapRenderSystem>(m_device, m_shadowmapRenderer->getShadowmapRenderPass(), globalSetLayout->getDescriptorSetLayout(),
+				m_shadowmapRenderer->getShadowmapRenderPass(ShadowPassType::AllCascades), shadowLayering);
+		}
 
-		// Point lights
-		if (m_enabledSystems.pointLightRenderSystemEnable)
-			renderSystems.emplace_back(std::make_unique<PointLightRenderSystem>(m_device, m_renderer.getRenderPass(), globalSetLayout->getDescriptorSetLayout()));
+		// Main system. The deferred path lights in its own render pass, where the other systems draw after the lighting
+		std::unique_ptr<GBuffer> gBuffer;
+		std::unique_ptr<DeferredRenderSystem> deferredRenderSystem;
+		std::unique_ptr<DepthPrepassRenderSystem> depthPrepassRenderSystem; // Forward path only, drawn before the opaque system
+
+		if (m_enabledSystems.simpleRenderSystemEnable) {
+			if (m_renderSettings.renderPath == RenderPath::Deferred) {
+				gBuffer = std::make_unique<GBuffer>(m_device, m_renderer);
+				deferredRenderSystem = std::make_unique<DeferredRenderSystem>(m_device, *gBuffer, globalSetLayout->getDescriptorSetLayout(),
+					m_renderSettings.shadowmap.filter, m_renderSettings.debugCascades);
+				opaqueRenderSystem = deferredRenderSystem.get();
+
+				if (m_renderSettings.occlusionCulling)
+					OV_DEBUG_LOG("GPU occlusion culling needs the forward path, disabled");
+				if (m_renderSettings.lightAssignment == LightAssignment::PerObject)
+					OV_DEBUG_LOG("Per object light lists need the forward path, the deferred path uses the light clusters");
+				if (m_renderSettings.depthPrepass)
+					OV_DEBUG_LOG("The deferred path already shades each pixel once, depth pre-pass disabled");
+			}
+			else {
+				if (m_renderSettings.depthPrepass)
+					depthPrepassRenderSystem = std::make_unique<DepthPrepassRenderSystem>(m_device, m_renderer.getRenderPass(), globalSetLayout->getDescriptorSetLayout());
 
-		// Create player controller
-		KeyboardMovementController viewerController;
+				renderSystems.emplace_back(std::make_unique<SimpleRenderSystem>(m_device, m_renderer.getRenderPass(), globalSetLayout->getDescriptorSetLayout(),
+					m_renderSettings.shadowmap.filter, m_renderSettings.debugCascades, depthPrepassRenderSystem != nullptr));
+				opaqueRenderSystem = renderSystems.back().get();
+			}
+		}
 
-		// Main loop
-		auto currentTime = std::chrono::high_resolution_clock::now();
+		// Point lights
+		if (m_enabledSystems.pointLightRenderSystemEnable) {
+			VkRenderPass renderPass = gBuffer ? gBuffer->getRenderPass() : m_renderer.getRenderPass();
+			uint32_t subpass = gBuffer ? static_cast<uint32_t>(DeferredSubpass::Lighting) : 0;
+			renderSystems.emplace_back(std::make_unique<PointLightRenderSystem>(m_device, renderPass, globalSetLayout->getDescriptorSetLayout(), subpass));
+		}
 
-		while (!m_window.shouldClose()) {
+		// Occlusion culling
+		if (m_renderSettings.occlusionCulling && opaqueRenderSystem && !deferredRenderSystem)
+			m_occlusionCuller = std::make_unique<OcclusionCuller>(m_device, m_renderer);
 
-			glfwPollEvents(); // Process all pending events (window related)
+		if (m_renderSettings.softwareOcclusion)
+			m_softwareOcclusionCuller = std::make_unique<SoftwareOcclusionCuller>(m_jobSystem);
 
-			// Time management
-			const auto newTime = std::chrono::high_resolution_clock::now();
-			const float frameTime = std::chrono::duration<float, std::chrono::seconds::period>(newTime - currentTime).count();
-			currentTime = newTime;
+		// Far cascades can be refreshed less often than near ones
+		CascadeScheduler cascadeScheduler{ m_renderSettings.cascadeUpdatePeriods };
 
-			// Player movement & rotation
-			viewerController.moveInPlaneXZ(m_window.getGLFWwindow(), frameTime, m_camera.viewerGameObject.m_transform);
+		// Main pass GPU time, to compare lighting costs
+		GpuTimer mainPassTimer{ m_device, framesInFlight };
 
-			// Update camera matrices (View & Projection)
-			m_camera.updateMatricesValues(m_renderer.getAspectRatio());
+		// Command buffers of the frame, recorded inline or on several threads
+		CommandRecorder commandRecorder{ m_device, m_jobSystem, framesInFlight, m_renderSettings.recordingThreads };
 
-			// Frame
-			if (auto commandBuffer = m_renderer.beginFrame()) {
-				int frameIndex = m_renderer.getFrameIndex();
-				FrameInfo frameInfo{ frameIndex, frameTime, commandBuffer, m_camera, globalDescriptorSets[frameIndex], m_gameObjects };
+		// Passes of the frame and their barriers, rebuilt every frame. Owns the G-buffer images
+		RenderGraph renderGraph{ m_device };
 
-				GlobalUbo ubo;
+		// Create player controller
+		KeyboardMovementController viewerController;
 
-				// Update UBO
-				ubo.viewMat = m_camera.getView();
-				ubo.inverseViewMat = m_camera.getInverseView();
-				ubo.projMat = m_camera.getProjection();
-				ubo.ambientLight = m_renderSettings.ambientLight;
+		// The simulation runs on this thread, which owns the window's events and input, and the frames are recorded on a render thread
+		// Each simulation step is handed over as a snapshot, so that the next step is simulated while the current frame is recorded
+		SnapshotMailbox snapshots;
+		std::exception_ptr renderException;
+
+		// The simulation moves its own copies of the camera and of the moving objects, only the render thread writes to the game objects
+		TransformComponent viewerTransform = m_camera.viewerGameObject.m_transform;
+		std::vector<ObjectTransform> movingObjects;
+		for (auto& kv : m_gameObjects)
+			if (kv.second.m_pointLight != nullptr)
+				movingObjects.push_back({ kv.first, kv.second.m_transform });
+
+		// Paces the simulation steps, and through them the frames as each step is rendered once
+		FramePacer framePacer{ m_renderSettings.targetFps };
+
+		std::thread renderThread([&]() {
+			try {
+				float statsTimer = 0.0f;
+
+				while (true) {
+					// Latest simulation step, the same one is never rendered twice
+					snapshots.waitForSnapshot();
+					const FrameSnapshot* snapshot = snapshots.acquire();
+					if (snapshot == nullptr)
+						break; // Closed by the simulation
+
+					const float frameTime = snapshot->frameTime;
+					m_camera.viewerGameObject.m_transform = snapshot->viewerTransform;
+					for (const ObjectTransform& object : snapshot->transforms)
+						m_gameObjects.at(object.objectID).m_transform = object.transform;
+
+					// Nothing to present to, the simulation keeps the window's events flowing until it's restored
+					if (m_window.isMinimized())
+						continue;
+
+					// Update camera matrices (View & Projection)
+					m_camera.updateMatricesValues(m_renderer.getAspectRatio());
+
+					// Load and evict meshes around the camera, before the frame references any of them
+					if (m_meshStreamer)
+						m_meshStreamer->update(m_gameObjects, m_camera.getPosition());
+
+					// Frame
+					if (auto commandBuffer = m_renderer.beginFrame()) {
+						int frameIndex = m_renderer.getFrameIndex();
+						FrameInfo frameInfo{ frameIndex, frameTime, commandBuffer, m_camera, globalDescriptorSets[frameIndex], m_gameObjects };
+
+						// This frame's fence was waited on by beginFrame, its region of the arena is free again
+						gpuArena.beginFrame(frameIndex);
+						frameInfo.gpuArena = &gpuArena;
+
+						// Lights of the frame, which the lighting permutations depend on
+						uint32 directionalLightCount = 0;
+						updateLights(frameInfo, frameLights, directionalLightCount);
+						frameInfo.directionalLightCount = directionalLightCount;
+						frameInfo.pointLightCount = static_cast<uint32>(frameLights.size()) - directionalLightCount;
+						frameInfo.shadows = shadowmapRenderSystem != nullptr;
+
+						// Pipelines of the frame, picked before the opaque draws are sorted by them and before any chunk is recorded
+						for (auto& renderSystem : renderSystems)
+							renderSystem->prepare(frameInfo);
+
+						if (deferredRenderSystem)
+							deferredRenderSystem->prepare(frameInfo);
+
+						// Sort this frame's opaque draws once, both the shadow and main passes consume the same queue
+						uint32 opaquePipelineID = opaqueRenderSystem ? opaqueRenderSystem->getPipelineID() : 0;
+						m_renderQueue.build(m_gameObjects, m_camera, opaquePipelineID);
+						frameInfo.renderQueue = &m_renderQueue;
+						m_renderQueue.resetBindState(commandBuffer);
+
+						// Same frame CPU culling, the camera pass skips what ends up hidden behind the occluders
+						if (m_softwareOcclusionCuller) {
+							glm::mat4 viewProjMat = m_camera.getProjection() * m_camera.getView();
+							m_softwareOcclusionCuller->rasterizeOccluders(m_gameObjects, viewProjMat);
+							m_softwareOcclusionCuller->cull(m_renderQueue, viewProjMat);
+						}
+
+						if (m_occlusionCuller)
+							m_occlusionCuller->prepare(frameInfo);
+
+						GlobalUbo ubo;
+
+						// Update UBO
+						ubo.viewMat = m_camera.getView();
+						ubo.inverseViewMat = m_camera.getInverseView();
+						ubo.projMat = m_camera.getProjection();
+						ubo.ambientLight = m_renderSettings.ambientLight;
+
+						lightClusters.build(frameIndex, frameLights, directionalLightCount, m_camera, m_renderer.getSwapChainExtent(), ubo);
+
+						if (m_renderSettings.lightAssignment == LightAssignment::PerObject && !deferredRenderSystem) {
+							lightSelector.build(frameIndex, m_renderQueue, frameLights, directionalLightCount);
+							frameInfo.lightSelector = &lightSelector;
+						}
+
+						// Matrix from light's point of view (directional lights only, the first one casts the shadows)
+						glm::vec3 sunDirection = directionalLightCount > 0 ? glm::vec3(frameLights[0].position) : glm::vec3(1.0f, 1.0f, 0.0f);
+						glm::mat4 lightViewMat = glm::lookAt(m_camera.getPosition() - sunDirection, m_camera.getPosition(), glm::vec3(0.0f, -1.0f, 0.0f));
+
+						getCascadeMatrices(lightViewMat, m_camera, m_renderer.getAspectRatio(), m_renderSettings.shadowmap.cascadeResolutions, ubo.cascadesMats, ubo.cascadeSplits);
+
+						// Skipped cascades keep the matrix their shadowmap layer was rendered with
+						cascadeScheduler.update(ubo.cascadesMats);
+
+						for (uint32_t i = 0; i < SHADOWMAP_CASCADE_COUNT; i++) {
+							ubo.cascadeAtlasRects[i] = m_shadowmapRenderer->getCascadeAtlasRect(i);
+							ubo.cascadeLayers[i] = m_shadowmapRenderer->getCascadeRegion(i).layer;
+						}
+
+						// Upload UBO
+						GpuAllocation uboAllocation = gpuArena.allocateUniform(sizeof(GlobalUbo));
+						memcpy(uboAllocation.data, &ubo, sizeof(GlobalUbo));
+						frameInfo.globalOffsets[0] = uboAllocation.getDynamicOffset();
+
+						// Transforms and light lists of the queue's objects, computed once for the shadow, pre-pass and main passes
+						frameInfo.globalOffsets[1] = writeObjectData(frameInfo);
+
+						// The frame is described first, then recorded at once (in parallel when recording threads are enabled)
+						commandRecorder.begin(frameIndex);
+						const VkSubpassContents contents = commandRecorder.getSubpassContents();
+
+						// Records "render" with its own copy of the frame info, on whichever command buffer the content ends up in
+						auto addDraws = [&commandRecorder](const FrameInfo& info, std::function<void(FrameInfo&)> render) {
+							commandRecorder.addContent([contentInfo = info, render](VkCommandBuffer contentCommandBuffer) mutable {
+								contentInfo.commandBuffer = contentCommandBuffer;
+								render(contentInfo);
+							});
+						};
+
+						// The opaque systems are split in ranges of the render queue, one per recording thread
+						auto addChunkedDraws = [&](const FrameInfo& info, RenderSystem* renderSystem) {
+							const uint32 packetCount = m_renderQueue.size();
+							const uint32 chunkCount = std::max(std::min(commandRecorder.getThreadCount(), packetCount), 1u);
+							const uint32 chunkSize = (packetCount + chunkCount - 1) / chunkCount;
+
+							for (uint32 i = 0; i < chunkCount; i++) {
+								FrameInfo chunkInfo = info;
+								chunkInfo.firstPacket = i * chunkSize;
+								chunkInfo.lastPacket = std::min(packetCount, (i + 1) * chunkSize);
+								addDraws(chunkInfo, [renderSystem](FrameInfo& chunk) { renderSystem->render(chunk); });
+							}
+						};
+
+						// Shadowmap render passes
+						uint32_t updatedCascadeMask = 0;
+						for (uint32_t i = 0; i < SHADOWMAP_CASCADE_COUNT; i++)
+							if (cascadeScheduler.isCascadeUpdated(i))
+								updatedCascadeMask |= 1u << i;
+
+						ShadowmapRenderSystem* shadowSystem = shadowmapRenderSystem.get();
+
+						// One cascade per pass, each pass is a content of its own
+						auto addCascadePass = [&](uint32_t cascadeIndex, ShadowPassType type, ShadowCasterFilter casterFilter) {
+							ShadowmapRenderer* shadowmapRenderer = m_shadowmapRenderer.get();
+
+							commandRecorder.addPrimary([=](VkCommandBuffer primary) {
+								shadowmapRenderer->beginShadowmapRenderPass(primary, cascadeIndex, type, contents);
+							});
+
+							if (shadowSystem) {
+								commandRecorder.setSubpass(shadowmapRenderer->getShadowmapRenderPass(type), 0, [=](VkCommandBuffer contentCommandBuffer) {
+									shadowmapRenderer->recordPassState(contentCommandBuffer, cascadeIndex, type);
+								});
+
+								ShadowCasterPass pass{ cascadeIndex, casterFilter, 0 };
+								addDraws(frameInfo, [shadowSystem, pass](FrameInfo& info) { shadowSystem->render(info, pass); });
+							}
+
+							commandRecorder.addPrimary([=](VkCommandBuffer primary) { shadowmapRenderer->endCurrentRenderPass(primary); });
+						};
+
+						// Every caster once for all the updated cascades. Kept inline, as the pass clears the cascades it draws
+						auto addAllCascadesPass = [&](bool fromStaticCache, ShadowCasterFilter casterFilter) {
+							if (updatedCascadeMask == 0)
+								return;
+
+							commandRecorder.addPrimary([this, shadowSystem, info = frameInfo, updatedCascadeMask, fromStaticCache, casterFilter](VkCommandBuffer primary) mutable {
+								m_shadowmapRenderer->prepareAllCascades(primary, updatedCascadeMask, fromStaticCache);
+
+								m_shadowmapRenderer->beginShadowmapRenderPass(primary, 0, ShadowPassType::AllCascades);
+								info.commandBuffer = primary;
+								shadowSystem->render(info, ShadowCasterPass{ 0, casterFilter, updatedCascadeMask });
+								m_shadowmapRenderer->endCurrentRenderPass(primary);
+							});
+						};
+
+						// The frame as a render graph: passes declare the resources they use, the graph culls the passes whose results are never used,
+						// derives the barriers between them and places the transient images
+						renderGraph.reset();
+
+						const uint32_t imageIndex = m_renderer.getImageIndex();
+						const RenderResource swapChainColor = renderGraph.importImage("Swapchain color", m_renderer.getImage(imageIndex), VK_IMAGE_ASPECT_COLOR_BIT);
+						const RenderResource swapChainDepth = renderGraph.importImage("Swapchain depth", m_renderer.getDepthImage(imageIndex), VK_IMAGE_ASPECT_DEPTH_BIT);
+						renderGraph.markOutput(swapChainColor); // Presented
+
+						// Sampled by the main pass when shadows are enabled, its shaders are specialized without shadows otherwise
+						const ResourceUsage shadowmapRead{ VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL };
+						const RenderResource shadowmap = renderGraph.importImage("Shadow atlas", m_shadowmapRenderer->getShadowmapImage(), VK_IMAGE_ASPECT_DEPTH_BIT, shadowmapRead);
+
+						// The shadow renderer transitions the layers it renders itself, and its render passes order them with the main pass
+						renderGraph.addPass("Shadows", [&](RenderGraph::PassBuilder& pass) {
+							pass.write(shadowmap, { VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+								VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, true });
+						}, [&](CommandRecorder&) {
+							if (m_hasStaticCasters && shadowmapRenderSystem)
+							{
+								// Static casters currently in the queue (streamed meshes come and go)
+								std::size_t staticCastersHash = 0;
+								for (const DrawPacket& packet : m_renderQueue)
+									if (packet.object->m_isStatic)
+										hashCombine(staticCastersHash, packet.object->getObjectID(), packet.model->getModelID());
+
+								// Static layers, only when the cascade moved or the static casters changed
+								for (uint32_t i = 0; i < SHADOWMAP_CASCADE_COUNT; i++)
+								{
+									if (!cascadeScheduler.isCascadeUpdated(i) || !m_shadowmapRenderer->updateStaticCache(i, ubo.cascadesMats[i], staticCastersHash))
+										continue;
+
+									addCascadePass(i, ShadowPassType::StaticCache, ShadowCasterFilter::Static);
+								}
+
+								// Dynamic casters on top of a copy of the static layers
+								if (shadowLayering != ShadowLayering::None)
+								{
+									addAllCascadesPass(true, ShadowCasterFilter::Dynamic);
+								}
+								else
+								{
+									for (uint32_t i = 0; i < SHADOWMAP_CASCADE_COUNT; i++)
+									{
+										if (!cascadeScheduler.isCascadeUpdated(i))
+											continue;
+
+										commandRecorder.addPrimary([this, i](VkCommandBuffer primary) { m_shadowmapRenderer->copyStaticLayer(primary, i); });
+										addCascadePass(i, ShadowPassType::Dynamic, ShadowCasterFilter::Dynamic);
+									}
+								}
+							}
+							else if (shadowLayering != ShadowLayering::None)
+							{
+								addAllCascadesPass(false, ShadowCasterFilter::All);
+							}
+							else
+							{
+								for (uint32_t i = 0; i < SHADOWMAP_CASCADE_COUNT; i++)
+								{
+									if (cascadeScheduler.isCascadeUpdated(i))
+										addCascadePass(i, ShadowPassType::Full, ShadowCasterFilter::All);
+								}
+							}
+						});
+
+						// Main render passes. Their attachments are ordered with the other passes by the subpass dependencies of the render passes
+						auto colorAttachment = [](VkImageLayout initialLayout, VkImageLayout finalLayout) {
+							return ResourceUsage{ VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+								initialLayout, finalLayout, true };
+						};
+						auto depthAttachment = [](VkImageLayout initialLayout, VkImageLayout finalLayout) {
+							return ResourceUsage{ VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+								VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, initialLayout, finalLayout, true };
+						};
+
+						auto recordMainPassState = [this](VkCommandBuffer contentCommandBuffer) { m_renderer.recordPassState(contentCommandBuffer); };
+
+						// Every system of the last main pass, the opaque one split in chunks
+						auto addMainPassDraws = [&](const FrameInfo& info) {
+							if (depthPrepassRenderSystem)
+								addChunkedDraws(info, depthPrepassRenderSystem.get());
+
+							for (auto& renderSystem : renderSystems) {
+								if (renderSystem.get() == opaqueRenderSystem) {
+									addChunkedDraws(info, opaqueRenderSystem);
+								}
+								else {
+									RenderSystem* system = renderSystem.get();
+									addDraws(info, [system](FrameInfo& systemInfo) { system->render(systemInfo); });
+								}
+							}
+						};
+
+						RenderResource albedo = 0;
+						RenderResource normal = 0;
+
+						if (deferredRenderSystem) {
+							albedo = renderGraph.createImage("G-buffer albedo", gBuffer->getImageDesc(GBuffer::ALBEDO_FORMAT));
+							normal = renderGraph.createImage("G-buffer normal", gBuffer->getImageDesc(GBuffer::NORMAL_FORMAT));
+
+							renderGraph.addPass("Deferred pass", [&](RenderGraph::PassBuilder& pass) {
+								if (frameInfo.shadows)
+									pass.read(shadowmap, shadowmapRead);
+								pass.write(albedo, colorAttachment(VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+								pass.write(normal, colorAttachment(VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+								pass.write(swapChainColor, colorAttachment(VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR));
+								pass.write(swapChainDepth, depthAttachment(VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL));
+							}, [&](CommandRecorder&) {
+								GBuffer* deferredBuffer = gBuffer.get();
+
+								commandRecorder.addPrimary([&mainPassTimer, frameIndex](VkCommandBuffer primary) { mainPassTimer.begin(primary, frameIndex); });
+
+								commandRecorder.addPrimary([deferredBuffer, contents](VkCommandBuffer primary) { deferredBuffer->beginRenderPass(primary, contents); });
+								commandRecorder.setSubpass(deferredBuffer->getRenderPass(), static_cast<uint32_t>(DeferredSubpass::Geometry),
+									[deferredBuffer](VkCommandBuffer contentCommandBuffer) { deferredBuffer->recordPassState(contentCommandBuffer); });
+								addChunkedDraws(frameInfo, deferredRenderSystem.get());
+
+								commandRecorder.addPrimary([deferredBuffer, contents](VkCommandBuffer primary) { deferredBuffer->nextSubpass(primary, contents); });
+								commandRecorder.setSubpass(deferredBuffer->getRenderPass(), static_cast<uint32_t>(DeferredSubpass::Lighting),
+									[deferredBuffer](VkCommandBuffer contentCommandBuffer) { deferredBuffer->recordPassState(contentCommandBuffer); });
+
+								DeferredRenderSystem* lightingSystem = deferredRenderSystem.get();
+								addDraws(frameInfo, [lightingSystem](FrameInfo& info) { lightingSystem->renderLighting(info); });
+
+								// Forward systems after the lighting (the opaque one is the deferred system)
+								addMainPassDraws(frameInfo);
+
+								commandRecorder.addPrimary([deferredBuffer](VkCommandBuffer primary) { deferredBuffer->endRenderPass(primary); });
+								commandRecorder.addPrimary([&mainPassTimer, frameIndex](VkCommandBuffer primary) { mainPassTimer.end(primary, frameIndex); });
+							});
+						}
+						else if (m_occlusionCuller) {
+							frameInfo.occlusionCuller = m_occlusionCuller.get();
+
+							const ResourceUsage computeRead{ VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT };
+							const ResourceUsage computeWrite{ VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT };
+							const ResourceUsage computeReadWrite{ VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT };
+							const ResourceUsage indirectRead{ VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT };
+
+							// The visibility buffer was last written by the previous frame's tests, and the Hi-Z read by them
+							// Draw commands and stats were reset by the CPU (prepare), the stats are read back once the frame is done
+							const RenderResource visibility = renderGraph.importBuffer("Visibility", m_occlusionCuller->getVisibilityBuffer(), computeReadWrite);
+							const RenderResource drawCommands = renderGraph.importBuffer("Draw commands", m_occlusionCuller->getDrawCommandBuffer(frameIndex));
+							const RenderResource cullingStats = renderGraph.importBuffer("Culling stats", m_occlusionCuller->getStatsBuffer(frameIndex));
+							const RenderResource hiZ = renderGraph.importImage("Hi-Z", m_occlusionCuller->getHiZImage(), VK_IMAGE_ASPECT_COLOR_BIT,
+								{ VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL });
+							renderGraph.markOutput(cullingStats, { VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT });
+
+							// Records "cull" on the primary command buffer with its own copy of the frame info
+							auto addCullPass = [&](const char* name, const RenderGraph::SetupFunction& setup, void (OcclusionCuller::*cull)(FrameInfo&)) {
+								renderGraph.addPass(name, setup, [this, &commandRecorder, &frameInfo, cull](CommandRecorder&) {
+									commandRecorder.addPrimary([this, info = frameInfo, cull](VkCommandBuffer primary) mutable {
+										info.commandBuffer = primary;
+										(m_occlusionCuller.get()->*cull)(info);
+									});
+								});
+							};
+
+							// Objects visible last frame
+							addCullPass("Cull previously visible", [&](RenderGraph::PassBuilder& pass) {
+								pass.read(visibility, computeRead);
+								pass.write(drawCommands, computeWrite);
+							}, &OcclusionCuller::cullPreviouslyVisible);
+
+							renderGraph.addPass("Main pass (previously visible)", [&](RenderGraph::PassBuilder& pass) {
+								pass.read(drawCommands, indirectRead);
+								if (frameInfo.shadows)
+									pass.read(shadowmap, shadowmapRead);
+								pass.write(swapChainColor, colorAttachment(VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL));
+								pass.write(swapChainDepth, depthAttachment(VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL));
+							}, [&](CommandRecorder&) {
+								FrameInfo firstPassInfo = frameInfo;
+								firstPassInfo.cullPhase = CullPhase::PreviouslyVisible;
+
+								commandRecorder.addPrimary([&mainPassTimer, frameIndex](VkCommandBuffer primary) { mainPassTimer.begin(primary, frameIndex); });
+								commandRecorder.addPrimary([this, contents](VkCommandBuffer primary) { m_renderer.beginRenderPass(primary, MainPassType::First, contents); });
+								commandRecorder.setSubpass(m_renderer.getRenderPass(MainPassType::First), 0, recordMainPassState);
+								if (depthPrepassRenderSystem)
+									addChunkedDraws(firstPassInfo, depthPrepassRenderSystem.get());
+								addChunkedDraws(firstPassInfo, opaqueRenderSystem);
+								commandRecorder.addPrimary([this](VkCommandBuffer primary) { m_renderer.endRenderPass(primary); });
+							});
+
+							// Objects that just became visible
+							addCullPass("Hi-Z build", [&](RenderGraph::PassBuilder& pass) {
+								pass.read(swapChainDepth, { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL });
+								pass.write(hiZ, { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL });
+							}, &OcclusionCuller::buildHiZ);
+
+							addCullPass("Cull newly visible", [&](RenderGraph::PassBuilder& pass) {
+								pass.read(hiZ, { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL });
+								pass.write(visibility, computeReadWrite);
+								pass.write(drawCommands, computeWrite);
+								pass.write(cullingStats, computeReadWrite);
+							}, &OcclusionCuller::cullNewlyVisible);
+
+							// Then everything else
+							renderGraph.addPass("Main pass", [&](RenderGraph::PassBuilder& pass) {
+								pass.read(drawCommands, indirectRead);
+								if (frameInfo.shadows)
+									pass.read(shadowmap, shadowmapRead);
+								pass.write(swapChainColor, colorAttachment(VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR));
+								pass.write(swapChainDepth, depthAttachment(VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL));
+							}, [&](CommandRecorder&) {
+								FrameInfo lastPassInfo = frameInfo;
+								lastPassInfo.cullPhase = CullPhase::NewlyVisible;
+
+								commandRecorder.addPrimary([this, contents](VkCommandBuffer primary) { m_renderer.beginRenderPass(primary, MainPassType::Last, contents); });
+								commandRecorder.setSubpass(m_renderer.getRenderPass(MainPassType::Last), 0, recordMainPassState);
+								addMainPassDraws(lastPassInfo);
+								commandRecorder.addPrimary([this](VkCommandBuffer primary) { m_renderer.endRenderPass(primary); });
+								commandRecorder.addPrimary([&mainPassTimer, frameIndex](VkCommandBuffer primary) { mainPassTimer.end(primary, frameIndex); });
+							});
+						}
+						else {
+							renderGraph.addPass("Main pass", [&](RenderGraph::PassBuilder& pass) {
+								if (frameInfo.shadows)
+									pass.read(shadowmap, shadowmapRead);
+								pass.write(swapChainColor, colorAttachment(VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR));
+								pass.write(swapChainDepth, depthAttachment(VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL));
+							}, [&](CommandRecorder&) {
+								commandRecorder.addPrimary([&mainPassTimer, frameIndex](VkCommandBuffer primary) { mainPassTimer.begin(primary, frameIndex); });
+								commandRecorder.addPrimary([this, contents](VkCommandBuffer primary) { m_renderer.beginRenderPass(primary, MainPassType::Single, contents); });
+								commandRecorder.setSubpass(m_renderer.getRenderPass(), 0, recordMainPassState);
+								addMainPassDraws(frameInfo);
+								commandRecorder.addPrimary([this](VkCommandBuffer primary) { m_renderer.endRenderPass(primary); });
+								commandRecorder.addPrimary([&mainPassTimer, frameIndex](VkCommandBuffer primary) { mainPassTimer.end(primary, frameIndex); });
+							});
+						}
+
+						renderGraph.compile();
+
+						// The G-buffer's framebuffers follow wherever the graph placed its images
+						if (gBuffer)
+							gBuffer->update(renderGraph.getImageView(albedo), renderGraph.getImageView(normal));
+
+						renderGraph.execute(commandRecorder);
+						commandRecorder.record(commandBuffer, m_renderQueue);
+
+						m_renderer.endFrame();
+
+						statsTimer += frameTime;
+						if (statsTimer >= 2.0f) {
+							const RenderStats stats = m_renderQueue.getStats();
+							OV_DEBUG_LOG("Draws: " << stats.drawCalls
+								<< " | Pipeline binds: " << stats.pipelineBinds << " (" << stats.pipelineBindsSkipped << " skipped)"
+								<< " | Model binds: " << stats.modelBinds << " (" << stats.modelBindsSkipped << " skipped)"
+								<< " | Recording: " << commandRecorder.getRecordTime() << " ms (" << (commandRecorder.isParallel() ? std::to_string(commandRecorder.getThreadCount()) + " threads" : std::string("inline")) << ")");
+
+							const RenderGraphStats& graphStats = renderGraph.getStats();
+							OV_DEBUG_LOG("Render graph passes: " << graphStats.passes << " (" << graphStats.culledPasses << " culled)"
+								<< " | Barriers: " << graphStats.barriers << " (" << graphStats.imageBarriers << " layout transitions)"
+								<< " | Transient memory: " << (graphStats.transientBytes >> 10) << " KB (" << (graphStats.aliasedBytes >> 10) << " KB saved by aliasing)");
+
+							const GpuArenaStats& arenaStats = gpuArena.getStats();
+							OV_DEBUG_LOG("GPU frame arena: " << (arenaStats.usedBytes >> 10) << " KB in " << arenaStats.allocations << " allocations"
+								<< " | Peak: " << (arenaStats.peakBytes >> 10) << " KB of " << (arenaStats.capacity >> 10) << " KB");
+
+							const LightClusterStats& lightStats = lightClusters.getStats();
+							OV_DEBUG_LOG("Point lights: " << lightStats.pointLights
+								<< " | Cluster light indices: " << lightStats.lightIndices << " (max " << lightStats.maxClusterLights << " per cluster, " << lightStats.droppedIndices << " dropped)"
+								<< " | Cluster build: " << lightStats.buildTime << " ms | Main pass GPU (" << (deferredRenderSystem ? "deferred" : depthPrepassRenderSystem ? "forward + depth pre-pass" : "forward") << "): " << mainPassTimer.getTime() << " ms");
+
+							if (m_renderSettings.lightAssignment == LightAssignment::PerObject && !deferredRenderSystem) {
+								const LightSelectionStats& selectionStats = lightSelector.getStats();
+								OV_DEBUG_LOG("Per object lights: " << selectionStats.selectedLights << " over " << selectionStats.objects << " objects"
+									<< " | Objects over the cap: " << selectionStats.truncatedObjects);
+							}
+
+							if (m_occlusionCuller) {
+								const CullingStats& cullingStats = m_occlusionCuller->getStats();
+								OV_DEBUG_LOG("Objects drawn: " << cullingStats.drawn
+									<< " | Frustum culled: " << cullingStats.frustumCulled
+									<< " | Occlusion culled: " << cullingStats.occlusionCulled);
+							}
+
+							if (m_softwareOcclusionCuller) {
+								const SoftwareOcclusionStats& occlusionStats = m_softwareOcclusionCuller->getStats();
+								OV_DEBUG_LOG("Occluder triangles: " << occlusionStats.occluderTriangles
+									<< " | CPU culled: " << occlusionStats.culledObjects << "/" << occlusionStats.testedObjects
+									<< " | Raster: " << occlusionStats.rasterizationTime << " ms | Test: " << occlusionStats.testTime << " ms");
+							}
+
+							if (m_meshStreamer) {
+								const StreamingStats& streamingStats = m_meshStreamer->getStats();
+								OV_DEBUG_LOG("Resident meshes: " << streamingStats.residentMeshes << " (" << (streamingStats.residentBytes >> 10) << " KB)"
+									<< " | Pending: " << streamingStats.pendingLoads
+									<< " | Uploaded: " << (streamingStats.uploadedBytes >> 10) << " KB | Evicted: " << streamingStats.evictions);
+								m_meshStreamer->resetCounters();
+							}
+
+							const FramePacingStats pacingStats = framePacer.takeStats();
+							OV_DEBUG_LOG("Frame time: " << pacingStats.averageFrameTime << " ms (smoothed " << pacingStats.smoothedFrameTime << " ms)" << (framePacer.isLimited() ? " (limited to " + std::to_string(std::lround(m_renderSettings.targetFps)) + " FPS)" : std::string())
+								<< " | Jitter: " << pacingStats.jitter << " ms (worst " << pacingStats.maxDeviation << " ms)"
+								<< " | Sleep: " << pacingStats.sleepTime << " ms | Spin: " << pacingStats.spinTime << " ms per frame");
+							statsTimer = 0.0f;
+						}
+					}
+				}
+			}
+			catch (...) {
+				renderException = std::current_exception();
+			}
 
-				updateLights(frameInfo, ubo);
+			snapshots.close();
+		});
 
-				// Matrix from light's point of view (directional lights only)
-				glm::mat4 lightViewMat = glm::lookAt(m_camera.getPosition() + glm::vec3(-ubo.lights[0].position), m_camera.getPosition(), glm::vec3(0.0f, -1.0f, 0.0f));
+		uint64 sequence = 0;
 
-				getCascadeMatrices(lightViewMat, m_camera, m_renderer.getAspectRatio(), ubo.cascadesMats, ubo.cascadeSplits);
+		while (!m_window.shouldClose() && !snapshots.isClosed()) {
 
-				// Upload UBOs
-				uboBuffers[frameIndex]->writeToBuffer(&ubo);
-				uboBuffers[frameIndex]->flush();
+			// Time management. Waits before the input is read, so that the wait adds no input latency
+			const float frameTime = framePacer.waitForNextFrame();
 
-				// Shadowmap render passes
-				for (uint32_t i = 0; i < SHADOWMAP_CASCADE_COUNT; i++)
-				{
-					m_shadowmapRenderer.beginShadowmapRenderPass(commandBuffer, i);
+			glfwPollEvents(); // Process all pending events (window related)
 
-					if (shadowmapRenderSystem)
-					{
-						shadowmapRenderSystem->m_activeCascadeIndex = i;
-						shadowmapRenderSystem->render(frameInfo);
-					}
+			// Player movement & rotation
+			viewerController.moveInPlaneXZ(m_window.getGLFWwindow(), frameTime, viewerTransform);
 
-					m_shadowmapRenderer.endCurrentRenderPass(commandBuffer);
-				}
+			// Continious rotation for point lights
+			if (ROTATE_LIGHTS) {
+				auto rotateLight = glm::rotate(glm::mat4(1.f), 0.5f * frameTime, { 0.f, -1.f, 0.f });
+				for (ObjectTransform& object : movingObjects)
+					object.transform.position = glm::vec3(rotateLight * glm::vec4(object.transform.position, 1.f));
+			}
 
-				// Swapchain render pass
-				m_renderer.beginRenderPass(commandBuffer);
+			FrameSnapshot& snapshot = snapshots.getWriteSlot();
+			snapshot.sequence = ++sequence;
+			snapshot.frameTime = frameTime;
+			snapshot.viewerTransform = viewerTransform;
+			snapshot.transforms.assign(movingObjects.begin(), movingObjects.end());
+			snapshots.publish();
 
-				for (unsigned i = 0; i < renderSystems.size(); i++)
-					renderSystems[i]->render(frameInfo);
+			// At most one step ahead of the render thread
+			while (!snapshots.waitForAcquire(sequence, std::chrono::milliseconds(10)))
+				glfwPollEvents();
+		}
 
-				m_renderer.endRenderPass(commandBuffer);
+		snapshots.close();
+		renderThread.join();
 
-				m_renderer.endFrame();
-			}
-		}
+		if (renderException)
+			std::rethrow_exception(renderException);
 
 		// Wait until all operations are completed before closing the window
 		vkDeviceWaitIdle(m_device.device());
@@ -191,12 +749,23 @@ namespace OmniV {
 
 		// Render Settings parsing
 		m_renderSettings = RenderSettings::loadRenderSettings(sceneNode.child("rendersettings"));
+		m_renderer.setSwapChainSettings(m_renderSettings.swapChain);
 
 		// Camera parsing
 		m_camera = Camera::loadCameraFromNode(sceneNode.child("camera"));
 
-		// Meshes parsing
-		std::shared_ptr<Model> model;
+		// In streaming mode meshes are only registered here, and loaded once the camera gets close to them
+		if (m_renderSettings.streaming.enabled)
+			m_meshStreamer = std::make_unique<MeshStreamer>(m_device, m_renderSettings.streaming);
+
+		// Meshes parsing. Obj files are parsed by jobs once every mesh node is read, then uploaded in order from this thread
+		struct PendingModel {
+			GameObject::id_t objectID;
+			std::string filepath;
+			Model::Builder builder;
+		};
+		std::vector<PendingModel> pendingModels;
+
 		for (pugi::xml_node meshNode = sceneNode.child("mesh"); meshNode; meshNode = meshNode.next_sibling("mesh"))
 		{
 			if (!meshNode.attribute("type"))
@@ -209,17 +778,50 @@ namespace OmniV {
 
 				auto gameObject = GameObject::createGameObject();
 
+				// Occluders keep a CPU copy of their geometry for the software occlusion culler
+				bool isOccluder = meshNode.child("occluder") ? toBool(meshNode.child("occluder").attribute("enabled").value()) : false;
+
 				std::string objPath = meshNode.find_child_by_attribute("name", "filename").attribute("value").value();
-				model = Model::createModelFromFile(m_device, objPath);
-				gameObject.m_model = model;
+				gameObject.m_isOccluder = isOccluder;
+				gameObject.m_isStatic = meshNode.child("static") ? toBool(meshNode.child("static").attribute("enabled").value()) : false;
+				m_hasStaticCasters |= gameObject.m_isStatic;
 				gameObject.m_transform.initializeFromNode(meshNode.child("transform"));
 
+				if (m_meshStreamer) {
+					// Proxy bounds in model space, as <bounds min="x y z" max="x y z"/>. A unit cube around the origin if not given
+					glm::vec3 boundsMin{ -1.0f }, boundsMax{ 1.0f };
+					if (pugi::xml_node boundsNode = meshNode.child("bounds")) {
+						boundsMin = toVector3f(boundsNode.attribute("min").value());
+						boundsMax = toVector3f(boundsNode.attribute("max").value());
+					}
+
+					m_meshStreamer->registerProxy(gameObject.getObjectID(), objPath, boundsMin, boundsMax, isOccluder);
+				}
+				else {
+					PendingModel& pendingModel = pendingModels.emplace_back();
+					pendingModel.objectID = gameObject.getObjectID();
+					pendingModel.filepath = "models/" + objPath;
+					pendingModel.builder.keepCpuGeometry = isOccluder;
+				}
+
 				m_gameObjects.emplace(gameObject.getObjectID(), std::move(gameObject));
 			}
 
 			assert(m_gameObjects.size() < MAX_GAME_OBJECTS && "Exceeded maximum number of objects in scene");
 		}
 
+		JobCounter modelParsing;
+		m_jobSystem.parallelFor(static_cast<uint32>(pendingModels.size()), 1, [&pendingModels](uint32 first, uint32 end) {
+			for (uint32 i = first; i < end; i++)
+				pendingModels[i].builder.loadModel(pendingModels[i].filepath);
+		}, modelParsing, "Parse obj");
+
+		m_jobSystem.wait(modelParsing);
+
+		// Uploads go through the device's single time commands, which aren't thread safe
+		for (PendingModel& pendingModel : pendingModels)
+			m_gameObjects.at(pendingModel.objectID).m_model = std::make_shared<Model>(m_device, pendingModel.builder);
+
 		// Lights parsing
 		for (pugi::xml_node lightNode = sceneNode.child("light"); lightNode; lightNode = lightNode.next_sibling("light"))
 		{
@@ -233,45 +835,117 @@ namespace OmniV {
 
 			assert(m_gameObjects.size() < MAX_GAME_OBJECTS && "Exceeded maximum number of objects in scene");
 		}
+
+		// Debug lights fill what the scene's lights leave of the light buffer
+		uint32 sceneLightCount = 0;
+		for (auto& kv : m_gameObjects)
+			if (kv.second.m_pointLight != nullptr || kv.second.m_directionalLight != nullptr)
+				sceneLightCount++;
+
+		const uint32 maxDebugLights = MAX_LIGHTS - std::min(sceneLightCount, uint32(MAX_LIGHTS));
+		if (m_renderSettings.debugLightCount > maxDebugLights) {
+			OV_DEBUG_LOG("The scene declares " << sceneLightCount << " lights, debug lights limited to " << maxDebugLights << " (max " << MAX_LIGHTS << " lights)");
+			m_renderSettings.debugLightCount = maxDebugLights;
+		}
+
+		// Debug lights, with a fixed seed so that measurements can be repeated
+		std::mt19937 randomEngine(0);
+		std::uniform_real_distribution<float> random(0.0f, 1.0f);
+		const float extent = m_renderSettings.debugLightExtent;
+
+		for (uint32 i = 0; i < m_renderSettings.debugLightCount; i++)
+		{
+			glm::vec3 color{ random(randomEngine), random(randomEngine), random(randomEngine) };
+			auto lightGameObject = GameObject::makeSimplePointLight(false, color, 0.2f, 0.1f);
+			lightGameObject.m_transform.position = { extent * (2.0f * random(randomEngine) - 1.0f), -random(randomEngine), extent * (2.0f * random(randomEngine) - 1.0f) };
+
+			m_gameObjects.emplace(lightGameObject.getObjectID(), std::move(lightGameObject));
+
+			assert(m_gameObjects.size() < MAX_GAME_OBJECTS && "Exceeded maximum number of objects in scene");
+		}
 	}
 
 	// User-defined function
-	void EngineApp::updateLights(FrameInfo& frameInfo, GlobalUbo& ubo) {
-		// Continious rotation for lights
-		auto rotateLight = glm::rotate(glm::mat4(1.f), 0.5f * frameInfo.frameTime, { 0.f, -1.f, 0.f });
+	// Point lights are moved by the simulation thread, their transforms come from the frame's snapshot
+	void EngineApp::updateLights(FrameInfo& frameInfo, std::vector<Light>& outLights, uint32& outDirectionalCount) {
+		outLights.clear();
+		uint32 droppedLights = 0;
 
-		int lightIndex = 0;
+		// Directional lights are evaluated by every fragment, so they go first
 		for (auto& kv : frameInfo.gameObjects) {
 			auto& obj = kv.second;
 
-			// Maybe it would be better to just upload up to MAX_LIGHTS lights, ordering them by priority before uploading
-			assert(lightIndex < MAX_LIGHTS && "Exceeded maximum number of lights in scene");
-
 			if (obj.m_directionalLight != nullptr)
 			{
-				// copy light to ubo
-				ubo.lights[lightIndex].type = Directional;
-				ubo.lights[lightIndex].position = glm::vec4(obj.m_directionalLight->direction, 0.f);
-				ubo.lights[lightIndex].color = glm::vec4(obj.m_color, obj.m_directionalLight->lightIntensity);
+				// The light buffer holds MAX_LIGHTS
+				if (outLights.size() >= MAX_LIGHTS) {
+					droppedLights++;
+					continue;
+				}
 
-				lightIndex += 1;
+				Light& light = outLights.emplace_back();
+				light.type = Directional;
+				light.position = glm::vec4(obj.m_directionalLight->direction, 0.f);
+				light.color = glm::vec4(obj.m_color, obj.m_directionalLight->lightIntensity);
 			}
+		}
+		outDirectionalCount = static_cast<uint32>(outLights.size());
+
+		// Point lights are only evaluated by the fragments of the clusters they overlap
+		for (auto& kv : frameInfo.gameObjects) {
+			auto& obj = kv.second;
 
 			if (obj.m_pointLight != nullptr)
 			{
-				// update light position
-				if (ROTATE_LIGHTS)
-					obj.m_transform.position = glm::vec3(rotateLight * glm::vec4(obj.m_transform.position, 1.f));
-
-				// copy light to ubo
-				ubo.lights[lightIndex].type = Point;
-				ubo.lights[lightIndex].position = glm::vec4(obj.m_transform.position, 1.f);
-				ubo.lights[lightIndex].color = glm::vec4(obj.m_color, obj.m_pointLight->lightIntensity);
-				ubo.lights[lightIndex].radius = obj.m_transform.scale.x;
+				if (outLights.size() >= MAX_LIGHTS) {
+					droppedLights++;
+					continue;
+				}
 
-				lightIndex += 1;
+				Light& light = outLights.emplace_back();
+				light.type = Point;
+				light.position = glm::vec4(obj.m_transform.position, 1.f);
+				light.color = glm::vec4(obj.m_color, obj.m_pointLight->lightIntensity);
+				light.radius = obj.m_transform.scale.x;
 			}
 		}
-		ubo.numLights = lightIndex;
+
+		if (droppedLights != m_droppedLights) {
+			OV_DEBUG_LOG("Exceeded maximum number of lights (" << MAX_LIGHTS << "), " << droppedLights << " dropped");
+			m_droppedLights = droppedLights;
+		}
+	}
+
+	uint32_t EngineApp::writeObjectData(const FrameInfo& frameInfo) {
+		const RenderQueue& renderQueue = *frameInfo.renderQueue;
+		assert(renderQueue.size() <= MAX_GAME_OBJECTS && "Render queue does not fit in the object data range");
+
+		GpuAllocation allocation = frameInfo.gpuArena->allocateStorage(OBJECT_DATA_RANGE);
+		ObjectData* objects = static_cast<ObjectData*>(allocation.data);
+		const LightSelector* lightSelector = frameInfo.lightSelector;
+
+		// Packets write their own entry only. Written sequentially, the arena's memory is write-combined
+		JobCounter writing;
+		m_jobSystem.parallelFor(renderQueue.size(), OBJECT_DATA_BATCH_SIZE, [&](uint32 firstPacket, uint32 endPacket) {
+			for (uint32 i = firstPacket; i < endPacket; i++) {
+				TransformComponent& transform = renderQueue.begin()[i].object->m_transform;
+
+				ObjectData data{};
+				data.modelMat = transform.mat4();
+				data.normalMat = glm::mat3x4(transform.normalMatrix());
+
+				if (lightSelector) {
+					const glm::uvec2& lightList = lightSelector->getLightList(i);
+					data.lightListOffset = lightList.x;
+					data.lightListCount = lightList.y;
+				}
+
+				objects[i] = data;
+			}
+		}, writing, "Write object data");
+
+		m_jobSystem.wait(writing);
+
+		return allocation.getDynamicOffset();
 	}
 }
\ No newline at end of file
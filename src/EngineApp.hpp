@@ -8,6 +8,14 @@
 #include "ShadowmapRenderer.hpp"
 #include "Camera.hpp"
 #include "FrameInfo.hpp"
+#include "RenderQueue.hpp"
+#include "OcclusionCuller.hpp"
+#include "SoftwareOcclusionCuller.hpp"
+#include "MeshStreamer.hpp"
+#include "LightClusters.hpp"
+#include "LightSelector.hpp"
+#include "CascadeScheduler.hpp"
+#include "JobSystem.hpp"
 
 namespace OmniV {
 
@@ -37,18 +45,30 @@ namespace OmniV {
 		Window m_window{ WIDTH, HEIGHT, "Hello Vulkan!" };
 		Device m_device{ m_window };
 		Renderer m_renderer{ m_window, m_device };
-		ShadowmapRenderer m_shadowmapRenderer{ m_device, m_renderer };
+		JobSystem m_jobSystem; // Sized to the hardware threads. Declared before everything that runs jobs, so that it's destroyed after them
+		std::unique_ptr<ShadowmapRenderer> m_shadowmapRenderer; // Created once the scene's settings are known
 
 		// Note: Order of declarations matters -> We want the DescriptorPool object to be destroyed before the Device object
 		// (objects are created in declaration order & destroyed in reverse declaration order)
 		std::unique_ptr<DescriptorPool> m_globalPool;
+		std::unique_ptr<OcclusionCuller> m_occlusionCuller; // Only created if enabled in the render settings
+		std::unique_ptr<MeshStreamer> m_meshStreamer; // Only created if streaming is enabled in the render settings
 		GameObject::Map m_gameObjects; // Should be part of a scene object
 
 		Camera m_camera;
 		RenderSettings m_renderSettings;
 
 		EnabledRenderSystems m_enabledSystems;
+		bool m_hasStaticCasters = false; // Shadows of static objects are cached if there are any
+		uint32 m_droppedLights = 0; // Over MAX_LIGHTS in the last updateLights(), logged when it changes
 
-		void updateLights(FrameInfo& frameInfo, GlobalUbo& ubo);
+		RenderQueue m_renderQueue;
+		std::unique_ptr<SoftwareOcclusionCuller> m_softwareOcclusionCuller; // Only created if enabled in the render settings
+
+		// Directional lights first, then point lights. Lights over MAX_LIGHTS are dropped
+		void updateLights(FrameInfo& frameInfo, std::vector<Light>& outLights, uint32& outDirectionalCount);
+
+		// ObjectData of every render queue packet, in the GPU frame arena. Returns its dynamic offset
+		uint32_t writeObjectData(const FrameInfo& frameInfo);
 	};
 }
\ No newline at end of file
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "defines.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+namespace OmniV {
+
+	// Linear (bump) allocator for CPU data that only lives for one frame
+	// Memory is never freed individually, the whole arena is rewound with reset() at the start of every frame
+	// The backing storage only grows, so after a few frames no heap allocations happen anymore
+	class FrameArena {
+	public:
+		explicit FrameArena(size_t initialCapacity = 64 * 1024) { m_storage.resize(initialCapacity); }
+
+		FrameArena(const FrameArena&) = delete;
+		FrameArena& operator=(const FrameArena&) = delete;
+
+		// Objects allocated here are not constructed nor destroyed, so only trivial types are allowed
+		template <typename T>
+		T* allocate(size_t count) {
+			static_assert(std::is_trivially_copyable<T>::value && std::is_trivially_destructible<T>::value, "FrameArena only supports trivial types");
+
+			size_t alignedOffset = (m_offset + alignof(T) - 1) & ~(alignof(T) - 1);
+			size_t requiredSize = alignedOffset + sizeof(T) * count;
+
+			if (requiredSize > m_storage.size()) {
+				// Pointers returned earlier in this frame would be invalidated by a resize, so this is only
+				// allowed while the arena is empty. Callers size their requests up-front with reserve()
+				assert(m_offset == 0 && "FrameArena ran out of memory mid-frame, call reserve() before allocating");
+				m_storage.resize(std::max(requiredSize, m_storage.size() * 2));
+			}
+
+			m_offset = requiredSize;
+			return reinterpret_cast<T*>(m_storage.data() + alignedOffset);
+		}
+
+		// Makes sure that at least "bytes" can be allocated this frame without growing
+		void reserve(size_t bytes) {
+			assert(m_offset == 0 && "FrameArena can only grow between frames");
+			if (bytes > m_storage.size())
+				m_storage.resize(bytes);
+		}
+
+		void reset() { m_offset = 0; }
+
+		size_t getUsedBytes() const { return m_offset; }
+		size_t getCapacity() const { return m_storage.size(); }
+
+	private:
+		// operator new returns memory aligned to max_align_t, so any trivial type can be placed at offset 0
+		std::vector<uint8> m_storage;
+		size_t m_offset = 0;
+	};
+}
@@ -2,12 +2,27 @@
 
 #include "Camera.hpp"
 #include "GameObject.hpp"
+#include "SwapChain.hpp"
 
 // libs
 #include <vulkan/vulkan.h>
 
+// std
+#include <thread>
+
 namespace OmniV {
 
+	class RenderQueue;
+	class GpuFrameArena;
+	class OcclusionCuller;
+	class LightSelector;
+
+	// Main pass of a frame drawn with occlusion culling
+	enum class CullPhase : uint32 {
+		PreviouslyVisible = 0, // Objects visible last frame, drawn before the Hi-Z is built
+		NewlyVisible = 1, // Objects that passed the Hi-Z test and were not drawn yet
+	};
+
 	enum LightType {
 		Directional = 0,
 		Point = 1,
@@ -27,11 +42,31 @@ namespace OmniV {
 		glm::mat4 cascadesMats[SHADOWMAP_CASCADE_COUNT];
 		float cascadeSplits[SHADOWMAP_CASCADE_COUNT];
 		glm::vec4 ambientLight{ 1.f, 1.f, 1.f, .02f };  // w is intensity
-		Light lights[MAX_LIGHTS];
-		int numLights;
+		glm::uvec4 clusterGrid{ 0 }; // Light cluster counts in x, y, z. w is the number of directional lights (first in the light buffer)
+		glm::vec4 clusterParams{ 0.f }; // Depth slice scale & bias, cluster width & height in pixels
+		glm::vec4 cascadeAtlasRects[SHADOWMAP_CASCADE_COUNT]; // Region of each cascade in its shadow atlas layer: uv offset (xy) and scale (zw)
+		glm::uvec4 cascadeLayers{ 0 }; // Shadow atlas layer of each cascade
+	};
+
+	// Light list count telling the shader to use the light clusters instead
+	static constexpr uint32 USE_LIGHT_CLUSTERS = ~0u;
 
+	// Per object data of a frame, indexed by the render queue packet (binding 6 of the global set). Written once per frame and read
+	// by every pass drawing the queue: draws pass the packet index as their first instance. Must match scene.vert/offscreen.vert
+	struct ObjectData {
+		glm::mat4 modelMat{ 1.f };
+		glm::mat3x4 normalMat{ 1.f }; // mat3 with its columns padded to vec4
+		uint32 lightListOffset = 0;
+		uint32 lightListCount = USE_LIGHT_CLUSTERS; // Per object lists (LightSelector), or the fragment's cluster
+		uint32 padding[2]{};
 	};
 
+	// Range of the object data descriptor. Allocated whole every frame, so that the range never goes past the end of the GPU frame arena
+	static constexpr VkDeviceSize OBJECT_DATA_RANGE = sizeof(ObjectData) * MAX_GAME_OBJECTS;
+
+	// Dynamic descriptors of the global set: global UBO (binding 0) and object data (binding 6)
+	static constexpr uint32_t GLOBAL_DYNAMIC_OFFSET_COUNT = 2;
+
 	struct FrameInfo {
 		int frameIndex;
 		float frameTime;
@@ -39,10 +74,83 @@ namespace OmniV {
 		Camera& camera;
 		VkDescriptorSet globalDescriptorSet;
 		GameObject::Map& gameObjects;
+		std::array<uint32_t, GLOBAL_DYNAMIC_OFFSET_COUNT> globalOffsets{}; // Dynamic offsets to bind the global set with, in binding order
+		GpuFrameArena* gpuArena = nullptr; // Per frame GPU data, allocations stay valid until the frame is finished
+		RenderQueue* renderQueue = nullptr; // Sorted opaque draws of this frame
+		OcclusionCuller* occlusionCuller = nullptr; // If set, opaque draws are indirect and filtered by the culler
+		CullPhase cullPhase = CullPhase::PreviouslyVisible;
+		LightSelector* lightSelector = nullptr; // If set, point lights come from per object lists instead of the light clusters
+		uint32 directionalLightCount = 0;
+		uint32 pointLightCount = 0;
+		bool shadows = false; // Whether shadowmaps are rendered
+
+		// Render queue packets drawn by the opaque systems, so that chunks of the queue can be recorded in parallel
+		uint32 firstPacket = 0;
+		uint32 lastPacket = ~0u; // Excluded, clamped to the queue size
+	};
+
+	struct StreamingSettings {
+		bool enabled = false; // Meshes are loaded around the camera instead of up front
+		float loadRadius = 50.0f; // Distance from the camera to a mesh's bounds under which it gets loaded
+		float unloadMargin = 10.0f; // Meshes are evicted further than loadRadius + unloadMargin
+		uint64 uploadBudget = 8ull << 20; // Bytes uploaded per frame
+		uint64 residencyCap = 256ull << 20; // Bytes of vertex + index buffers resident at once
+	};
+
+	// Shadow filtering kernel of scene.frag, set as a specialization constant (values must match the shader)
+	enum class ShadowFilter : uint32 {
+		Bilinear = 0, // 1 hardware PCF tap (2x2 texels)
+		Gather = 1, // 4 gathers (4x4 texels)
+		Poisson = 2, // 8 hardware PCF taps on a per pixel rotated Poisson disk
+	};
+
+	// Of the shadow passes (vkCmdSetDepthBias). The constant factor counts steps of the depth format
+	struct DepthBias {
+		float constantFactor;
+		float slopeFactor;
+	};
+
+	struct ShadowmapSettings {
+		std::array<uint32, SHADOWMAP_CASCADE_COUNT> cascadeResolutions{ SHADOWMAP_RES, SHADOWMAP_RES, SHADOWMAP_RES, SHADOWMAP_RES }; // Powers of two, up to SHADOWMAP_RES
+		bool compactDepth = false; // 16 bit depth (VK_FORMAT_D16_UNORM) instead of the most precise supported format
+		ShadowFilter filter = ShadowFilter::Gather;
+
+		// A D16 step (1 / 65535) is hundreds of times a D32 one around the middle of the range, and the rounding of the stored depth
+		// alone can reach half of it, so the 16 bit format gets its own bias
+		DepthBias depthBias{ 1.25f, 1.75f }; // D32 (and the D24 fallback)
+		DepthBias compactDepthBias{ 2.0f, 1.75f }; // D16
+	};
+
+	// How fragments find the point lights they evaluate
+	enum class LightAssignment {
+		Clustered, // Lights of the fragment's cluster
+		PerObject, // Lights selected per object on the CPU, ranked by contribution
+	};
+
+	// How the opaque pass is shaded
+	enum class RenderPath {
+		Forward, // Lighting while rasterizing each object (scene.frag), overdrawn fragments are shaded too
+		Deferred, // Albedo & normals to a G-buffer, then lighting once per pixel. Wins with many lights and overdraw
 	};
 
 	struct RenderSettings {
 		glm::vec4 ambientLight;
+		SwapChainSettings swapChain;
+		RenderPath renderPath = RenderPath::Forward;
+		bool occlusionCulling = false; // Hi-Z occlusion culling, worth it in heavily occluded scenes
+		bool depthPrepass = false; // Forward path only: opaque depth first, so that lighting only runs on visible fragments
+		bool softwareOcclusion = false; // CPU occlusion culling against the meshes flagged as occluders
+		StreamingSettings streaming;
+		ShadowmapSettings shadowmap;
+		std::array<uint32, SHADOWMAP_CASCADE_COUNT> cascadeUpdatePeriods{ 1, 1, 1, 1 }; // In frames, far cascades can be updated less often
+		bool singlePassShadows = false; // All cascades in one pass (multiview, or instancing where unsupported)
+		LightAssignment lightAssignment = LightAssignment::Clustered;
+		uint32 maxObjectLights = 8; // Per object mode only, up to LightSelector::MAX_OBJECT_LIGHTS
+		uint32 debugLightCount = 0; // Randomly placed point lights added to the scene, to measure how lighting scales
+		float debugLightExtent = 10.0f; // Half size of the square (XZ) in which they are placed
+		bool debugCascades = false; // Tints the scene by shadow cascade
+		uint32 recordingThreads = 0; // Threads recording secondary command buffers (cascades, systems, chunks of objects). 0 records inline
+		float targetFps = 0.0f; // Frame limiter, 0 leaves the frame rate to the present mode
 
 		static RenderSettings loadRenderSettings(pugi::xml_node i_settings_node) {
 			RenderSettings renderSettings;
@@ -50,6 +158,172 @@ namespace OmniV {
 			pugi::xml_node ambientLightNode = i_settings_node.child("ambientlight");
 			renderSettings.ambientLight = toVector4f(ambientLightNode.attribute("value").value());
 
+			// <swapchain framesinflight="2" presentmode="fifo|mailbox|immediate|fiforelaxed"/>
+			if (pugi::xml_node swapChainNode = i_settings_node.child("swapchain")) {
+				SwapChainSettings& swapChain = renderSettings.swapChain;
+
+				if (swapChainNode.attribute("framesinflight")) {
+					swapChain.framesInFlight = toUInt(swapChainNode.attribute("framesinflight").value());
+					if (swapChain.framesInFlight == 0 || swapChain.framesInFlight > MAX_FRAMES_IN_FLIGHT)
+						throw std::runtime_error("Frames in flight must be between 1 and " + std::to_string(MAX_FRAMES_IN_FLIGHT));
+				}
+
+				if (swapChainNode.attribute("presentmode")) {
+					std::string presentMode = toLower(swapChainNode.attribute("presentmode").value());
+
+					if (presentMode == "fifo")
+						swapChain.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+					else if (presentMode == "mailbox")
+						swapChain.presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+					else if (presentMode == "immediate")
+						swapChain.presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+					else if (presentMode == "fiforelaxed")
+						swapChain.presentMode = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+					else
+						throw std::runtime_error("Unknown present mode: " + presentMode);
+				}
+			}
+
+			// <renderpath value="forward|deferred"/>
+			if (pugi::xml_node renderPathNode = i_settings_node.child("renderpath")) {
+				std::string path = toLower(renderPathNode.attribute("value").value());
+
+				if (path == "deferred")
+					renderSettings.renderPath = RenderPath::Deferred;
+				else if (path != "forward")
+					throw std::runtime_error("Unknown render path: " + path);
+			}
+
+			if (pugi::xml_node occlusionCullingNode = i_settings_node.child("occlusionculling"))
+				renderSettings.occlusionCulling = toBool(occlusionCullingNode.attribute("value").value());
+
+			if (pugi::xml_node depthPrepassNode = i_settings_node.child("depthprepass"))
+				renderSettings.depthPrepass = toBool(depthPrepassNode.attribute("value").value());
+
+			if (pugi::xml_node softwareOcclusionNode = i_settings_node.child("softwareocclusion"))
+				renderSettings.softwareOcclusion = toBool(softwareOcclusionNode.attribute("value").value());
+
+			if (pugi::xml_node singlePassShadowsNode = i_settings_node.child("singlepassshadows"))
+				renderSettings.singlePassShadows = toBool(singlePassShadowsNode.attribute("value").value());
+
+			// <shadowmap resolutions="2048 2048 1024 1024" format="d16|d32" filter="bilinear|gather|poisson" bias="1.25 1.75" bias16="2 1.75"/>,
+			// one resolution per cascade. Biases are "constant slope", for D32 and D16 respectively
+			if (pugi::xml_node shadowmapNode = i_settings_node.child("shadowmap")) {
+				ShadowmapSettings& shadowmap = renderSettings.shadowmap;
+
+				if (shadowmapNode.attribute("resolutions")) {
+					std::vector<std::string> tokens = tokenize(shadowmapNode.attribute("resolutions").value());
+					if (tokens.size() != SHADOWMAP_CASCADE_COUNT)
+						throw std::runtime_error("Expected one shadowmap resolution per cascade");
+
+					for (uint32 i = 0; i < SHADOWMAP_CASCADE_COUNT; i++) {
+						uint32 resolution = toUInt(tokens[i]);
+						if (resolution == 0 || resolution > SHADOWMAP_RES || (resolution & (resolution - 1)) != 0)
+							throw std::runtime_error("Shadowmap resolutions must be powers of two up to " + std::to_string(SHADOWMAP_RES));
+
+						shadowmap.cascadeResolutions[i] = resolution;
+					}
+				}
+
+				if (shadowmapNode.attribute("format")) {
+					std::string format = toLower(shadowmapNode.attribute("format").value());
+
+					if (format == "d16")
+						shadowmap.compactDepth = true;
+					else if (format != "d32")
+						throw std::runtime_error("Unknown shadowmap format: " + format);
+				}
+
+				if (shadowmapNode.attribute("filter")) {
+					std::string filter = toLower(shadowmapNode.attribute("filter").value());
+
+					if (filter == "bilinear")
+						shadowmap.filter = ShadowFilter::Bilinear;
+					else if (filter == "gather")
+						shadowmap.filter = ShadowFilter::Gather;
+					else if (filter == "poisson")
+						shadowmap.filter = ShadowFilter::Poisson;
+					else
+						throw std::runtime_error("Unknown shadow filter: " + filter);
+				}
+
+				auto parseDepthBias = [](const pugi::xml_attribute& attribute, DepthBias& depthBias) {
+					std::vector<std::string> tokens = tokenize(attribute.value());
+					if (tokens.size() != 2)
+						throw std::runtime_error("Expected a constant and a slope shadowmap depth bias");
+
+					depthBias.constantFactor = toFloat(tokens[0]);
+					depthBias.slopeFactor = toFloat(tokens[1]);
+				};
+
+				if (shadowmapNode.attribute("bias"))
+					parseDepthBias(shadowmapNode.attribute("bias"), shadowmap.depthBias);
+
+				if (shadowmapNode.attribute("bias16"))
+					parseDepthBias(shadowmapNode.attribute("bias16"), shadowmap.compactDepthBias);
+			}
+
+			// <cascadeupdate periods="1 1 2 4"/>, one period per cascade
+			if (pugi::xml_node cascadeUpdateNode = i_settings_node.child("cascadeupdate")) {
+				std::vector<std::string> tokens = tokenize(cascadeUpdateNode.attribute("periods").value());
+				if (tokens.size() != SHADOWMAP_CASCADE_COUNT)
+					throw std::runtime_error("Expected one cascade update period per cascade");
+
+				for (uint32 i = 0; i < SHADOWMAP_CASCADE_COUNT; i++)
+					renderSettings.cascadeUpdatePeriods[i] = std::max(toUInt(tokens[i]), 1u);
+			}
+
+			// <lightassignment value="clustered|perobject" maxperobject="8"/>
+			if (pugi::xml_node lightAssignmentNode = i_settings_node.child("lightassignment")) {
+				std::string mode = toLower(lightAssignmentNode.attribute("value").value());
+
+				if (mode == "perobject")
+					renderSettings.lightAssignment = LightAssignment::PerObject;
+				else if (mode != "clustered")
+					throw std::runtime_error("Unknown light assignment mode: " + mode);
+
+				if (lightAssignmentNode.attribute("maxperobject"))
+					renderSettings.maxObjectLights = toUInt(lightAssignmentNode.attribute("maxperobject").value());
+			}
+
+			// <debuglights count="1024" extent="10"/>, further limited by the scene's own lights once it is loaded
+			if (pugi::xml_node debugLightsNode = i_settings_node.child("debuglights")) {
+				renderSettings.debugLightCount = std::min(toUInt(debugLightsNode.attribute("count").value()), unsigned(MAX_LIGHTS));
+
+				if (debugLightsNode.attribute("extent"))
+					renderSettings.debugLightExtent = toFloat(debugLightsNode.attribute("extent").value());
+			}
+
+			// <parallelrecording threads="4|auto"/>, auto uses every hardware thread
+			if (pugi::xml_node parallelRecordingNode = i_settings_node.child("parallelrecording")) {
+				std::string threads = toLower(parallelRecordingNode.attribute("threads").value());
+				uint32 hardwareThreads = std::max(std::thread::hardware_concurrency(), 1u);
+
+				renderSettings.recordingThreads = threads == "auto" ? hardwareThreads : std::min(toUInt(threads), hardwareThreads);
+			}
+
+			// <framelimiter fps="60"/>
+			if (pugi::xml_node frameLimiterNode = i_settings_node.child("framelimiter"))
+				renderSettings.targetFps = std::max(toFloat(frameLimiterNode.attribute("fps").value()), 0.0f);
+
+			if (pugi::xml_node debugCascadesNode = i_settings_node.child("debugcascades"))
+				renderSettings.debugCascades = toBool(debugCascadesNode.attribute("value").value());
+
+			// <streaming enabled="true" loadradius="50" unloadmargin="10" uploadbudgetkb="8192" residencycapmb="256"/>
+			if (pugi::xml_node streamingNode = i_settings_node.child("streaming")) {
+				StreamingSettings& streaming = renderSettings.streaming;
+				streaming.enabled = toBool(streamingNode.attribute("enabled").value());
+
+				if (streamingNode.attribute("loadradius"))
+					streaming.loadRadius = toFloat(streamingNode.attribute("loadradius").value());
+				if (streamingNode.attribute("unloadmargin"))
+					streaming.unloadMargin = toFloat(streamingNode.attribute("unloadmargin").value());
+				if (streamingNode.attribute("uploadbudgetkb"))
+					streaming.uploadBudget = uint64(toUInt(streamingNode.attribute("uploadbudgetkb").value())) << 10;
+				if (streamingNode.attribute("residencycapmb"))
+					streaming.residencyCap = uint64(toUInt(streamingNode.attribute("residencycapmb").value())) << 20;
+			}
+
 			return renderSettings;
 		}
 	};
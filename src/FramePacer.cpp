@@ -0,0 +1,115 @@
+#include "FramePacer.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <thread>
+
+namespace OmniV {
+
+	// Weight of the newest sample in the running averages (frame time stats and sleep wake-up delay)
+	static constexpr double SMOOTHING_FACTOR = 0.1;
+
+	FramePacer::FramePacer(float targetFps) {
+		assert(targetFps >= 0.0f && "Target frame rate can't be negative");
+
+		if (targetFps > 0.0f)
+			m_period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / targetFps));
+
+		m_lastFrameStart = Clock::now();
+		m_deadline = m_lastFrameStart + m_period;
+	}
+
+	float FramePacer::waitForNextFrame() {
+		double sleepTime = 0.0;
+		double spinTime = 0.0;
+
+		if (isLimited()) {
+			Clock::time_point now = Clock::now();
+
+			// Over a whole frame late: start now and restart the cadence from this frame
+			if (now > m_deadline + m_period)
+				m_deadline = now;
+
+			// Sleep, leaving the predicted wake-up delay to the spin
+			const double margin = m_wakeUpDelay + 2.0 * std::sqrt(m_wakeUpVariance);
+			const double remaining = std::chrono::duration<double>(m_deadline - now).count();
+			if (remaining > margin) {
+				const double requested = remaining - margin;
+				std::this_thread::sleep_for(std::chrono::duration<double>(requested));
+
+				const Clock::time_point wokeUp = Clock::now();
+				sleepTime = std::chrono::duration<double>(wokeUp - now).count();
+
+				const double delay = sleepTime - requested;
+				const double deviation = delay - m_wakeUpDelay;
+				m_wakeUpDelay += SMOOTHING_FACTOR * deviation;
+				m_wakeUpVariance = (1.0 - SMOOTHING_FACTOR) * (m_wakeUpVariance + SMOOTHING_FACTOR * deviation * deviation);
+				now = wokeUp;
+			}
+
+			// Spin the rest, yielding so that a single core machine still runs the other threads
+			const Clock::time_point spinStart = now;
+			while (now < m_deadline) {
+				std::this_thread::yield();
+				now = Clock::now();
+			}
+			spinTime = std::chrono::duration<double>(now - spinStart).count();
+
+			m_deadline += m_period;
+		}
+
+		const Clock::time_point frameStart = Clock::now();
+		const double frameTime = std::chrono::duration<double>(frameStart - m_lastFrameStart).count();
+		m_lastFrameStart = frameStart;
+
+		{
+			std::lock_guard<std::mutex> lock(m_statsMutex);
+
+			if (m_smoothedFrameTime == 0.0f)
+				m_smoothedFrameTime = static_cast<float>(frameTime);
+			else
+				m_smoothedFrameTime += static_cast<float>(SMOOTHING_FACTOR * (frameTime - m_smoothedFrameTime));
+
+			m_minFrameTime = m_frames == 0 ? frameTime : std::min(m_minFrameTime, frameTime);
+			m_maxFrameTime = m_frames == 0 ? frameTime : std::max(m_maxFrameTime, frameTime);
+			m_frames++;
+			m_frameTimeSum += frameTime;
+			m_frameTimeSquareSum += frameTime * frameTime;
+			m_sleepTime += sleepTime;
+			m_spinTime += spinTime;
+		}
+
+		return std::min(static_cast<float>(frameTime), MAX_FRAME_TIME);
+	}
+
+	FramePacingStats FramePacer::takeStats() {
+		std::lock_guard<std::mutex> lock(m_statsMutex);
+
+		FramePacingStats stats;
+		stats.frames = m_frames;
+		stats.targetFrameTime = static_cast<float>(std::chrono::duration<double, std::milli>(m_period).count());
+		stats.smoothedFrameTime = m_smoothedFrameTime * 1000.0f;
+
+		if (m_frames > 0) {
+			const double average = m_frameTimeSum / m_frames;
+			const double variance = std::max(m_frameTimeSquareSum / m_frames - average * average, 0.0);
+			const double reference = isLimited() ? stats.targetFrameTime / 1000.0 : average;
+
+			stats.averageFrameTime = static_cast<float>(average * 1000.0);
+			stats.jitter = static_cast<float>(std::sqrt(variance) * 1000.0);
+			stats.maxDeviation = static_cast<float>(std::max(m_maxFrameTime - reference, reference - m_minFrameTime) * 1000.0);
+			stats.sleepTime = static_cast<float>(m_sleepTime / m_frames * 1000.0);
+			stats.spinTime = static_cast<float>(m_spinTime / m_frames * 1000.0);
+		}
+
+		m_frames = 0;
+		m_frameTimeSum = 0.0;
+		m_frameTimeSquareSum = 0.0;
+		m_sleepTime = 0.0;
+		m_spinTime = 0.0;
+
+		return stats;
+	}
+}
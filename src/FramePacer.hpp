@@ -0,0 +1,72 @@
+#pragma once
+
+#include "defines.hpp"
+
+// std
+#include <chrono>
+#include <mutex>
+
+namespace OmniV {
+
+	// Since the last takeStats(). Times in ms
+	struct FramePacingStats {
+		uint32 frames = 0;
+		float targetFrameTime = 0.0f; // 0 when unlimited
+		float averageFrameTime = 0.0f;
+		float smoothedFrameTime = 0.0f; // Running average of the intervals, as of the last frame
+		float jitter = 0.0f; // Standard deviation of the frame intervals
+		float maxDeviation = 0.0f; // Worst interval, compared to the target (or the average when unlimited)
+		float sleepTime = 0.0f; // Per frame
+		float spinTime = 0.0f; // Per frame
+	};
+
+	/// <summary>
+	/// <para> Caps the frame rate to a target, so that frames the present mode would drop (MAILBOX) or that exceed what is needed
+	/// aren't simulated and rendered at all </para>
+	/// <para> Frames start on a fixed cadence of deadlines. The pacer sleeps until shortly before the deadline, then spin-waits the rest.
+	/// The margin left to the spin is predicted from how late the previous sleeps woke up (mean + 2 standard deviations), so it adapts
+	/// to the OS scheduler: a precise timer mostly sleeps, a coarse one mostly spins </para>
+	/// <para> A frame that misses its deadline starts right away. If it misses it by more than a whole frame, the cadence restarts from
+	/// it instead of rushing the next frames to catch up </para>
+	/// <para> The frame time handed to the simulation is the measured interval, so that simulated time keeps up with real time.
+	/// It is only clamped after long stalls (window moved, debugger break...). A smoothed frame time is kept for the stats </para>
+	/// </summary>
+	class FramePacer {
+	public:
+		using Clock = std::chrono::steady_clock;
+
+		static constexpr float MAX_FRAME_TIME = 0.25f; // Seconds. Longer frames are simulated as this long
+
+		explicit FramePacer(float targetFps); // 0 leaves the frame rate to the present mode
+
+		FramePacer(const FramePacer&) = delete;
+		FramePacer& operator=(const FramePacer&) = delete;
+
+		// Waits until the next frame is due. Returns the time since the previous frame started, in seconds, clamped to MAX_FRAME_TIME
+		float waitForNextFrame();
+
+		bool isLimited() const { return m_period.count() > 0; }
+
+		// Thread safe, resets the stats
+		FramePacingStats takeStats();
+
+	private:
+		Clock::duration m_period{ 0 };
+		Clock::time_point m_lastFrameStart;
+		Clock::time_point m_deadline;
+
+		// How late sleeps wake up, in seconds
+		double m_wakeUpDelay = 0.0005;
+		double m_wakeUpVariance = 0.0005 * 0.0005;
+
+		std::mutex m_statsMutex;
+		float m_smoothedFrameTime = 0.0f; // Seconds, 0 until the first frame
+		uint32 m_frames = 0;
+		double m_frameTimeSum = 0.0;
+		double m_frameTimeSquareSum = 0.0;
+		double m_minFrameTime = 0.0;
+		double m_maxFrameTime = 0.0;
+		double m_sleepTime = 0.0;
+		double m_spinTime = 0.0;
+	};
+}
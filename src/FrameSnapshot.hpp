@@ -0,0 +1,112 @@
+#pragma once
+
+#include "GameObject.hpp"
+
+// std
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+namespace OmniV {
+
+	// Transform of an object moved by the simulation
+	struct ObjectTransform {
+		GameObject::id_t objectID;
+		TransformComponent transform;
+	};
+
+	// Everything the render thread needs from one simulation step. Never modified once published
+	struct FrameSnapshot {
+		uint64 sequence = 0; // Simulation step that produced it, starting at 1
+		float frameTime = 0.0f; // Seconds simulated by this step
+		TransformComponent viewerTransform; // Camera
+		std::vector<ObjectTransform> transforms; // Moving objects only (point lights)
+	};
+
+	/// <summary>
+	/// <para> Hands the latest FrameSnapshot from the simulation thread over to the render thread </para>
+	/// <para> The simulation writes into its own slot while the render thread reads another one, a third slot holds the last published
+	/// snapshot. Publishing and acquiring each swap a slot with a single atomic exchange, so neither thread ever waits for the other
+	/// to finish copying. Slots are reused, their vectors stop allocating after a few frames </para>
+	/// <para> The mutex and condition variable are only used to sleep, when a thread has nothing to do until the other one moves </para>
+	/// </summary>
+	class SnapshotMailbox {
+	public:
+		SnapshotMailbox() = default;
+
+		SnapshotMailbox(const SnapshotMailbox&) = delete;
+		SnapshotMailbox& operator=(const SnapshotMailbox&) = delete;
+
+		// Simulation thread. Holds the data of an older snapshot, that has to be overwritten entirely
+		FrameSnapshot& getWriteSlot() { return m_slots[m_writeIndex]; }
+
+		void publish() {
+			m_writeIndex = m_ready.exchange(m_writeIndex | NEW_SNAPSHOT_BIT, std::memory_order_acq_rel) & SLOT_MASK;
+			notify();
+		}
+
+		// Render thread. Latest published snapshot, or nullptr if it was already acquired
+		const FrameSnapshot* acquire() {
+			if ((m_ready.load(std::memory_order_relaxed) & NEW_SNAPSHOT_BIT) == 0)
+				return nullptr;
+
+			m_readIndex = m_ready.exchange(m_readIndex, std::memory_order_acq_rel) & SLOT_MASK;
+
+			m_acquired.store(m_slots[m_readIndex].sequence, std::memory_order_relaxed);
+			notify();
+
+			return &m_slots[m_readIndex];
+		}
+
+		// Render thread. Sleeps until a new snapshot is published or the mailbox is closed
+		void waitForSnapshot() {
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_condition.wait(lock, [this]() { return m_closed || (m_ready.load(std::memory_order_acquire) & NEW_SNAPSHOT_BIT) != 0; });
+		}
+
+		// Simulation thread. Sleeps until snapshot "sequence" was acquired, which bounds the simulation to one step ahead of rendering
+		// Returns false on timeout, so that the caller can keep processing window events meanwhile
+		bool waitForAcquire(uint64 sequence, std::chrono::milliseconds timeout) {
+			std::unique_lock<std::mutex> lock(m_mutex);
+			return m_condition.wait_for(lock, timeout, [this, sequence]() { return m_closed || m_acquired.load(std::memory_order_relaxed) >= sequence; });
+		}
+
+		// Wakes up both threads for good, when either of them stops
+		void close() {
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_closed = true;
+			}
+			m_condition.notify_all();
+		}
+
+		bool isClosed() {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			return m_closed;
+		}
+
+	private:
+		static constexpr uint32 SLOT_MASK = 3;
+		static constexpr uint32 NEW_SNAPSHOT_BIT = 4;
+
+		void notify() {
+			// Taking the lock orders the change with a thread about to sleep, so that the notification isn't lost
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+			}
+			m_condition.notify_all();
+		}
+
+		std::array<FrameSnapshot, 3> m_slots;
+		uint32 m_writeIndex = 0; // Simulation thread only
+		uint32 m_readIndex = 1; // Render thread only
+		std::atomic<uint32> m_ready{ 2 }; // Last published slot, with NEW_SNAPSHOT_BIT until acquired
+
+		std::atomic<uint64> m_acquired{ 0 };
+
+		std::mutex m_mutex;
+		std::condition_variable m_condition;
+		bool m_closed = false;
+	};
+}
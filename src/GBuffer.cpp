@@ -0,0 +1,261 @@
+#include "GBuffer.hpp"
+
+// std
+#include <array>
+#include <cassert>
+
+namespace OmniV {
+
+	// Attachments of the deferred render pass
+	enum GBufferAttachment : uint32_t {
+		SWAPCHAIN_COLOR = 0,
+		DEPTH = 1,
+		ALBEDO = 2,
+		NORMAL = 3,
+		ATTACHMENT_COUNT = 4,
+	};
+
+	GBuffer::GBuffer(Device& device, Renderer& renderer) : m_device{ device }, m_renderer{ renderer } {
+		m_inputSetLayout = DescriptorSetLayout::Builder(m_device)
+			.addBinding(0, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, VK_SHADER_STAGE_FRAGMENT_BIT)
+			.addBinding(1, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, VK_SHADER_STAGE_FRAGMENT_BIT)
+			.addBinding(2, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, VK_SHADER_STAGE_FRAGMENT_BIT)
+			.build();
+
+		// Swapchain recreations keep the same formats, so the render pass outlives them
+		createRenderPass();
+	}
+
+	GBuffer::~GBuffer() {
+		destroyResources();
+		vkDestroyRenderPass(m_device.device(), m_renderPass, nullptr);
+	}
+
+	void GBuffer::createRenderPass() {
+		std::array<VkAttachmentDescription, ATTACHMENT_COUNT> attachments{};
+
+		VkAttachmentDescription& colorAttachment = attachments[SWAPCHAIN_COLOR];
+		colorAttachment.format = m_renderer.getSwapChainImageFormat();
+		colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+		colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+		VkAttachmentDescription& depthAttachment = attachments[DEPTH];
+		depthAttachment.format = m_renderer.getDepthFormat();
+		depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+		depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+		// G-buffer contents only live within the pass
+		for (uint32_t i : { ALBEDO, NORMAL }) {
+			VkAttachmentDescription& attachment = attachments[i];
+			attachment.format = i == ALBEDO ? ALBEDO_FORMAT : NORMAL_FORMAT;
+			attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+			attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+			attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			attachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		}
+
+		// Geometry subpass
+		std::array<VkAttachmentReference, 2> gBufferRefs{ {
+			{ ALBEDO, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL },
+			{ NORMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL } } };
+		VkAttachmentReference depthWriteRef{ DEPTH, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+
+		// Lighting subpass. Depth is both an input and a read only depth attachment, for the forward draws after the lighting
+		VkAttachmentReference colorRef{ SWAPCHAIN_COLOR, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+		std::array<VkAttachmentReference, 3> inputRefs{ {
+			{ ALBEDO, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+			{ NORMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+			{ DEPTH, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL } } };
+		VkAttachmentReference depthReadRef{ DEPTH, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL };
+
+		std::array<VkSubpassDescription, 2> subpasses{};
+
+		VkSubpassDescription& geometrySubpass = subpasses[static_cast<uint32_t>(DeferredSubpass::Geometry)];
+		geometrySubpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		geometrySubpass.colorAttachmentCount = static_cast<uint32_t>(gBufferRefs.size());
+		geometrySubpass.pColorAttachments = gBufferRefs.data();
+		geometrySubpass.pDepthStencilAttachment = &depthWriteRef;
+
+		VkSubpassDescription& lightingSubpass = subpasses[static_cast<uint32_t>(DeferredSubpass::Lighting)];
+		lightingSubpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		lightingSubpass.colorAttachmentCount = 1;
+		lightingSubpass.pColorAttachments = &colorRef;
+		lightingSubpass.inputAttachmentCount = static_cast<uint32_t>(inputRefs.size());
+		lightingSubpass.pInputAttachments = inputRefs.data();
+		lightingSubpass.pDepthStencilAttachment = &depthReadRef;
+
+		std::array<VkSubpassDependency, 2> dependencies{};
+
+		// The G-buffer is shared by the frames in flight: wait for the previous frame to be done reading and writing it
+		VkSubpassDependency& inDependency = dependencies[0];
+		inDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+		inDependency.dstSubpass = static_cast<uint32_t>(DeferredSubpass::Geometry);
+		inDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		inDependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+		inDependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		inDependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+		// Lighting reads what the geometry subpass wrote, at the same pixel
+		VkSubpassDependency& gBufferDependency = dependencies[1];
+		gBufferDependency.srcSubpass = static_cast<uint32_t>(DeferredSubpass::Geometry);
+		gBufferDependency.dstSubpass = static_cast<uint32_t>(DeferredSubpass::Lighting);
+		gBufferDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		gBufferDependency.dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+		gBufferDependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		gBufferDependency.dstAccessMask = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+		gBufferDependency.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+		VkRenderPassCreateInfo renderPassInfo{};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+		renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+		renderPassInfo.pAttachments = attachments.data();
+		renderPassInfo.subpassCount = static_cast<uint32_t>(subpasses.size());
+		renderPassInfo.pSubpasses = subpasses.data();
+		renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+		renderPassInfo.pDependencies = dependencies.data();
+
+		if (vkCreateRenderPass(m_device.device(), &renderPassInfo, nullptr, &m_renderPass) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create deferred render pass!");
+		}
+	}
+
+	void GBuffer::resize() {
+		// Frames in flight may still use the previous framebuffers and input sets, their destruction is deferred
+		destroyResources();
+
+		m_extent = m_renderer.getSwapChainExtent();
+
+		uint32_t imageCount = static_cast<uint32_t>(m_renderer.getSwapChainImageCount());
+
+		m_framebuffers.resize(imageCount);
+		for (uint32_t i = 0; i < imageCount; i++) {
+			std::array<VkImageView, ATTACHMENT_COUNT> attachments{};
+			attachments[SWAPCHAIN_COLOR] = m_renderer.getImageView(i);
+			attachments[DEPTH] = m_renderer.getDepthImageView(i);
+			attachments[ALBEDO] = m_albedoImageView;
+			attachments[NORMAL] = m_normalImageView;
+
+			VkFramebufferCreateInfo framebufferInfo{};
+			framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+			framebufferInfo.renderPass = m_renderPass;
+			framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+			framebufferInfo.pAttachments = attachments.data();
+			framebufferInfo.width = m_extent.width;
+			framebufferInfo.height = m_extent.height;
+			framebufferInfo.layers = 1;
+
+			if (vkCreateFramebuffer(m_device.device(), &framebufferInfo, nullptr, &m_framebuffers[i]) != VK_SUCCESS) {
+				throw std::runtime_error("failed to create G-buffer framebuffer!");
+			}
+		}
+
+		m_descriptorPool = DescriptorPool::Builder(m_device)
+			.setMaxSets(imageCount)
+			.addPoolSize(VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 3 * imageCount)
+			.build();
+
+		VkDescriptorImageInfo albedoInfo{ VK_NULL_HANDLE, m_albedoImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+		VkDescriptorImageInfo normalInfo{ VK_NULL_HANDLE, m_normalImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+
+		m_inputSets.resize(imageCount);
+		for (uint32_t i = 0; i < imageCount; i++) {
+			VkDescriptorImageInfo depthInfo{ VK_NULL_HANDLE, m_renderer.getDepthImageView(i), VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL };
+
+			DescriptorWriter(*m_inputSetLayout, *m_descriptorPool)
+				.writeImage(0, &albedoInfo)
+				.writeImage(1, &normalInfo)
+				.writeImage(2, &depthInfo)
+				.build(m_inputSets[i]);
+		}
+
+		m_swapChainGeneration = m_renderer.getSwapChainGeneration();
+	}
+
+	TransientImageDesc GBuffer::getImageDesc(VkFormat format) const {
+		TransientImageDesc desc{};
+		desc.format = format;
+		desc.extent = m_renderer.getSwapChainExtent();
+		desc.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+		desc.aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+		return desc;
+	}
+
+	void GBuffer::destroyResources() {
+		m_inputSets.clear();
+		m_descriptorPool = nullptr;
+
+		m_device.deferDestruction([device = m_device.device(), framebuffers = std::move(m_framebuffers)]() {
+			for (auto framebuffer : framebuffers)
+				vkDestroyFramebuffer(device, framebuffer, nullptr);
+		});
+		m_framebuffers.clear();
+	}
+
+	void GBuffer::update(VkImageView albedoImageView, VkImageView normalImageView) {
+		// Swapchain was recreated or the render graph reallocated its images: framebuffers and input sets point to the old ones
+		if (m_swapChainGeneration == m_renderer.getSwapChainGeneration() && m_albedoImageView == albedoImageView && m_normalImageView == normalImageView)
+			return;
+
+		m_albedoImageView = albedoImageView;
+		m_normalImageView = normalImageView;
+		resize();
+	}
+
+	void GBuffer::beginRenderPass(VkCommandBuffer commandBuffer, VkSubpassContents contents) {
+		assert(!m_framebuffers.empty() && "G-buffer must be updated before its render pass begins");
+
+		std::array<VkClearValue, ATTACHMENT_COUNT> clearValues{};
+		clearValues[SWAPCHAIN_COLOR].color = { 0.01f, 0.01f, 0.01f, 1.0f };
+		clearValues[DEPTH].depthStencil = { 1.0f, 0 };
+		clearValues[ALBEDO].color = { 0.0f, 0.0f, 0.0f, 0.0f };
+		clearValues[NORMAL].color = { 0.5f, 0.5f, 0.5f, 0.0f };
+
+		VkRenderPassBeginInfo renderPassInfo{};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassInfo.renderPass = m_renderPass;
+		renderPassInfo.framebuffer = m_framebuffers[m_renderer.getImageIndex()];
+		renderPassInfo.renderArea.offset = { 0, 0 };
+		renderPassInfo.renderArea.extent = m_extent;
+		renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+		renderPassInfo.pClearValues = clearValues.data();
+
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, contents);
+
+		if (contents == VK_SUBPASS_CONTENTS_INLINE)
+			recordPassState(commandBuffer);
+	}
+
+	void GBuffer::recordPassState(VkCommandBuffer commandBuffer) const {
+		VkViewport viewport{};
+		viewport.x = 0.0f;
+		viewport.y = 0.0f;
+		viewport.width = static_cast<float>(m_extent.width);
+		viewport.height = static_cast<float>(m_extent.height);
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
+		VkRect2D scissor{ {0, 0}, m_extent };
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+	}
+
+	void GBuffer::nextSubpass(VkCommandBuffer commandBuffer, VkSubpassContents contents) {
+		vkCmdNextSubpass(commandBuffer, contents);
+	}
+
+	void GBuffer::endRenderPass(VkCommandBuffer commandBuffer) {
+		vkCmdEndRenderPass(commandBuffer);
+	}
+}
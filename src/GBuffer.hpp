@@ -0,0 +1,77 @@
+#pragma once
+
+#include "Descriptors.hpp"
+#include "Device.hpp"
+#include "RenderGraph.hpp"
+#include "Renderer.hpp"
+
+namespace OmniV {
+
+	// Subpasses of the deferred render pass
+	enum class DeferredSubpass : uint32_t {
+		Geometry = 0, // Opaque objects write albedo, normal and depth
+		Lighting = 1, // Fullscreen lighting from the G-buffer into the swapchain image, then forward draws (depth is read only)
+	};
+
+	/// <summary>
+	/// <para> G-buffer and render pass of the deferred path, over the swapchain color and depth images </para>
+	/// <para> A single render pass with two subpasses: the geometry subpass fills the G-buffer, and the lighting subpass reads it back
+	/// as input attachments (same pixel only), so the G-buffer never has to leave tile memory on GPUs that can keep it there </para>
+	/// <para> Albedo and normal images are transient images of the render graph (getImageDesc), shared by the frames in flight.
+	/// The render pass dependencies order their reuse </para>
+	/// </summary>
+	class GBuffer {
+	public:
+		static constexpr VkFormat ALBEDO_FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
+		static constexpr VkFormat NORMAL_FORMAT = VK_FORMAT_A2B10G10R10_UNORM_PACK32; // World space, remapped to [0, 1]
+
+		GBuffer(Device& device, Renderer& renderer);
+		~GBuffer();
+
+		GBuffer(const GBuffer&) = delete;
+		GBuffer& operator=(const GBuffer&) = delete;
+
+		VkRenderPass getRenderPass() const { return m_renderPass; }
+
+		// Albedo, normal and depth as input attachments (bindings 0, 1 and 2), for the lighting subpass
+		VkDescriptorSetLayout getInputSetLayout() const { return m_inputSetLayout->getDescriptorSetLayout(); }
+		VkDescriptorSet getInputSet() const { return m_inputSets[m_renderer.getImageIndex()]; }
+
+		// Albedo or normal image, over the current swapchain extent
+		TransientImageDesc getImageDesc(VkFormat format) const;
+
+		// Follows swapchain recreations and the render graph's images, once it's compiled. Must happen before the render pass is begun and
+		// secondary command buffers record the input sets
+		void update(VkImageView albedoImageView, VkImageView normalImageView);
+
+		// Starts the geometry subpass on the current swapchain image
+		// With secondary contents, the secondary command buffers record the pass state themselves (recordPassState)
+		void beginRenderPass(VkCommandBuffer commandBuffer, VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
+		void nextSubpass(VkCommandBuffer commandBuffer, VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
+		void endRenderPass(VkCommandBuffer commandBuffer);
+		void recordPassState(VkCommandBuffer commandBuffer) const; // Viewport & scissor
+
+	private:
+		void createRenderPass();
+		void resize();
+		void destroyResources();
+
+		Device& m_device;
+		Renderer& m_renderer;
+
+		VkRenderPass m_renderPass = VK_NULL_HANDLE;
+
+		VkExtent2D m_extent{ 0, 0 };
+		uint32_t m_swapChainGeneration = ~0u;
+
+		// Owned by the render graph
+		VkImageView m_albedoImageView = VK_NULL_HANDLE;
+		VkImageView m_normalImageView = VK_NULL_HANDLE;
+
+		std::vector<VkFramebuffer> m_framebuffers; // One per swapchain image
+
+		std::unique_ptr<DescriptorSetLayout> m_inputSetLayout;
+		std::unique_ptr<DescriptorPool> m_descriptorPool;
+		std::vector<VkDescriptorSet> m_inputSets; // One per swapchain image (their depth images differ)
+	};
+}
@@ -55,6 +55,8 @@ namespace OmniV {
 
         glm::vec3 m_color{};
         TransformComponent m_transform{};
+        bool m_isOccluder = false; // Rasterized by the software occlusion culler
+        bool m_isStatic = false; // Never moves, its shadows can be cached
 
         // Optional pointer components
         std::shared_ptr<Model> m_model;
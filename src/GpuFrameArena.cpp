@@ -0,0 +1,57 @@
+#include "GpuFrameArena.hpp"
+
+// std
+#include <cassert>
+
+namespace OmniV {
+
+	GpuFrameArena::GpuFrameArena(Device& device, uint32 framesInFlight, VkDeviceSize frameCapacity) {
+		const VkPhysicalDeviceLimits& limits = device.m_properties.limits;
+		m_uniformAlignment = std::max<VkDeviceSize>(limits.minUniformBufferOffsetAlignment, 1);
+		m_storageAlignment = std::max<VkDeviceSize>(limits.minStorageBufferOffsetAlignment, 1);
+
+		// Every region starts on an alignment any allocation can ask for
+		const VkDeviceSize regionAlignment = std::max(m_uniformAlignment, m_storageAlignment);
+		m_frameCapacity = (frameCapacity + regionAlignment - 1) & ~(regionAlignment - 1);
+
+		assert(m_frameCapacity * framesInFlight <= UINT32_MAX && "Dynamic offsets are 32 bits");
+
+		m_buffer = std::make_unique<Buffer>(device, m_frameCapacity, framesInFlight, USAGE,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		m_buffer->map();
+
+		m_stats.capacity = m_frameCapacity;
+	}
+
+	void GpuFrameArena::beginFrame(int frameIndex) {
+		m_stats.usedBytes = m_offset.load(std::memory_order_relaxed);
+		m_stats.peakBytes = std::max(m_stats.peakBytes, m_stats.usedBytes);
+		m_stats.allocations = m_allocations.load(std::memory_order_relaxed);
+
+		m_frameBase = static_cast<VkDeviceSize>(frameIndex) * m_frameCapacity;
+		m_offset.store(0, std::memory_order_relaxed);
+		m_allocations.store(0, std::memory_order_relaxed);
+	}
+
+	GpuAllocation GpuFrameArena::allocate(VkDeviceSize size, VkDeviceSize alignment) {
+		assert(alignment > 0 && (alignment & (alignment - 1)) == 0 && "Alignment must be a power of two");
+
+		VkDeviceSize offset = m_offset.load(std::memory_order_relaxed);
+		VkDeviceSize alignedOffset;
+		do {
+			alignedOffset = (offset + alignment - 1) & ~(alignment - 1);
+			if (alignedOffset + size > m_frameCapacity) {
+				throw std::runtime_error("GPU frame arena is full, increase its capacity!");
+			}
+		} while (!m_offset.compare_exchange_weak(offset, alignedOffset + size, std::memory_order_relaxed));
+
+		m_allocations.fetch_add(1, std::memory_order_relaxed);
+
+		GpuAllocation allocation;
+		allocation.buffer = m_buffer->getBuffer();
+		allocation.offset = m_frameBase + alignedOffset;
+		allocation.size = size;
+		allocation.data = static_cast<uint8*>(m_buffer->getMappedMemory()) + allocation.offset;
+		return allocation;
+	}
+}
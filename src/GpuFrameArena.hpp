@@ -0,0 +1,79 @@
+#pragma once
+
+#include "Buffer.hpp"
+#include "Device.hpp"
+
+// std
+#include <atomic>
+
+namespace OmniV {
+
+	// Range of the GpuFrameArena buffer, valid until the same frame in flight starts again
+	struct GpuAllocation {
+		void* data = nullptr; // Persistently mapped, host coherent
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0; // In "buffer". Also the dynamic offset of descriptors created with getDescriptorInfo()
+		VkDeviceSize size = 0;
+
+		uint32_t getDynamicOffset() const { return static_cast<uint32_t>(offset); }
+	};
+
+	// Of the last recorded frame
+	struct GpuArenaStats {
+		VkDeviceSize usedBytes = 0;
+		VkDeviceSize peakBytes = 0; // Since the arena was created
+		VkDeviceSize capacity = 0; // Per frame in flight
+		uint32 allocations = 0;
+	};
+
+	/// <summary>
+	/// <para> Linear (bump) allocator for data the GPU reads during one frame: uniforms, instance data, light lists, indirect commands... </para>
+	/// <para> A single persistently mapped buffer is split in one region per frame in flight. Allocating only moves an offset forward, and
+	/// a region is rewound as a whole when its frame starts again, once the frame's fence signaled (beginFrame) </para>
+	/// <para> Descriptors point at the start of the buffer with getDescriptorInfo() and a *_DYNAMIC type, and each allocation is bound
+	/// with its dynamic offset, so the same descriptor set serves every frame and allocation </para>
+	/// <para> Allocations are thread safe (a single atomic), so secondary command buffers recorded by jobs can stream their own data </para>
+	/// </summary>
+	class GpuFrameArena {
+	public:
+		static constexpr VkBufferUsageFlags USAGE = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT
+			| VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+
+		GpuFrameArena(Device& device, uint32 framesInFlight, VkDeviceSize frameCapacity);
+
+		GpuFrameArena(const GpuFrameArena&) = delete;
+		GpuFrameArena& operator=(const GpuFrameArena&) = delete;
+
+		// Rewinds the region of "frameIndex". Its previous submission must be finished
+		void beginFrame(int frameIndex);
+
+		// "alignment" must be a power of two. Throws if the frame's region is full
+		GpuAllocation allocate(VkDeviceSize size, VkDeviceSize alignment);
+
+		// Aligned for uniform/storage buffer (dynamic) offsets
+		GpuAllocation allocateUniform(VkDeviceSize size) { return allocate(size, m_uniformAlignment); }
+		GpuAllocation allocateStorage(VkDeviceSize size) { return allocate(size, m_storageAlignment); }
+
+		// "count" elements of T, e.g. vertex or indirect data
+		template <typename T>
+		GpuAllocation allocate(uint32 count) { return allocate(sizeof(T) * count, alignof(T)); }
+
+		// For descriptors of type *_DYNAMIC, "range" being the size read through each dynamic offset
+		VkDescriptorBufferInfo getDescriptorInfo(VkDeviceSize range) const { return { m_buffer->getBuffer(), 0, range }; }
+
+		VkBuffer getBuffer() const { return m_buffer->getBuffer(); }
+		const GpuArenaStats& getStats() const { return m_stats; }
+
+	private:
+		std::unique_ptr<Buffer> m_buffer;
+		VkDeviceSize m_frameCapacity;
+		VkDeviceSize m_uniformAlignment;
+		VkDeviceSize m_storageAlignment;
+
+		VkDeviceSize m_frameBase = 0; // Start of the current frame's region
+		std::atomic<VkDeviceSize> m_offset{ 0 }; // In the current frame's region
+		std::atomic<uint32> m_allocations{ 0 };
+
+		GpuArenaStats m_stats;
+	};
+}
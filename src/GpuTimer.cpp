@@ -0,0 +1,39 @@
+#include "GpuTimer.hpp"
+
+namespace OmniV {
+
+	GpuTimer::GpuTimer(Device& device, uint32_t framesInFlight) : m_device{ device } {
+		VkQueryPoolCreateInfo queryPoolInfo{};
+		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolInfo.queryCount = 2 * framesInFlight;
+
+		if (vkCreateQueryPool(m_device.device(), &queryPoolInfo, nullptr, &m_queryPool) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create timestamp query pool!");
+
+		m_written.resize(framesInFlight, false);
+	}
+
+	GpuTimer::~GpuTimer() {
+		vkDestroyQueryPool(m_device.device(), m_queryPool, nullptr);
+	}
+
+	void GpuTimer::begin(VkCommandBuffer commandBuffer, int frameIndex) {
+		uint32_t firstQuery = 2 * frameIndex;
+
+		// The frame that last used these queries is done, read them before they are reset
+		if (m_written[frameIndex]) {
+			uint64_t timestamps[2];
+			if (vkGetQueryPoolResults(m_device.device(), m_queryPool, firstQuery, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+				m_time = float(timestamps[1] - timestamps[0]) * m_device.m_properties.limits.timestampPeriod * 1e-6f;
+		}
+
+		vkCmdResetQueryPool(commandBuffer, m_queryPool, firstQuery, 2);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_queryPool, firstQuery);
+	}
+
+	void GpuTimer::end(VkCommandBuffer commandBuffer, int frameIndex) {
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_queryPool, 2 * frameIndex + 1);
+		m_written[frameIndex] = true;
+	}
+}
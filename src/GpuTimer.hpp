@@ -0,0 +1,33 @@
+#pragma once
+
+#include "Device.hpp"
+
+namespace OmniV {
+
+	/// <summary>
+	/// <para> Measures the GPU time between two points of a frame's command buffer with timestamp queries (one pair per frame in flight) </para>
+	/// <para> Results are read without waiting, once the frame that wrote them is known to be finished, so they lag as many frames behind as there are frames in flight </para>
+	/// </summary>
+	class GpuTimer {
+	public:
+		GpuTimer(Device& device, uint32_t framesInFlight);
+		~GpuTimer();
+
+		GpuTimer(const GpuTimer&) = delete;
+		GpuTimer& operator=(const GpuTimer&) = delete;
+
+		// Has to be called after the frame's fence was waited on (after Renderer::beginFrame), and outside of any render pass
+		void begin(VkCommandBuffer commandBuffer, int frameIndex);
+		void end(VkCommandBuffer commandBuffer, int frameIndex);
+
+		float getTime() const { return m_time; } // ms
+
+	private:
+		Device& m_device;
+
+		VkQueryPool m_queryPool = VK_NULL_HANDLE;
+		std::vector<bool> m_written; // Per frame in flight, if its queries were ever written
+
+		float m_time = 0.0f;
+	};
+}
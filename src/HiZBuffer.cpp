@@ -0,0 +1,254 @@
+#include "HiZBuffer.hpp"
+
+// std
+#include <cassert>
+#include <cmath>
+
+namespace OmniV {
+
+	struct HiZPushConstantData {
+		glm::ivec2 srcSize;
+		glm::ivec2 dstSize;
+		int copyDepth; // Mip 0 copies the depth attachment, the rest downsample the previous mip
+	};
+
+	static VkExtent2D getMipExtent(VkExtent2D extent, uint32_t mip) {
+		return VkExtent2D{ std::max(extent.width >> mip, 1u), std::max(extent.height >> mip, 1u) };
+	}
+
+	HiZBuffer::HiZBuffer(Device& device) : m_device{ device } {
+		m_setLayout = DescriptorSetLayout::Builder(m_device)
+			.addBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT)
+			.addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT)
+			.build();
+
+		createPipeline();
+
+		// Sampler shared by the depth copy and the occlusion tests
+		VkSamplerCreateInfo samplerInfo{};
+		samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		samplerInfo.magFilter = VK_FILTER_NEAREST;
+		samplerInfo.minFilter = VK_FILTER_NEAREST;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeV = samplerInfo.addressModeU;
+		samplerInfo.addressModeW = samplerInfo.addressModeU;
+		samplerInfo.mipLodBias = 0.0f;
+		samplerInfo.maxAnisotropy = 1.0f;
+		samplerInfo.minLod = 0.0f;
+		samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+		samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+
+		if (vkCreateSampler(m_device.device(), &samplerInfo, nullptr, &m_sampler) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create sampler!");
+		}
+	}
+
+	HiZBuffer::~HiZBuffer() {
+		destroyResources();
+
+		vkDestroySampler(m_device.device(), m_sampler, nullptr);
+		vkDestroyPipelineLayout(m_device.device(), m_pipelineLayout, nullptr);
+	}
+
+	void HiZBuffer::createPipeline() {
+		VkPushConstantRange pushConstantRange{};
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(HiZPushConstantData);
+
+		VkDescriptorSetLayout setLayout = m_setLayout->getDescriptorSetLayout();
+
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = 1;
+		pipelineLayoutInfo.pSetLayouts = &setLayout;
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+		if (vkCreatePipelineLayout(m_device.device(), &pipelineLayoutInfo, nullptr, &m_pipelineLayout) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create pipeline layout!");
+		}
+
+		m_pipeline = std::make_unique<ComputePipeline>(m_device, m_pipelineLayout, "hiz_build.comp.spv");
+	}
+
+	void HiZBuffer::resize(VkExtent2D extent, const std::vector<VkImageView>& depthImageViews) {
+		destroyResources();
+
+		m_extent = extent;
+		m_mipCount = static_cast<uint32_t>(std::floor(std::log2(std::max(extent.width, extent.height)))) + 1;
+
+		createResources();
+		createDescriptorSets(depthImageViews);
+	}
+
+	void HiZBuffer::createResources() {
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.extent.width = m_extent.width;
+		imageInfo.extent.height = m_extent.height;
+		imageInfo.extent.depth = 1;
+		imageInfo.mipLevels = m_mipCount;
+		imageInfo.arrayLayers = 1;
+		imageInfo.format = VK_FORMAT_R32_SFLOAT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.flags = 0;
+
+		m_device.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_image, m_imageMemory);
+
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = m_image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = VK_FORMAT_R32_SFLOAT;
+		viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		viewInfo.subresourceRange.baseMipLevel = 0;
+		viewInfo.subresourceRange.levelCount = m_mipCount;
+		viewInfo.subresourceRange.baseArrayLayer = 0;
+		viewInfo.subresourceRange.layerCount = 1;
+
+		if (vkCreateImageView(m_device.device(), &viewInfo, nullptr, &m_imageView) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create texture image view!");
+		}
+
+		m_mipImageViews.resize(m_mipCount);
+		for (uint32_t i = 0; i < m_mipCount; i++) {
+			viewInfo.subresourceRange.baseMipLevel = i;
+			viewInfo.subresourceRange.levelCount = 1;
+
+			if (vkCreateImageView(m_device.device(), &viewInfo, nullptr, &m_mipImageViews[i]) != VK_SUCCESS) {
+				throw std::runtime_error("failed to create texture image view!");
+			}
+		}
+
+		// The pyramid lives in GENERAL layout for its whole lifetime
+		VkCommandBuffer commandBuffer = m_device.beginSingleTimeCommands();
+
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = m_image;
+		barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, m_mipCount, 0, 1 };
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		m_device.endSingleTimeCommands(commandBuffer);
+	}
+
+	void HiZBuffer::createDescriptorSets(const std::vector<VkImageView>& depthImageViews) {
+		uint32_t setCount = static_cast<uint32_t>(depthImageViews.size()) + m_mipCount - 1;
+
+		m_descriptorPool = DescriptorPool::Builder(m_device)
+			.setMaxSets(setCount)
+			.addPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, setCount)
+			.addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, setCount)
+			.build();
+
+		VkDescriptorImageInfo dstInfo{};
+		dstInfo.imageView = m_mipImageViews[0];
+		dstInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		m_depthCopySets.resize(depthImageViews.size());
+		for (size_t i = 0; i < depthImageViews.size(); i++) {
+			VkDescriptorImageInfo srcInfo{};
+			srcInfo.sampler = m_sampler;
+			srcInfo.imageView = depthImageViews[i];
+			srcInfo.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+			DescriptorWriter(*m_setLayout, *m_descriptorPool)
+				.writeImage(0, &srcInfo)
+				.writeImage(1, &dstInfo)
+				.build(m_depthCopySets[i]);
+		}
+
+		m_downsampleSets.resize(m_mipCount - 1);
+		for (uint32_t i = 0; i + 1 < m_mipCount; i++) {
+			VkDescriptorImageInfo srcInfo{};
+			srcInfo.sampler = m_sampler;
+			srcInfo.imageView = m_mipImageViews[i];
+			srcInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+			dstInfo.imageView = m_mipImageViews[i + 1];
+
+			DescriptorWriter(*m_setLayout, *m_descriptorPool)
+				.writeImage(0, &srcInfo)
+				.writeImage(1, &dstInfo)
+				.build(m_downsampleSets[i]);
+		}
+	}
+
+	void HiZBuffer::destroyResources() {
+		m_depthCopySets.clear();
+		m_downsampleSets.clear();
+		m_descriptorPool = nullptr;
+
+		if (m_image != VK_NULL_HANDLE) {
+			// Frames in flight may still build or sample the pyramid
+			m_device.deferDestruction([device = m_device.device(), mipImageViews = std::move(m_mipImageViews), imageView = m_imageView,
+				image = m_image, imageMemory = m_imageMemory]() {
+				for (auto mipImageView : mipImageViews)
+					vkDestroyImageView(device, mipImageView, nullptr);
+
+				vkDestroyImageView(device, imageView, nullptr);
+				vkDestroyImage(device, image, nullptr);
+				vkFreeMemory(device, imageMemory, nullptr);
+			});
+			m_mipImageViews.clear();
+
+			m_imageView = VK_NULL_HANDLE;
+			m_image = VK_NULL_HANDLE;
+			m_imageMemory = VK_NULL_HANDLE;
+		}
+	}
+
+	void HiZBuffer::build(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+		assert(m_image != VK_NULL_HANDLE && "HiZBuffer has to be resized to the swapchain before building it");
+		assert(imageIndex < m_depthCopySets.size() && "Swapchain image index out of range");
+
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = m_image;
+
+		m_pipeline->bind(commandBuffer);
+
+		for (uint32_t mip = 0; mip < m_mipCount; mip++) {
+			VkDescriptorSet set = mip == 0 ? m_depthCopySets[imageIndex] : m_downsampleSets[mip - 1];
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &set, 0, nullptr);
+
+			VkExtent2D srcExtent = mip == 0 ? m_extent : getMipExtent(m_extent, mip - 1);
+			VkExtent2D dstExtent = getMipExtent(m_extent, mip);
+
+			HiZPushConstantData push{};
+			push.srcSize = glm::ivec2(srcExtent.width, srcExtent.height);
+			push.dstSize = glm::ivec2(dstExtent.width, dstExtent.height);
+			push.copyDepth = mip == 0 ? 1 : 0;
+
+			vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(HiZPushConstantData), &push);
+
+			vkCmdDispatch(commandBuffer, (dstExtent.width + 7) / 8, (dstExtent.height + 7) / 8, 1);
+
+			// Next mip reads what was just written
+			if (mip + 1 == m_mipCount)
+				break;
+
+			barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, mip, 1, 0, 1 };
+			barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+		}
+	}
+}
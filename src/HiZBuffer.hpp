@@ -0,0 +1,62 @@
+#pragma once
+
+#include "Descriptors.hpp"
+#include "Device.hpp"
+#include "Pipeline.hpp"
+
+namespace OmniV {
+
+	/// <summary>
+	/// <para> Hierarchical depth buffer (depth pyramid) built with compute from the swapchain depth attachment </para>
+	/// <para> Mip 0 is a copy of the depth buffer, and every following mip stores the farthest (max) depth of the texels it covers,
+	/// so testing an object against a single mip level tells if it is completely hidden behind what was already drawn </para>
+	/// <para> The whole pyramid stays in VK_IMAGE_LAYOUT_GENERAL, as every level is both written (storage) and read (sampled) </para>
+	/// </summary>
+	class HiZBuffer {
+	public:
+		HiZBuffer(Device& device);
+		~HiZBuffer();
+
+		HiZBuffer(const HiZBuffer&) = delete;
+		HiZBuffer& operator=(const HiZBuffer&) = delete;
+
+		// (Re)creates the pyramid for the current swapchain. Must be called after every swapchain recreation, with the device idle
+		void resize(VkExtent2D extent, const std::vector<VkImageView>& depthImageViews);
+
+		// Depth of swapchain image "imageIndex" has to be in DEPTH_STENCIL_READ_ONLY_OPTIMAL layout
+		// Only the barriers between mips are recorded, the caller orders the build with the previous and next users of the pyramid
+		void build(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+
+		VkImage getImage() const { return m_image; }
+		VkImageView getImageView() const { return m_imageView; }
+		VkSampler getSampler() const { return m_sampler; }
+		VkExtent2D getExtent() const { return m_extent; }
+		uint32_t getMipCount() const { return m_mipCount; }
+
+	private:
+		void createPipeline();
+		void createResources();
+		void createDescriptorSets(const std::vector<VkImageView>& depthImageViews);
+		void destroyResources();
+
+		Device& m_device;
+
+		VkExtent2D m_extent{ 0, 0 };
+		uint32_t m_mipCount = 0;
+
+		VkImage m_image = VK_NULL_HANDLE;
+		VkDeviceMemory m_imageMemory = VK_NULL_HANDLE;
+		VkImageView m_imageView = VK_NULL_HANDLE; // All mips, used for the occlusion tests
+		std::vector<VkImageView> m_mipImageViews; // One per mip, used to build the pyramid
+
+		VkSampler m_sampler = VK_NULL_HANDLE; // Nearest, so that no depth gets blended with its neighbours
+
+		std::unique_ptr<DescriptorSetLayout> m_setLayout;
+		std::unique_ptr<DescriptorPool> m_descriptorPool;
+		std::vector<VkDescriptorSet> m_depthCopySets; // Depth attachment -> mip 0, one per swapchain image
+		std::vector<VkDescriptorSet> m_downsampleSets; // Mip i -> mip i + 1
+
+		VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+		std::unique_ptr<ComputePipeline> m_pipeline;
+	};
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "defines.hpp"
+
+// std
+#include <mutex>
+
+namespace OmniV {
+
+	/// <summary>
+	/// <para> Hands out IDs below a fixed limit, reusing the released ones, so that objects created and destroyed for the whole process
+	/// (streamed models, pipeline permutations...) keep IDs that fit in the bits a sort key gives them </para>
+	/// <para> Throws when every ID is in use, instead of letting an ID spill over its neighbours. Thread safe </para>
+	/// </summary>
+	class IdAllocator {
+	public:
+		IdAllocator(uint32 maxCount, const char* name) : m_maxCount{ maxCount }, m_name{ name } {}
+
+		IdAllocator(const IdAllocator&) = delete;
+		IdAllocator& operator=(const IdAllocator&) = delete;
+
+		uint32 allocate() {
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			if (!m_freeIDs.empty()) {
+				uint32 id = m_freeIDs.back();
+				m_freeIDs.pop_back();
+				return id;
+			}
+
+			if (m_nextID >= m_maxCount)
+				throw std::runtime_error(std::string("Out of ") + m_name + " IDs, " + std::to_string(m_maxCount) + " are in use");
+
+			return m_nextID++;
+		}
+
+		void release(uint32 id) {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_freeIDs.push_back(id);
+		}
+
+	private:
+		const uint32 m_maxCount;
+		const char* m_name;
+
+		std::mutex m_mutex;
+		uint32 m_nextID = 0;
+		std::vector<uint32> m_freeIDs;
+	};
+}
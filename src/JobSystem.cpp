@@ -0,0 +1,189 @@
+#include "JobSystem.hpp"
+
+// std
+#include <cassert>
+
+namespace OmniV {
+
+	static thread_local uint32 s_threadIndex = 0;
+
+	JobSystem::JobSystem(uint32 workerCount) : m_workerCount{ workerCount } {
+		m_queues.reserve(getThreadCount());
+		for (uint32 i = 0; i < getThreadCount(); i++)
+			m_queues.push_back(std::make_unique<JobQueue>());
+
+		m_workers.reserve(m_workerCount);
+		for (uint32 i = 1; i <= m_workerCount; i++)
+			m_workers.emplace_back(&JobSystem::workerLoop, this, i);
+	}
+
+	JobSystem::~JobSystem() {
+		{
+			std::lock_guard<std::mutex> lock(m_sleepMutex);
+			m_stop = true;
+		}
+		m_wakeCondition.notify_all();
+
+		for (auto& worker : m_workers)
+			worker.join();
+	}
+
+	uint32 JobSystem::getThreadIndex() {
+		return s_threadIndex;
+	}
+
+	void JobSystem::run(JobFunction job, JobCounter* counter, const char* name) {
+		if (counter)
+			counter->m_pending.fetch_add(1, std::memory_order_relaxed);
+
+		push({ std::move(job), counter, name });
+	}
+
+	void JobSystem::runAfter(JobCounter& dependency, JobFunction job, JobCounter* counter, const char* name) {
+		if (counter)
+			counter->m_pending.fetch_add(1, std::memory_order_relaxed);
+
+		{
+			// The last job of "dependency" takes the same lock before releasing the held jobs
+			std::lock_guard<std::mutex> lock(dependency.m_mutex);
+			if (!dependency.isDone()) {
+				dependency.m_heldJobs.push_back({ std::move(job), counter, name });
+				return;
+			}
+		}
+
+		push({ std::move(job), counter, name });
+	}
+
+	void JobSystem::parallelFor(uint32 count, uint32 batchSize, RangeFunction function, JobCounter& counter, const char* name) {
+		assert(batchSize > 0 && "Batches can't be empty");
+
+		for (uint32 begin = 0; begin < count; begin += batchSize) {
+			uint32 end = std::min(begin + batchSize, count);
+			run([function, begin, end]() { function(begin, end); }, &counter, name);
+		}
+	}
+
+	void JobSystem::wait(JobCounter& counter) {
+		// The waiting thread helps instead of blocking, any job can be picked up, not only those of "counter"
+		while (!counter.isDone()) {
+			Job job;
+			if (tryPop(job))
+				execute(job);
+			else
+				std::this_thread::yield();
+		}
+
+		// The last job may still be inside finish(), which holds the lock until it no longer touches the counter
+		std::exception_ptr exception;
+		{
+			std::lock_guard<std::mutex> lock(counter.m_mutex);
+			exception = counter.m_exception;
+			counter.m_exception = nullptr;
+		}
+
+		if (exception)
+			std::rethrow_exception(exception);
+	}
+
+	void JobSystem::workerLoop(uint32 threadIndex) {
+		s_threadIndex = threadIndex;
+
+		while (true) {
+			Job job;
+			if (tryPop(job)) {
+				execute(job);
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(m_sleepMutex);
+			m_wakeCondition.wait(lock, [this]() { return m_stop || m_queuedJobs.load(std::memory_order_acquire) > 0; });
+
+			if (m_stop)
+				return;
+		}
+	}
+
+	void JobSystem::push(Job job) {
+		JobQueue& queue = *m_queues[s_threadIndex];
+		{
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.jobs.push_back(std::move(job));
+		}
+
+		m_queuedJobs.fetch_add(1, std::memory_order_release);
+
+		// Taking the lock orders the push with a worker that is about to sleep, so that the notification isn't lost
+		{
+			std::lock_guard<std::mutex> lock(m_sleepMutex);
+		}
+		m_wakeCondition.notify_one();
+	}
+
+	bool JobSystem::tryPop(Job& outJob) {
+		const uint32 threadIndex = s_threadIndex;
+		const uint32 threadCount = getThreadCount();
+
+		for (uint32 i = 0; i < threadCount; i++) {
+			uint32 queueIndex = (threadIndex + i) % threadCount;
+			JobQueue& queue = *m_queues[queueIndex];
+
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (queue.jobs.empty())
+				continue;
+
+			// Own jobs are popped newest first, stolen ones oldest first
+			if (queueIndex == threadIndex) {
+				outJob = std::move(queue.jobs.back());
+				queue.jobs.pop_back();
+			}
+			else {
+				outJob = std::move(queue.jobs.front());
+				queue.jobs.pop_front();
+			}
+
+			m_queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+
+		return false;
+	}
+
+	void JobSystem::execute(Job& job) {
+		const auto startTime = std::chrono::high_resolution_clock::now();
+
+		std::exception_ptr exception;
+		try {
+			job.function();
+		}
+		catch (...) {
+			// Rethrown by wait(), jobs without counter have nobody to report to
+			assert(job.counter && "Exception thrown by a job without counter");
+			exception = std::current_exception();
+		}
+
+		if (m_traceFunction)
+			m_traceFunction({ job.name, s_threadIndex, startTime, std::chrono::high_resolution_clock::now() });
+
+		finish(job.counter, exception);
+	}
+
+	void JobSystem::finish(JobCounter* counter, std::exception_ptr exception) {
+		if (!counter)
+			return;
+
+		std::vector<Job> released;
+		{
+			std::lock_guard<std::mutex> lock(counter->m_mutex);
+
+			if (exception && !counter->m_exception)
+				counter->m_exception = exception;
+
+			if (counter->m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				released.swap(counter->m_heldJobs);
+		}
+
+		for (Job& job : released)
+			push(std::move(job));
+	}
+}
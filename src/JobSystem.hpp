@@ -0,0 +1,124 @@
+#pragma once
+
+#include "defines.hpp"
+
+// std
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+namespace OmniV {
+
+	class JobCounter;
+
+	// Timings of an executed job, given to the trace function
+	struct JobTrace {
+		const char* name; // nullptr for unnamed jobs
+		uint32 threadIndex; // JobSystem::getThreadIndex() of the thread that ran it
+		std::chrono::high_resolution_clock::time_point start;
+		std::chrono::high_resolution_clock::time_point end;
+	};
+
+	/// <summary>
+	/// <para> Work-stealing job scheduler. Every worker thread owns a deque of jobs: it pushes and pops its own jobs at the back (most recent first,
+	/// while their data is still in cache) and steals from the front of the other deques when its own is empty </para>
+	/// <para> The thread that created the system is thread 0 and has a deque as well, its jobs are run by the workers, or by itself while it waits
+	/// for a counter </para>
+	/// <para> Completion is tracked with JobCounter: jobs started with a counter increment it, and decrement it once done. A job can also be held
+	/// back until a counter reaches 0 (runAfter), which is how dependencies between jobs are expressed </para>
+	/// </summary>
+	class JobSystem {
+	public:
+		using JobFunction = std::function<void()>;
+		using RangeFunction = std::function<void(uint32 begin, uint32 end)>; // [begin, end)
+		using TraceFunction = std::function<void(const JobTrace&)>;
+
+		// One worker per hardware thread, besides the calling thread
+		static uint32 getDefaultWorkerCount() { return std::max(std::thread::hardware_concurrency(), 1u) - 1; }
+
+		explicit JobSystem(uint32 workerCount = getDefaultWorkerCount());
+		~JobSystem();
+
+		JobSystem(const JobSystem&) = delete;
+		JobSystem& operator=(const JobSystem&) = delete;
+
+		uint32 getWorkerCount() const { return m_workerCount; }
+		uint32 getThreadCount() const { return m_workerCount + 1; } // Workers + the thread that created the system
+
+		// 0 on the thread that created the system (and any thread that isn't a worker), [1, getThreadCount()[ on the workers
+		static uint32 getThreadIndex();
+
+		// "counter" (optional) has to outlive the job, "name" is only used for traces
+		void run(JobFunction job, JobCounter* counter = nullptr, const char* name = nullptr);
+
+		// Same, but the job only starts once "dependency" reaches 0
+		void runAfter(JobCounter& dependency, JobFunction job, JobCounter* counter = nullptr, const char* name = nullptr);
+
+		// Splits [0, count[ in jobs of "batchSize" elements. The batches can run in any order and on any thread
+		void parallelFor(uint32 count, uint32 batchSize, RangeFunction function, JobCounter& counter, const char* name = nullptr);
+
+		// Runs pending jobs on the calling thread until "counter" reaches 0, then rethrows the first exception of its jobs, if any
+		void wait(JobCounter& counter);
+
+		// Called after every job, from the thread that ran it. Must be set while no job is running
+		void setTraceFunction(TraceFunction traceFunction) { m_traceFunction = std::move(traceFunction); }
+
+	private:
+		struct Job {
+			JobFunction function;
+			JobCounter* counter;
+			const char* name;
+		};
+
+		struct JobQueue {
+			std::mutex mutex;
+			std::deque<Job> jobs;
+		};
+
+		friend class JobCounter;
+
+		void workerLoop(uint32 threadIndex);
+
+		void push(Job job);
+		bool tryPop(Job& outJob); // Own deque first, then steals
+		void execute(Job& job);
+		void finish(JobCounter* counter, std::exception_ptr exception);
+
+		uint32 m_workerCount;
+		std::vector<std::unique_ptr<JobQueue>> m_queues; // One per thread, index 0 being the creating thread
+		std::vector<std::thread> m_workers;
+
+		// Sleeping workers are woken up when jobs are pushed
+		std::atomic<uint32> m_queuedJobs{ 0 };
+		std::mutex m_sleepMutex;
+		std::condition_variable m_wakeCondition;
+		bool m_stop = false;
+
+		TraceFunction m_traceFunction;
+	};
+
+	// Jobs still to finish. Must outlive the jobs that reference it, and not be reused before it reached 0
+	class JobCounter {
+	public:
+		JobCounter() = default;
+
+		JobCounter(const JobCounter&) = delete;
+		JobCounter& operator=(const JobCounter&) = delete;
+
+		bool isDone() const { return m_pending.load(std::memory_order_acquire) == 0; }
+
+	private:
+		friend class JobSystem;
+
+		std::atomic<uint32> m_pending{ 0 };
+
+		// Guards the held jobs and the exception against the last decrement
+		std::mutex m_mutex;
+		std::vector<JobSystem::Job> m_heldJobs; // Started by runAfter, pushed once the counter reaches 0
+		std::exception_ptr m_exception;
+	};
+}
@@ -0,0 +1,151 @@
+#include "LightClusters.hpp"
+
+// std
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+namespace OmniV {
+
+	LightClusters::LightClusters(Device& device, uint32 framesInFlight) {
+		m_lightBuffers.resize(framesInFlight);
+		m_clusterBuffers.resize(framesInFlight);
+		m_lightIndexBuffers.resize(framesInFlight);
+
+		for (uint32 i = 0; i < framesInFlight; i++) {
+			m_lightBuffers[i] = std::make_unique<Buffer>(device, sizeof(Light), MAX_LIGHTS,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+			m_lightBuffers[i]->map();
+
+			m_clusterBuffers[i] = std::make_unique<Buffer>(device, sizeof(glm::uvec2), CLUSTER_COUNT,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+			m_clusterBuffers[i]->map();
+
+			m_lightIndexBuffers[i] = std::make_unique<Buffer>(device, sizeof(uint32), MAX_LIGHT_INDICES,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+			m_lightIndexBuffers[i]->map();
+		}
+
+		m_clusterCounts.resize(CLUSTER_COUNT);
+		m_clusterCursors.resize(CLUSTER_COUNT);
+	}
+
+	void LightClusters::build(int frameIndex, const std::vector<Light>& lights, uint32 directionalCount, const Camera& camera, VkExtent2D extent, GlobalUbo& ubo) {
+		assert(lights.size() <= MAX_LIGHTS && "Exceeded maximum number of lights in scene");
+
+		// The light buffer holds MAX_LIGHTS, the rest is ignored
+		const uint32 lightCount = std::min(static_cast<uint32>(lights.size()), uint32(MAX_LIGHTS));
+
+		auto startTime = std::chrono::high_resolution_clock::now();
+
+		m_stats = {};
+		m_stats.pointLights = lightCount - std::min(directionalCount, lightCount);
+
+		// Exponential depth slices, so that clusters keep a similar shape along the frustum
+		const float nearClip = camera.getNear();
+		const float farClip = camera.getFar();
+		const float sliceScale = CLUSTERS_Z / std::log(farClip / nearClip);
+		const float sliceBias = -std::log(nearClip) * sliceScale;
+
+		auto getSlice = [&](float depth) {
+			int slice = static_cast<int>(std::floor(std::log(depth) * sliceScale + sliceBias));
+			return static_cast<uint8>(glm::clamp(slice, 0, int(CLUSTERS_Z) - 1));
+		};
+
+		ubo.clusterGrid = glm::uvec4(CLUSTERS_X, CLUSTERS_Y, CLUSTERS_Z, directionalCount);
+		ubo.clusterParams = glm::vec4(sliceScale, sliceBias, float(extent.width) / CLUSTERS_X, float(extent.height) / CLUSTERS_Y);
+
+		const glm::mat4& viewMat = camera.getView();
+		const glm::mat4& projMat = camera.getProjection();
+
+		// Clusters overlapped by each light: depth range of its sphere, and the screen rect of its view space AABB
+		m_boxes.clear();
+		for (uint32 i = directionalCount; i < lightCount; i++) {
+			const Light& light = lights[i];
+
+			float range = getLightRange(light.radius);
+			glm::vec3 center = glm::vec3(viewMat * glm::vec4(glm::vec3(light.position), 1.0f));
+
+			if (center.z + range < nearClip || center.z - range > farClip)
+				continue;
+
+			float minDepth = std::max(center.z - range, nearClip);
+			float maxDepth = std::min(center.z + range, farClip);
+
+			glm::vec2 ndcMin{ 1.0f }, ndcMax{ -1.0f };
+			for (int corner = 0; corner < 8; corner++) {
+				glm::vec4 clip = projMat * glm::vec4(
+					center.x + ((corner & 1) ? range : -range),
+					center.y + ((corner & 2) ? range : -range),
+					(corner & 4) ? maxDepth : minDepth,
+					1.0f);
+
+				glm::vec2 ndc = glm::vec2(clip) / clip.w;
+				ndcMin = glm::min(ndcMin, ndc);
+				ndcMax = glm::max(ndcMax, ndc);
+			}
+
+			if (ndcMax.x < -1.0f || ndcMin.x > 1.0f || ndcMax.y < -1.0f || ndcMin.y > 1.0f)
+				continue;
+
+			auto getTile = [](float ndc, uint32 tileCount) {
+				int tile = static_cast<int>((ndc * 0.5f + 0.5f) * tileCount);
+				return static_cast<uint8>(glm::clamp(tile, 0, int(tileCount) - 1));
+			};
+
+			ClusterBox box;
+			box.lightIndex = i;
+			box.minX = getTile(ndcMin.x, CLUSTERS_X);
+			box.maxX = getTile(ndcMax.x, CLUSTERS_X);
+			box.minY = getTile(ndcMin.y, CLUSTERS_Y);
+			box.maxY = getTile(ndcMax.y, CLUSTERS_Y);
+			box.minZ = getSlice(minDepth);
+			box.maxZ = getSlice(maxDepth);
+
+			m_boxes.push_back(box);
+		}
+
+		auto forEachCluster = [](const ClusterBox& box, auto&& function) {
+			for (uint32 z = box.minZ; z <= box.maxZ; z++)
+				for (uint32 y = box.minY; y <= box.maxY; y++)
+					for (uint32 x = box.minX; x <= box.maxX; x++)
+						function(x + CLUSTERS_X * (y + CLUSTERS_Y * z));
+		};
+
+		// Count, then prefix sum into offsets, then fill
+		std::fill(m_clusterCounts.begin(), m_clusterCounts.end(), 0);
+		for (const ClusterBox& box : m_boxes)
+			forEachCluster(box, [&](uint32 cluster) { m_clusterCounts[cluster]++; });
+
+		glm::uvec2* clusters = static_cast<glm::uvec2*>(m_clusterBuffers[frameIndex]->getMappedMemory());
+		uint32* lightIndices = static_cast<uint32*>(m_lightIndexBuffers[frameIndex]->getMappedMemory());
+
+		uint32 offset = 0;
+		for (uint32 cluster = 0; cluster < CLUSTER_COUNT; cluster++) {
+			uint32 count = std::min(m_clusterCounts[cluster], MAX_LIGHT_INDICES - offset);
+
+			m_stats.droppedIndices += m_clusterCounts[cluster] - count;
+			m_stats.maxClusterLights = std::max(m_stats.maxClusterLights, m_clusterCounts[cluster]);
+
+			m_clusterCursors[cluster] = offset;
+			clusters[cluster] = glm::uvec2(offset, count);
+
+			offset += count;
+			m_clusterCounts[cluster] = offset; // Now the end of the cluster's range
+		}
+		m_stats.lightIndices = offset;
+
+		for (const ClusterBox& box : m_boxes) {
+			forEachCluster(box, [&](uint32 cluster) {
+				if (m_clusterCursors[cluster] < m_clusterCounts[cluster])
+					lightIndices[m_clusterCursors[cluster]++] = box.lightIndex;
+			});
+		}
+
+		memcpy(m_lightBuffers[frameIndex]->getMappedMemory(), lights.data(), lightCount * sizeof(Light));
+
+		auto endTime = std::chrono::high_resolution_clock::now();
+		m_stats.buildTime = std::chrono::duration<float, std::chrono::milliseconds::period>(endTime - startTime).count();
+	}
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "Buffer.hpp"
+#include "Camera.hpp"
+#include "Device.hpp"
+#include "FrameInfo.hpp"
+
+namespace OmniV {
+
+	struct LightClusterStats {
+		uint32 pointLights = 0;
+		uint32 lightIndices = 0; // Light references stored over all clusters
+		uint32 maxClusterLights = 0; // Lights in the most crowded cluster
+		uint32 droppedIndices = 0; // Over MAX_LIGHT_INDICES, those lights are missing from their clusters
+		float buildTime = 0.0f; // ms
+	};
+
+	/// <summary>
+	/// <para> Clustered forward lighting. The view frustum is split in a 3D grid of clusters (screen tiles x exponential depth slices),
+	/// and every point light is assigned to the clusters its influence sphere overlaps. The fragment shader only evaluates the lights of its own cluster </para>
+	/// <para> Lights and cluster lists are built on the CPU every frame, and written to storage buffers (one set per frame in flight):
+	/// the light array (directional lights first), an {offset, count} pair per cluster, and the light indices those pairs point into </para>
+	/// </summary>
+	class LightClusters {
+	public:
+		static constexpr uint32 CLUSTERS_X = 16;
+		static constexpr uint32 CLUSTERS_Y = 9;
+		static constexpr uint32 CLUSTERS_Z = 24;
+		static constexpr uint32 CLUSTER_COUNT = CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z;
+		static constexpr uint32 MAX_LIGHT_INDICES = 1 << 20;
+
+		LightClusters(Device& device, uint32 framesInFlight);
+
+		LightClusters(const LightClusters&) = delete;
+		LightClusters& operator=(const LightClusters&) = delete;
+
+		// "lights" holds "directionalCount" directional lights followed by point lights. Fills the cluster parameters of "ubo"
+		void build(int frameIndex, const std::vector<Light>& lights, uint32 directionalCount, const Camera& camera, VkExtent2D extent, GlobalUbo& ubo);
+
+		VkDescriptorBufferInfo getLightBufferInfo(int frameIndex) { return m_lightBuffers[frameIndex]->descriptorInfo(); }
+		VkDescriptorBufferInfo getClusterBufferInfo(int frameIndex) { return m_clusterBuffers[frameIndex]->descriptorInfo(); }
+		VkDescriptorBufferInfo getLightIndexBufferInfo(int frameIndex) { return m_lightIndexBuffers[frameIndex]->descriptorInfo(); }
+
+		const LightClusterStats& getStats() const { return m_stats; }
+
+		// Distance at which the shader's attenuation window reaches zero (see attenuation() in scene.frag)
+		static float getLightRange(float lightRadius) { return std::sqrt(lightRadius * 100.0f); }
+
+	private:
+		// Inclusive cluster ranges covered by a light
+		struct ClusterBox {
+			uint32 lightIndex;
+			uint8 minX, maxX;
+			uint8 minY, maxY;
+			uint8 minZ, maxZ;
+		};
+
+		// One set per frame in flight
+		std::vector<std::unique_ptr<Buffer>> m_lightBuffers;
+		std::vector<std::unique_ptr<Buffer>> m_clusterBuffers; // {offset, count} per cluster
+		std::vector<std::unique_ptr<Buffer>> m_lightIndexBuffers;
+
+		std::vector<ClusterBox> m_boxes;
+		std::vector<uint32> m_clusterCounts;
+		std::vector<uint32> m_clusterCursors;
+
+		LightClusterStats m_stats;
+	};
+}
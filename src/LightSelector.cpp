@@ -0,0 +1,85 @@
+#include "LightSelector.hpp"
+#include "LightClusters.hpp"
+#include "Utils.hpp"
+
+// std
+#include <cassert>
+
+namespace OmniV {
+
+	// Same attenuation as scene.frag, for a light at "squaredDistance" from the surface
+	static float estimateAttenuation(float squaredDistance, float lightRadius) {
+		const float d0 = 1.0f;
+		float influenceRadius = lightRadius * 100.0f;
+
+		float fallOff = (d0 + lightRadius) / std::max(squaredDistance, lightRadius);
+		float window = std::pow(std::max(0.0f, 1.0f - std::pow(squaredDistance / influenceRadius, 4.0f)), 2.0f);
+
+		return window * fallOff;
+	}
+
+	LightSelector::LightSelector(Device& device, uint32 framesInFlight, uint32 maxObjectLights) : m_maxObjectLights{ maxObjectLights } {
+		assert(m_maxObjectLights > 0 && m_maxObjectLights <= MAX_OBJECT_LIGHTS && "Invalid number of lights per object");
+
+		m_lightIndexBuffers.resize(framesInFlight);
+		for (uint32 i = 0; i < framesInFlight; i++) {
+			m_lightIndexBuffers[i] = std::make_unique<Buffer>(device, sizeof(uint32), MAX_GAME_OBJECTS * MAX_OBJECT_LIGHTS,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+			m_lightIndexBuffers[i]->map();
+		}
+	}
+
+	void LightSelector::build(int frameIndex, const RenderQueue& renderQueue, const std::vector<Light>& lights, uint32 directionalCount) {
+		// Indices past the light buffer would be read out of bounds by the shaders
+		const uint32 lightCount = std::min(static_cast<uint32>(lights.size()), uint32(MAX_LIGHTS));
+
+		m_stats = {};
+		m_stats.objects = renderQueue.size();
+
+		m_lists.resize(renderQueue.size());
+
+		uint32* lightIndices = static_cast<uint32*>(m_lightIndexBuffers[frameIndex]->getMappedMemory());
+		uint32 offset = 0;
+
+		for (uint32 i = 0; i < renderQueue.size(); i++) {
+			const DrawPacket& packet = renderQueue.begin()[i];
+
+			glm::vec3 boundsMin, boundsMax;
+			getWorldBounds(packet.object->m_transform.mat4(), packet.model->getBoundsMin(), packet.model->getBoundsMax(), boundsMin, boundsMax);
+
+			// Lights whose range overlaps the bounds, with their contribution at the closest point
+			m_candidates.clear();
+			for (uint32 lightIndex = directionalCount; lightIndex < lightCount; lightIndex++) {
+				const Light& light = lights[lightIndex];
+				glm::vec3 position = glm::vec3(light.position);
+
+				glm::vec3 delta = glm::max(glm::max(boundsMin - position, position - boundsMax), glm::vec3(0.0f));
+				float squaredDistance = glm::dot(delta, delta);
+
+				float range = LightClusters::getLightRange(light.radius);
+				if (squaredDistance >= range * range)
+					continue;
+
+				float intensity = light.color.w * std::max(light.color.x, std::max(light.color.y, light.color.z));
+				m_candidates.push_back({ lightIndex, intensity * estimateAttenuation(squaredDistance, light.radius) });
+			}
+
+			uint32 count = static_cast<uint32>(m_candidates.size());
+			if (count > m_maxObjectLights) {
+				std::partial_sort(m_candidates.begin(), m_candidates.begin() + m_maxObjectLights, m_candidates.end(),
+					[](const Candidate& a, const Candidate& b) { return a.contribution > b.contribution; });
+
+				count = m_maxObjectLights;
+				m_stats.truncatedObjects++;
+			}
+
+			for (uint32 j = 0; j < count; j++)
+				lightIndices[offset + j] = m_candidates[j].lightIndex;
+
+			m_lists[i] = glm::uvec2(offset, count);
+			offset += count;
+		}
+
+		m_stats.selectedLights = offset;
+	}
+}
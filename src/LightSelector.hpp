@@ -0,0 +1,57 @@
+#pragma once
+
+#include "Buffer.hpp"
+#include "Device.hpp"
+#include "FrameInfo.hpp"
+#include "RenderQueue.hpp"
+
+namespace OmniV {
+
+	struct LightSelectionStats {
+		uint32 objects = 0;
+		uint32 selectedLights = 0; // Over all objects
+		uint32 truncatedObjects = 0; // Objects affected by more lights than the per object cap
+	};
+
+	/// <summary>
+	/// <para> Per object light lists, an alternative to clustered lighting for scenes with few, large objects </para>
+	/// <para> For every packet of the render queue, the point lights whose range overlaps the object's bounds are ranked by their estimated
+	/// contribution (intensity with the shader's attenuation at the closest point of the bounds), and the best ones are kept.
+	/// Objects affected by more lights than the cap lose the dimmest ones instead of failing </para>
+	/// <para> Lists are written back to back into a storage buffer. Each packet's offset and count are copied into its entry of the
+	/// per object data (ObjectData storage buffer, binding 6), which the shaders index with the draw's instance </para>
+	/// </summary>
+	class LightSelector {
+	public:
+		static constexpr uint32 MAX_OBJECT_LIGHTS = 16;
+
+		LightSelector(Device& device, uint32 framesInFlight, uint32 maxObjectLights);
+
+		LightSelector(const LightSelector&) = delete;
+		LightSelector& operator=(const LightSelector&) = delete;
+
+		// "lights" holds "directionalCount" directional lights followed by point lights. Directional lights are never part of the lists
+		void build(int frameIndex, const RenderQueue& renderQueue, const std::vector<Light>& lights, uint32 directionalCount);
+
+		// {offset, count} of the list of render queue packet "packetIndex"
+		const glm::uvec2& getLightList(uint32 packetIndex) const { return m_lists[packetIndex]; }
+
+		VkDescriptorBufferInfo getLightIndexBufferInfo(int frameIndex) { return m_lightIndexBuffers[frameIndex]->descriptorInfo(); }
+
+		const LightSelectionStats& getStats() const { return m_stats; }
+
+	private:
+		struct Candidate {
+			uint32 lightIndex;
+			float contribution;
+		};
+
+		uint32 m_maxObjectLights;
+
+		std::vector<std::unique_ptr<Buffer>> m_lightIndexBuffers; // One per frame in flight
+		std::vector<glm::uvec2> m_lists; // Per render queue packet
+		std::vector<Candidate> m_candidates;
+
+		LightSelectionStats m_stats;
+	};
+}
@@ -0,0 +1,211 @@
+#include "MeshStreamer.hpp"
+#include "Utils.hpp"
+
+// std
+#include <limits>
+
+namespace OmniV {
+
+	MeshStreamer::MeshStreamer(Device& device, const StreamingSettings& settings)
+		: m_device{ device }, m_settings{ settings } {
+		assert(m_settings.unloadMargin >= 0.0f && "Streaming hysteresis margin can't be negative");
+
+		m_loaderThread = std::thread(&MeshStreamer::loaderLoop, this);
+	}
+
+	MeshStreamer::~MeshStreamer() {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stopLoader = true;
+		}
+		m_condition.notify_all();
+
+		m_loaderThread.join();
+	}
+
+	void MeshStreamer::registerProxy(GameObject::id_t objectID, const std::string& filepath, const glm::vec3& boundsMin, const glm::vec3& boundsMax, bool keepCpuGeometry) {
+		Proxy proxy{};
+		proxy.objectID = objectID;
+		proxy.filepath = filepath;
+		proxy.boundsMin = boundsMin;
+		proxy.boundsMax = boundsMax;
+		proxy.keepCpuGeometry = keepCpuGeometry;
+
+		m_proxies.push_back(std::move(proxy));
+	}
+
+	void MeshStreamer::loaderLoop() {
+		while (true) {
+			LoadRequest request;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_condition.wait(lock, [this] { return m_stopLoader || !m_loadRequests.empty(); });
+
+				if (m_stopLoader)
+					return;
+
+				request = std::move(m_loadRequests.front());
+				m_loadRequests.pop_front();
+			}
+
+			// Parsing is the slow part, and only touches CPU memory
+			LoadResult result{ request.proxyIndex, std::make_unique<Model::Builder>(), nullptr };
+			result.builder->keepCpuGeometry = request.keepCpuGeometry;
+
+			try {
+				result.builder->loadModel("models/" + request.filepath);
+			}
+			catch (...) {
+				result.error = std::current_exception();
+			}
+
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_loadResults.push_back(std::move(result));
+		}
+	}
+
+	void MeshStreamer::update(GameObject::Map& gameObjects, const glm::vec3& cameraPosition) {
+		const float unloadRadius = m_settings.loadRadius + m_settings.unloadMargin;
+
+		// Distance from the camera to the world bounds of every proxy
+		for (Proxy& proxy : m_proxies) {
+			auto it = gameObjects.find(proxy.objectID);
+			if (it == gameObjects.end()) {
+				proxy.distance = std::numeric_limits<float>::max();
+				continue;
+			}
+
+			glm::vec3 worldMin, worldMax;
+			getWorldBounds(it->second.m_transform.mat4(), proxy.boundsMin, proxy.boundsMax, worldMin, worldMax);
+
+			glm::vec3 delta = glm::max(glm::max(worldMin - cameraPosition, cameraPosition - worldMax), glm::vec3(0.0f));
+			proxy.distance = glm::length(delta);
+		}
+
+		std::vector<LoadResult> results;
+		std::vector<uint32> newRequests;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			results.swap(m_loadResults);
+
+			// Drop the requests that are out of range before the loader gets to them
+			auto removed = std::remove_if(m_loadRequests.begin(), m_loadRequests.end(),
+				[&](const LoadRequest& request) { return m_proxies[request.proxyIndex].distance > unloadRadius; });
+
+			for (auto it = removed; it != m_loadRequests.end(); it++)
+				m_proxies[it->proxyIndex].state = ProxyState::Unloaded;
+
+			m_loadRequests.erase(removed, m_loadRequests.end());
+		}
+
+		for (LoadResult& result : results) {
+			if (result.error)
+				std::rethrow_exception(result.error);
+
+			Proxy& proxy = m_proxies[result.proxyIndex];
+			proxy.sizeBytes = result.builder->vertices.size() * sizeof(Model::Vertex) + result.builder->indices.size() * sizeof(uint32_t);
+			proxy.builder = std::move(result.builder);
+			proxy.state = ProxyState::Parsed;
+		}
+
+		// Evictions (with hysteresis) and new requests
+		for (uint32 i = 0; i < m_proxies.size(); i++) {
+			Proxy& proxy = m_proxies[i];
+
+			switch (proxy.state) {
+			case ProxyState::Unloaded:
+				if (proxy.distance <= m_settings.loadRadius)
+					newRequests.push_back(i);
+				break;
+
+			case ProxyState::Parsed:
+				if (proxy.distance > unloadRadius) {
+					proxy.builder.reset();
+					proxy.state = ProxyState::Unloaded;
+				}
+				break;
+
+			case ProxyState::Resident:
+				if (proxy.distance > unloadRadius)
+					evict(proxy, gameObjects.at(proxy.objectID));
+				break;
+
+			default:
+				break;
+			}
+		}
+
+		if (!newRequests.empty()) {
+			std::sort(newRequests.begin(), newRequests.end(), [this](uint32 a, uint32 b) { return m_proxies[a].distance < m_proxies[b].distance; });
+
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				for (uint32 index : newRequests) {
+					m_proxies[index].state = ProxyState::Loading;
+					m_loadRequests.push_back({ index, m_proxies[index].filepath, m_proxies[index].keepCpuGeometry });
+				}
+			}
+			m_condition.notify_one();
+		}
+
+		// Uploads, nearest first, within the frame budget. At least one mesh is uploaded per frame so that
+		// meshes larger than the budget still get loaded
+		m_uploadOrder.clear();
+		for (uint32 i = 0; i < m_proxies.size(); i++)
+			if (m_proxies[i].state == ProxyState::Parsed)
+				m_uploadOrder.push_back(i);
+
+		std::sort(m_uploadOrder.begin(), m_uploadOrder.end(), [this](uint32 a, uint32 b) { return m_proxies[a].distance < m_proxies[b].distance; });
+
+		uint64 uploadedThisFrame = 0;
+		for (uint32 index : m_uploadOrder) {
+			Proxy& proxy = m_proxies[index];
+
+			if (uploadedThisFrame > 0 && uploadedThisFrame + proxy.sizeBytes > m_settings.uploadBudget)
+				break;
+
+			// Make room by evicting the furthest resident meshes, as long as they are further than this one
+			while (m_stats.residentBytes + proxy.sizeBytes > m_settings.residencyCap) {
+				Proxy* furthest = nullptr;
+				for (Proxy& resident : m_proxies)
+					if (resident.state == ProxyState::Resident && resident.distance > proxy.distance && (!furthest || resident.distance > furthest->distance))
+						furthest = &resident;
+
+				if (!furthest)
+					break;
+
+				evict(*furthest, gameObjects.at(furthest->objectID));
+			}
+
+			// Over the cap even after evicting, it stays parsed until something else leaves
+			if (m_stats.residentBytes + proxy.sizeBytes > m_settings.residencyCap)
+				continue;
+
+			gameObjects.at(proxy.objectID).m_model = std::make_shared<Model>(m_device, *proxy.builder);
+			proxy.builder.reset();
+			proxy.state = ProxyState::Resident;
+
+			uploadedThisFrame += proxy.sizeBytes;
+			m_stats.residentBytes += proxy.sizeBytes;
+			m_stats.residentMeshes++;
+		}
+
+		m_stats.uploadedBytes += uploadedThisFrame;
+
+		m_stats.pendingLoads = 0;
+		for (const Proxy& proxy : m_proxies)
+			if (proxy.state == ProxyState::Loading || proxy.state == ProxyState::Parsed)
+				m_stats.pendingLoads++;
+	}
+
+	void MeshStreamer::evict(Proxy& proxy, GameObject& gameObject) {
+		// The device defers the destruction of its buffers until the frames in flight drawing it are finished
+		gameObject.m_model = nullptr;
+
+		proxy.state = ProxyState::Unloaded;
+
+		m_stats.residentBytes -= proxy.sizeBytes;
+		m_stats.residentMeshes--;
+		m_stats.evictions++;
+	}
+}
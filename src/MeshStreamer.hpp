@@ -0,0 +1,104 @@
+#pragma once
+
+#include "Device.hpp"
+#include "FrameInfo.hpp"
+#include "GameObject.hpp"
+#include "Model.hpp"
+
+// std
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+namespace OmniV {
+
+	struct StreamingStats {
+		uint32 residentMeshes = 0;
+		uint32 pendingLoads = 0; // Requested or parsed, not uploaded yet
+		uint32 evictions = 0; // Since the last stats reset
+		uint64 residentBytes = 0;
+		uint64 uploadedBytes = 0; // Since the last stats reset
+	};
+
+	/// <summary>
+	/// <para> Distance based streaming of the scene meshes. In streaming mode, the meshes of the scene are registered as proxies
+	/// (a game object without model, plus its file and model space bounds) instead of being loaded up front </para>
+	/// <para> A background thread parses the OBJ files of the proxies that come within the load radius of the camera.
+	/// The GPU upload is done on the main thread (it goes through the graphics queue), up to a byte budget per frame </para>
+	/// <para> Meshes are evicted once they are further than the load radius plus a hysteresis margin, so that a camera moving
+	/// around the border doesn't load and evict the same mesh every frame. Resident memory never exceeds the residency cap </para>
+	/// </summary>
+	class MeshStreamer {
+	public:
+		MeshStreamer(Device& device, const StreamingSettings& settings);
+		~MeshStreamer();
+
+		MeshStreamer(const MeshStreamer&) = delete;
+		MeshStreamer& operator=(const MeshStreamer&) = delete;
+
+		// "filepath" is relative to the models folder. Bounds are in model space
+		void registerProxy(GameObject::id_t objectID, const std::string& filepath, const glm::vec3& boundsMin, const glm::vec3& boundsMax, bool keepCpuGeometry);
+
+		// Requests, uploads and evicts meshes around "cameraPosition". Has to be called once per frame, before the frame is recorded
+		void update(GameObject::Map& gameObjects, const glm::vec3& cameraPosition);
+
+		const StreamingStats& getStats() const { return m_stats; }
+		void resetCounters() { m_stats.evictions = 0; m_stats.uploadedBytes = 0; }
+
+	private:
+		enum class ProxyState {
+			Unloaded,
+			Loading, // Queued or being parsed by the loader thread
+			Parsed, // Waiting for its upload
+			Resident,
+		};
+
+		struct Proxy {
+			GameObject::id_t objectID;
+			std::string filepath;
+			glm::vec3 boundsMin;
+			glm::vec3 boundsMax;
+			bool keepCpuGeometry;
+
+			ProxyState state = ProxyState::Unloaded;
+			float distance = 0.0f; // Camera to world bounds, updated every frame
+			uint64 sizeBytes = 0; // Vertex + index buffers, known once parsed
+			std::unique_ptr<Model::Builder> builder; // Parsed geometry waiting for its upload
+		};
+
+		// Copied so that the loader thread never reads m_proxies
+		struct LoadRequest {
+			uint32 proxyIndex;
+			std::string filepath;
+			bool keepCpuGeometry;
+		};
+
+		struct LoadResult {
+			uint32 proxyIndex;
+			std::unique_ptr<Model::Builder> builder;
+			std::exception_ptr error; // Rethrown on the main thread
+		};
+
+		void loaderLoop();
+
+		void evict(Proxy& proxy, GameObject& gameObject);
+
+		Device& m_device;
+		StreamingSettings m_settings;
+
+		std::vector<Proxy> m_proxies;
+		std::vector<uint32> m_uploadOrder; // Scratch, parsed proxies sorted by distance
+
+		// Shared with the loader thread
+		std::thread m_loaderThread;
+		std::mutex m_mutex;
+		std::condition_variable m_condition;
+		std::deque<LoadRequest> m_loadRequests; // Nearest first
+		std::vector<LoadResult> m_loadResults;
+		bool m_stopLoader = false;
+
+		StreamingStats m_stats;
+	};
+}
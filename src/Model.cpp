@@ -1,6 +1,8 @@
 #include "common.hpp"
 #include "Model.hpp"
 #include "Utils.hpp"
+#include "IdAllocator.hpp"
+#include "RenderQueue.hpp"
 
 // libs
 #define TINYOBJLOADER_IMPLEMENTATION
@@ -26,15 +28,50 @@ namespace std {
 
 namespace OmniV {
 
+	// IDs of the live models, dense enough to fit in the model field of the render queue's sort key
+	static IdAllocator& getModelIDs() {
+		static IdAllocator modelIDs{ 1u << RenderQueue::MODEL_BITS, "model" };
+		return modelIDs;
+	}
+
 	Model::Model(Device& device, const Model::Builder& builder) : m_device{ device } {
 		createVertexBuffers(builder.vertices);
 		createIndexBuffers(builder.indices);
+
+		m_boundsMin = builder.vertices[0].position;
+		m_boundsMax = builder.vertices[0].position;
+		for (const Vertex& vertex : builder.vertices) {
+			m_boundsMin = glm::min(m_boundsMin, vertex.position);
+			m_boundsMax = glm::max(m_boundsMax, vertex.position);
+		}
+
+		if (builder.keepCpuGeometry) {
+			m_cpuPositions.reserve(builder.vertices.size());
+			for (const Vertex& vertex : builder.vertices)
+				m_cpuPositions.push_back(vertex.position);
+
+			// Non indexed models get a trivial index list, so that users only have to handle one case
+			if (builder.indices.empty()) {
+				m_cpuIndices.resize(builder.vertices.size());
+				for (uint32_t i = 0; i < m_cpuIndices.size(); i++)
+					m_cpuIndices[i] = i;
+			}
+			else {
+				m_cpuIndices = builder.indices;
+			}
+		}
+
+		// Last, so that a constructor that throws doesn't leak its ID
+		m_modelID = getModelIDs().allocate();
 	}
 
-	Model::~Model() {}
+	Model::~Model() {
+		getModelIDs().release(m_modelID);
+	}
 
-	std::unique_ptr<Model> Model::createModelFromFile(Device& device, const std::string& filepath) {
+	std::unique_ptr<Model> Model::createModelFromFile(Device& device, const std::string& filepath, bool keepCpuGeometry) {
 		Builder builder{};
+		builder.keepCpuGeometry = keepCpuGeometry;
 		builder.loadModel("models/" + filepath);
 		return std::make_unique<Model>(device, builder);
 	}
@@ -99,13 +136,32 @@ namespace OmniV {
 		m_device.copyBuffer(stagingBuffer.getBuffer(), m_indexBuffer->getBuffer(), bufferSize);
 	}
 
-	void Model::draw(VkCommandBuffer commandBuffer) {
+	void Model::draw(VkCommandBuffer commandBuffer, uint32_t instanceCount, uint32_t firstInstance) {
 		if (m_hasIndexBuffer) {
-			vkCmdDrawIndexed(commandBuffer, m_indexCount, 1, 0, 0, 0);
+			vkCmdDrawIndexed(commandBuffer, m_indexCount, instanceCount, 0, 0, firstInstance);
 		}
 		else {
-			vkCmdDraw(commandBuffer, m_vertexCount, 1, 0, 0);
+			vkCmdDraw(commandBuffer, m_vertexCount, instanceCount, 0, firstInstance);
+		}
+	}
+
+	void Model::drawIndirect(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset) {
+		if (m_hasIndexBuffer) {
+			vkCmdDrawIndexedIndirect(commandBuffer, buffer, offset, 1, sizeof(VkDrawIndexedIndirectCommand));
 		}
+		else {
+			vkCmdDrawIndirect(commandBuffer, buffer, offset, 1, sizeof(VkDrawIndirectCommand));
+		}
+	}
+
+	VkDrawIndexedIndirectCommand Model::getDrawCommand(uint32_t firstInstance) const {
+		VkDrawIndexedIndirectCommand command{};
+		command.indexCount = m_hasIndexBuffer ? m_indexCount : m_vertexCount; // vertexCount for non indexed draws
+		command.instanceCount = 1;
+		command.firstIndex = 0; // firstVertex for non indexed draws
+		command.vertexOffset = m_hasIndexBuffer ? 0 : static_cast<int32_t>(firstInstance); // firstInstance for non indexed draws
+		command.firstInstance = firstInstance;
+		return command;
 	}
 
 	void Model::bind(VkCommandBuffer commandBuffer) {
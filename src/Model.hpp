@@ -23,6 +23,7 @@ namespace OmniV {
         struct Builder {
             std::vector<Vertex> vertices{};
             std::vector<uint32_t> indices{};
+            bool keepCpuGeometry = false;
 
             void loadModel(const std::string& filepath);
         };
@@ -33,10 +34,27 @@ namespace OmniV {
         Model(const Model&) = delete;
         Model& operator=(const Model&) = delete;
 
-        static std::unique_ptr<Model> createModelFromFile(Device& device, const std::string& filepath);
+        // keepCpuGeometry: positions and indices are also kept in CPU memory (e.g. for software occlusion)
+        static std::unique_ptr<Model> createModelFromFile(Device& device, const std::string& filepath, bool keepCpuGeometry = false);
 
         void bind(VkCommandBuffer commandBuffer);
-        void draw(VkCommandBuffer commandBuffer);
+        // gl_InstanceIndex starts at "firstInstance", e.g. the index of the object's data in a storage buffer
+        void draw(VkCommandBuffer commandBuffer, uint32_t instanceCount = 1, uint32_t firstInstance = 0);
+
+        // Draws with the parameters stored in "buffer" at "offset", written as a VkDrawIndexedIndirectCommand
+        // Non indexed models read the first 4 members as a VkDrawIndirectCommand (instanceCount is at the same offset in both)
+        void drawIndirect(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset);
+        VkDrawIndexedIndirectCommand getDrawCommand(uint32_t firstInstance = 0) const;
+
+        uint32_t getModelID() const { return m_modelID; }
+
+        // Axis aligned bounding box in model space
+        const glm::vec3& getBoundsMin() const { return m_boundsMin; }
+        const glm::vec3& getBoundsMax() const { return m_boundsMax; }
+
+        // Empty unless the model was created with keepCpuGeometry
+        const std::vector<glm::vec3>& getCpuPositions() const { return m_cpuPositions; }
+        const std::vector<uint32_t>& getCpuIndices() const { return m_cpuIndices; }
 
     private:
         void createVertexBuffers(const std::vector<Vertex>& vertices);
@@ -44,6 +62,15 @@ namespace OmniV {
 
         Device& m_device;
 
+        // Unique per model, used to group draws that share vertex/index buffers
+        uint32_t m_modelID;
+
+        glm::vec3 m_boundsMin{ 0.f };
+        glm::vec3 m_boundsMax{ 0.f };
+
+        std::vector<glm::vec3> m_cpuPositions;
+        std::vector<uint32_t> m_cpuIndices;
+
         std::unique_ptr<Buffer> m_vertexBuffer;
         uint32_t m_vertexCount;
 
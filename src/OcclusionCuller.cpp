@@ -0,0 +1,223 @@
+#include "OcclusionCuller.hpp"
+#include "RenderQueue.hpp"
+#include "Utils.hpp"
+
+// std
+#include <cassert>
+
+namespace OmniV {
+
+	// Must match occlusion_cull.comp
+	struct CullObject {
+		glm::vec3 boundsMin;
+		uint32 objectID;
+		glm::vec3 boundsMax;
+		uint32 padding;
+	};
+
+	struct CullPushConstantData {
+		glm::mat4 viewProjMat;
+		uint32 objectCount;
+		uint32 phase;
+	};
+
+	static constexpr uint32 CULL_GROUP_SIZE = 64;
+
+	OcclusionCuller::OcclusionCuller(Device& device, Renderer& renderer)
+		: m_device{ device }, m_renderer{ renderer }, m_hiZBuffer{ device } {
+		createBuffers();
+		createDescriptorSets();
+		createPipeline();
+	}
+
+	OcclusionCuller::~OcclusionCuller() {
+		vkDestroyPipelineLayout(m_device.device(), m_pipelineLayout, nullptr);
+	}
+
+	void OcclusionCuller::createBuffers() {
+		const uint32 framesInFlight = m_renderer.getFramesInFlight();
+
+		m_visibilityBuffer = std::make_unique<Buffer>(m_device, sizeof(uint32), MAX_GAME_OBJECTS,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		// Nothing is visible before the first frame, so everything goes through the occlusion test
+		VkCommandBuffer commandBuffer = m_device.beginSingleTimeCommands();
+		vkCmdFillBuffer(commandBuffer, m_visibilityBuffer->getBuffer(), 0, VK_WHOLE_SIZE, 0);
+		m_device.endSingleTimeCommands(commandBuffer);
+
+		m_objectBuffers.resize(framesInFlight);
+		m_drawCommandBuffers.resize(framesInFlight);
+		m_statsBuffers.resize(framesInFlight);
+
+		for (uint32 i = 0; i < framesInFlight; i++) {
+			m_objectBuffers[i] = std::make_unique<Buffer>(m_device, sizeof(CullObject), MAX_GAME_OBJECTS,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+			m_objectBuffers[i]->map();
+
+			// Phase 0 commands, then phase 1 commands
+			m_drawCommandBuffers[i] = std::make_unique<Buffer>(m_device, sizeof(VkDrawIndexedIndirectCommand), 2 * MAX_GAME_OBJECTS,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+			m_drawCommandBuffers[i]->map();
+
+			m_statsBuffers[i] = std::make_unique<Buffer>(m_device, sizeof(CullingStats), 1,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+			m_statsBuffers[i]->map();
+
+			CullingStats emptyStats{};
+			m_statsBuffers[i]->writeToBuffer(&emptyStats);
+		}
+	}
+
+	void OcclusionCuller::createDescriptorSets() {
+		const uint32 framesInFlight = m_renderer.getFramesInFlight();
+
+		m_setLayout = DescriptorSetLayout::Builder(m_device)
+			.addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+			.addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+			.addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+			.addBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+			.addBinding(4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT)
+			.build();
+
+		m_descriptorPool = DescriptorPool::Builder(m_device)
+			.setMaxSets(framesInFlight)
+			.addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4 * framesInFlight)
+			.addPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, framesInFlight)
+			.build();
+
+		// The Hi-Z binding is written once the pyramid exists (see prepare)
+		m_descriptorSets.resize(framesInFlight);
+		m_setGenerations.assign(framesInFlight, ~0u);
+		for (uint32 i = 0; i < framesInFlight; i++) {
+			auto objectsInfo = m_objectBuffers[i]->descriptorInfo();
+			auto drawCommandsInfo = m_drawCommandBuffers[i]->descriptorInfo();
+			auto visibilityInfo = m_visibilityBuffer->descriptorInfo();
+			auto statsInfo = m_statsBuffers[i]->descriptorInfo();
+
+			DescriptorWriter(*m_setLayout, *m_descriptorPool)
+				.writeBuffer(0, &objectsInfo)
+				.writeBuffer(1, &drawCommandsInfo)
+				.writeBuffer(2, &visibilityInfo)
+				.writeBuffer(3, &statsInfo)
+				.build(m_descriptorSets[i]);
+		}
+	}
+
+	void OcclusionCuller::createPipeline() {
+		VkPushConstantRange pushConstantRange{};
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(CullPushConstantData);
+
+		VkDescriptorSetLayout setLayout = m_setLayout->getDescriptorSetLayout();
+
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = 1;
+		pipelineLayoutInfo.pSetLayouts = &setLayout;
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+		if (vkCreatePipelineLayout(m_device.device(), &pipelineLayoutInfo, nullptr, &m_pipelineLayout) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create pipeline layout!");
+		}
+
+		// Phase 1 draw commands start after MAX_GAME_OBJECTS phase 0 ones (see getDrawCommandOffset)
+		SpecializationConstants constants;
+		constants.set(0, MAX_GAME_OBJECTS);
+
+		m_pipeline = std::make_unique<ComputePipeline>(m_device, m_pipelineLayout, "occlusion_cull.comp.spv", &constants);
+	}
+
+	VkDeviceSize OcclusionCuller::getDrawCommandOffset(CullPhase phase, uint32 packetIndex) const {
+		uint32 commandIndex = static_cast<uint32>(phase) * MAX_GAME_OBJECTS + packetIndex;
+		return static_cast<VkDeviceSize>(commandIndex) * sizeof(VkDrawIndexedIndirectCommand);
+	}
+
+	void OcclusionCuller::prepare(FrameInfo& frameInfo) {
+		assert(frameInfo.renderQueue != nullptr && "OcclusionCuller needs a render queue");
+
+		// Swapchain was recreated: the pyramid has to match the new depth attachments
+		// The previous pyramid is destroyed once the frames in flight sampling it are finished
+		if (m_swapChainGeneration != m_renderer.getSwapChainGeneration()) {
+			std::vector<VkImageView> depthImageViews(m_renderer.getSwapChainImageCount());
+			for (size_t i = 0; i < depthImageViews.size(); i++)
+				depthImageViews[i] = m_renderer.getDepthImageView(static_cast<int>(i));
+
+			m_hiZBuffer.resize(m_renderer.getSwapChainExtent(), depthImageViews);
+
+			m_swapChainGeneration = m_renderer.getSwapChainGeneration();
+		}
+
+		// The sets of other frames may still be in use, each one is only pointed to the new pyramid when its frame comes again
+		if (m_setGenerations[frameInfo.frameIndex] != m_swapChainGeneration) {
+			VkDescriptorImageInfo hiZInfo{};
+			hiZInfo.sampler = m_hiZBuffer.getSampler();
+			hiZInfo.imageView = m_hiZBuffer.getImageView();
+			hiZInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+			DescriptorWriter(*m_setLayout, *m_descriptorPool).writeImage(4, &hiZInfo).overwrite(m_descriptorSets[frameInfo.frameIndex]);
+			m_setGenerations[frameInfo.frameIndex] = m_swapChainGeneration;
+		}
+
+		// The fence of this frame was waited on in beginFrame, so the GPU is done with this frame's buffers
+		CullingStats* stats = static_cast<CullingStats*>(m_statsBuffers[frameInfo.frameIndex]->getMappedMemory());
+		m_stats = *stats;
+		*stats = CullingStats{};
+
+		const RenderQueue& renderQueue = *frameInfo.renderQueue;
+		assert(renderQueue.size() <= MAX_GAME_OBJECTS && "Render queue does not fit in the culling buffers");
+
+		CullObject* objects = static_cast<CullObject*>(m_objectBuffers[frameInfo.frameIndex]->getMappedMemory());
+		VkDrawIndexedIndirectCommand* drawCommands = static_cast<VkDrawIndexedIndirectCommand*>(m_drawCommandBuffers[frameInfo.frameIndex]->getMappedMemory());
+
+		m_objectCount = 0;
+		for (const DrawPacket& packet : renderQueue) {
+			CullObject& object = objects[m_objectCount];
+			getWorldBounds(packet.object->m_transform.mat4(), packet.model->getBoundsMin(), packet.model->getBoundsMax(), object.boundsMin, object.boundsMax);
+			object.objectID = packet.object->getObjectID();
+			object.padding = 0;
+
+			assert(object.objectID < MAX_GAME_OBJECTS && "Object ID does not fit in the visibility buffer");
+
+			// instanceCount is written by the culling shader. The packet index points the draw to its object data
+			VkDrawIndexedIndirectCommand command = packet.model->getDrawCommand(m_objectCount);
+			command.instanceCount = 0;
+			drawCommands[m_objectCount] = command;
+			drawCommands[MAX_GAME_OBJECTS + m_objectCount] = command;
+
+			m_objectCount++;
+		}
+	}
+
+	void OcclusionCuller::cullPreviouslyVisible(FrameInfo& frameInfo) {
+		dispatch(frameInfo, CullPhase::PreviouslyVisible);
+	}
+
+	void OcclusionCuller::buildHiZ(FrameInfo& frameInfo) {
+		m_hiZBuffer.build(frameInfo.commandBuffer, m_renderer.getImageIndex());
+	}
+
+	void OcclusionCuller::cullNewlyVisible(FrameInfo& frameInfo) {
+		dispatch(frameInfo, CullPhase::NewlyVisible);
+	}
+
+	void OcclusionCuller::dispatch(FrameInfo& frameInfo, CullPhase phase) {
+		if (m_objectCount == 0)
+			return;
+
+		VkCommandBuffer commandBuffer = frameInfo.commandBuffer;
+
+		m_pipeline->bind(commandBuffer);
+
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descriptorSets[frameInfo.frameIndex], 0, nullptr);
+
+		CullPushConstantData push{};
+		push.viewProjMat = frameInfo.camera.getProjection() * frameInfo.camera.getView();
+		push.objectCount = m_objectCount;
+		push.phase = static_cast<uint32>(phase);
+
+		vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPushConstantData), &push);
+
+		vkCmdDispatch(commandBuffer, (m_objectCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+	}
+}
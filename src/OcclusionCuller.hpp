@@ -0,0 +1,86 @@
+#pragma once
+
+#include "Buffer.hpp"
+#include "Descriptors.hpp"
+#include "Device.hpp"
+#include "FrameInfo.hpp"
+#include "HiZBuffer.hpp"
+#include "Pipeline.hpp"
+#include "Renderer.hpp"
+
+namespace OmniV {
+
+	// Objects that were not drawn at all this frame. Values are read back with as many frames of latency as there are frames in flight
+	struct CullingStats {
+		uint32 drawn = 0;
+		uint32 frustumCulled = 0;
+		uint32 occlusionCulled = 0;
+	};
+
+	/// <summary>
+	/// <para> GPU occlusion culling of the render queue, two-phase style: </para>
+	/// <para> 1. cullPreviouslyVisible(): the draws of the objects that were visible last frame are enabled, and drawn in a first main pass </para>
+	/// <para> 2. buildHiZ() then cullNewlyVisible(): the Hi-Z pyramid is built from that pass' depth, and every object is tested against it.
+	/// Objects that became visible are drawn in a second main pass that loads the first one </para>
+	/// <para> Draws go through indirect commands (one per render queue packet) whose instanceCount is written by the culling shader </para>
+	/// <para> Each step is a render graph pass of its own: no barrier is recorded here, the graph derives them from the buffers each step
+	/// declares (getVisibilityBuffer, getDrawCommandBuffer, getStatsBuffer, getHiZImage) </para>
+	/// </summary>
+	class OcclusionCuller {
+	public:
+		OcclusionCuller(Device& device, Renderer& renderer);
+		~OcclusionCuller();
+
+		OcclusionCuller(const OcclusionCuller&) = delete;
+		OcclusionCuller& operator=(const OcclusionCuller&) = delete;
+
+		// Uploads the bounds of the render queue and resets the draw commands, on the CPU. Has to be called before recording the frame
+		void prepare(FrameInfo& frameInfo);
+
+		// Enables last frame's visible set. Has to be recorded before the First main pass
+		void cullPreviouslyVisible(FrameInfo& frameInfo);
+
+		// Builds the Hi-Z from the First main pass' depth, then tests every object. Have to be recorded between the First and Last main passes
+		void buildHiZ(FrameInfo& frameInfo);
+		void cullNewlyVisible(FrameInfo& frameInfo);
+
+		VkBuffer getVisibilityBuffer() const { return m_visibilityBuffer->getBuffer(); } // Written by cullNewlyVisible, read by the next frame
+		VkBuffer getDrawCommandBuffer(int frameIndex) const { return m_drawCommandBuffers[frameIndex]->getBuffer(); }
+		VkBuffer getStatsBuffer(int frameIndex) const { return m_statsBuffers[frameIndex]->getBuffer(); } // Read back by the CPU
+		VkImage getHiZImage() const { return m_hiZBuffer.getImage(); } // Always in VK_IMAGE_LAYOUT_GENERAL
+		VkDeviceSize getDrawCommandOffset(CullPhase phase, uint32 packetIndex) const;
+
+		const CullingStats& getStats() const { return m_stats; }
+
+	private:
+		void createBuffers();
+		void createDescriptorSets();
+		void createPipeline();
+
+		void dispatch(FrameInfo& frameInfo, CullPhase phase);
+
+		Device& m_device;
+		Renderer& m_renderer;
+
+		HiZBuffer m_hiZBuffer;
+		uint32_t m_swapChainGeneration = 0;
+
+		std::unique_ptr<Buffer> m_visibilityBuffer; // Indexed by object ID, only accessed by the GPU
+
+		// One per frame in flight
+		std::vector<std::unique_ptr<Buffer>> m_objectBuffers;
+		std::vector<std::unique_ptr<Buffer>> m_drawCommandBuffers;
+		std::vector<std::unique_ptr<Buffer>> m_statsBuffers;
+
+		std::unique_ptr<DescriptorSetLayout> m_setLayout;
+		std::unique_ptr<DescriptorPool> m_descriptorPool;
+		std::vector<VkDescriptorSet> m_descriptorSets;
+		std::vector<uint32_t> m_setGenerations; // Swapchain generation of the pyramid each set points to
+
+		VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+		std::unique_ptr<ComputePipeline> m_pipeline;
+
+		uint32 m_objectCount = 0;
+		CullingStats m_stats;
+	};
+}
@@ -1,6 +1,8 @@
 #include "common.hpp"
 #include "Pipeline.hpp"
 #include "Model.hpp"
+#include "IdAllocator.hpp"
+#include "RenderQueue.hpp"
 
 // std
 #include <cassert>
@@ -8,15 +10,30 @@
 
 namespace OmniV {
 
+	// IDs of the live pipelines, dense enough to fit in the pipeline field of the render queue's sort key
+	static IdAllocator& getPipelineIDs() {
+		static IdAllocator pipelineIDs{ 1u << RenderQueue::PIPELINE_BITS, "pipeline" };
+		return pipelineIDs;
+	}
+
 	Pipeline::Pipeline(Device& device, const PipelineConfigInfo& configInfo, const std::string& vertFilepath, const std::string& fragFilepath)
 		: m_device{ device } {
 		createGraphicsPipeline(configInfo, vertFilepath, fragFilepath);
+
+		// Last, so that a constructor that throws doesn't leak its ID
+		m_pipelineID = getPipelineIDs().allocate();
 	}
 
 	Pipeline::~Pipeline() {
-		vkDestroyShaderModule(m_device.device(), m_vertShaderModule, nullptr);
-		vkDestroyShaderModule(m_device.device(), m_fragShaderModule, nullptr);
-		vkDestroyPipeline(m_device.device(), m_graphicsPipeline, nullptr);
+		getPipelineIDs().release(m_pipelineID);
+
+		// Frames in flight may still be bound to it
+		m_device.deferDestruction([device = m_device.device(), vertShaderModule = m_vertShaderModule, fragShaderModule = m_fragShaderModule,
+			pipeline = m_graphicsPipeline]() {
+			vkDestroyShaderModule(device, vertShaderModule, nullptr);
+			vkDestroyShaderModule(device, fragShaderModule, nullptr);
+			vkDestroyPipeline(device, pipeline, nullptr);
+		});
 	}
 
 	std::vector<char> Pipeline::readFile(const std::string& filename) {
@@ -56,16 +73,17 @@ namespace OmniV {
 		shaderStages[0].pName = "main";
 		shaderStages[0].flags = 0;
 		shaderStages[0].pNext = nullptr;
-		shaderStages[0].pSpecializationInfo = nullptr;
+		shaderStages[0].pSpecializationInfo = configInfo.vertSpecializationInfo;
 
-		if (configInfo.stagesCount == 2)
+		if (configInfo.stagesCount == 2) {
 			shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 			shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
 			shaderStages[1].module = m_fragShaderModule;
 			shaderStages[1].pName = "main";
 			shaderStages[1].flags = 0;
 			shaderStages[1].pNext = nullptr;
-			shaderStages[1].pSpecializationInfo = nullptr;
+			shaderStages[1].pSpecializationInfo = configInfo.fragSpecializationInfo;
+		}
 
 		auto& bindingDescriptions = configInfo.bindingDescriptions;
 		auto& attributeDescriptions = configInfo.attributeDescriptions;
@@ -122,6 +140,122 @@ namespace OmniV {
 		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
 	}
 
+	// *************** Pipeline Permutations *********************
+
+	SpecializationConstants& SpecializationConstants::set(uint32_t constantID, uint32_t value) {
+		auto it = std::lower_bound(m_entries.begin(), m_entries.end(), constantID,
+			[](const VkSpecializationMapEntry& entry, uint32_t id) { return entry.constantID < id; });
+
+		size_t index = it - m_entries.begin();
+		if (it != m_entries.end() && it->constantID == constantID) {
+			m_data[index] = value;
+			return *this;
+		}
+
+		m_entries.insert(it, { constantID, 0, sizeof(uint32_t) });
+		m_data.insert(m_data.begin() + index, value);
+
+		// Offsets follow the sorted order
+		for (size_t i = 0; i < m_entries.size(); i++)
+			m_entries[i].offset = static_cast<uint32_t>(i * sizeof(uint32_t));
+
+		return *this;
+	}
+
+	VkSpecializationInfo SpecializationConstants::getInfo() const {
+		VkSpecializationInfo info{};
+		info.mapEntryCount = static_cast<uint32_t>(m_entries.size());
+		info.pMapEntries = m_entries.data();
+		info.dataSize = m_data.size() * sizeof(uint32_t);
+		info.pData = m_data.data();
+		return info;
+	}
+
+	void SpecializationConstants::appendKey(std::vector<uint32_t>& key) const {
+		key.push_back(static_cast<uint32_t>(m_entries.size()));
+		for (size_t i = 0; i < m_entries.size(); i++) {
+			key.push_back(m_entries[i].constantID);
+			key.push_back(m_data[i]);
+		}
+	}
+
+	PipelinePermutations::PipelinePermutations(Device& device, const std::string& vertFilepath, const std::string& fragFilepath)
+		: m_device{ device }, m_vertFilepath{ vertFilepath }, m_fragFilepath{ fragFilepath } {
+		Pipeline::defaultPipelineConfigInfo(m_configInfo);
+	}
+
+	Pipeline& PipelinePermutations::get(const SpecializationConstants& vertConstants, const SpecializationConstants& fragConstants) {
+		m_key.clear();
+		vertConstants.appendKey(m_key);
+		fragConstants.appendKey(m_key);
+
+		auto it = m_permutations.find(m_key);
+		if (it != m_permutations.end())
+			return *it->second;
+
+		VkSpecializationInfo vertInfo = vertConstants.getInfo();
+		VkSpecializationInfo fragInfo = fragConstants.getInfo();
+		m_configInfo.vertSpecializationInfo = vertConstants.empty() ? nullptr : &vertInfo;
+		m_configInfo.fragSpecializationInfo = fragConstants.empty() ? nullptr : &fragInfo;
+
+		auto pipeline = std::make_unique<Pipeline>(m_device, m_configInfo, m_vertFilepath, m_fragFilepath);
+
+		m_configInfo.vertSpecializationInfo = nullptr;
+		m_configInfo.fragSpecializationInfo = nullptr;
+
+		OV_DEBUG_LOG("Created permutation " << m_permutations.size() << " of " << m_vertFilepath << " / " << m_fragFilepath);
+
+		return *m_permutations.emplace(m_key, std::move(pipeline)).first->second;
+	}
+
+	// *************** Compute Pipeline *********************
+
+	ComputePipeline::ComputePipeline(Device& device, VkPipelineLayout pipelineLayout, const std::string& compFilepath, const SpecializationConstants* constants)
+		: m_device{ device } {
+		assert(pipelineLayout != VK_NULL_HANDLE && "Cannot create compute pipeline: no pipelineLayout provided");
+
+		std::vector<char> code = Pipeline::readFile("shaders/" + compFilepath);
+
+		VkShaderModuleCreateInfo moduleInfo{};
+		moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+		moduleInfo.codeSize = code.size();
+		moduleInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+		if (vkCreateShaderModule(m_device.device(), &moduleInfo, nullptr, &m_compShaderModule) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create shader module");
+		}
+
+		VkComputePipelineCreateInfo pipelineInfo{};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipelineInfo.stage.module = m_compShaderModule;
+		pipelineInfo.stage.pName = "main";
+		VkSpecializationInfo specializationInfo{};
+		if (constants != nullptr && !constants->empty())
+			specializationInfo = constants->getInfo();
+
+		pipelineInfo.stage.pSpecializationInfo = specializationInfo.mapEntryCount > 0 ? &specializationInfo : nullptr;
+		pipelineInfo.layout = pipelineLayout;
+		pipelineInfo.basePipelineIndex = -1;
+		pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+		if (vkCreateComputePipelines(m_device.device(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_computePipeline) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create compute pipeline");
+		}
+	}
+
+	ComputePipeline::~ComputePipeline() {
+		m_device.deferDestruction([device = m_device.device(), compShaderModule = m_compShaderModule, pipeline = m_computePipeline]() {
+			vkDestroyShaderModule(device, compShaderModule, nullptr);
+			vkDestroyPipeline(device, pipeline, nullptr);
+		});
+	}
+
+	void ComputePipeline::bind(VkCommandBuffer commandBuffer) {
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_computePipeline);
+	}
+
 	void Pipeline::defaultPipelineConfigInfo(PipelineConfigInfo& configInfo) {
 		configInfo.inputAssemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
 		configInfo.inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
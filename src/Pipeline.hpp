@@ -21,6 +21,8 @@ namespace OmniV {
 		VkPipelineDepthStencilStateCreateInfo depthStencilInfo;
 		std::vector<VkDynamicState> dynamicStateEnables;
 		VkPipelineDynamicStateCreateInfo dynamicStateInfo;
+		const VkSpecializationInfo* vertSpecializationInfo = nullptr; // Specialization constants of the vertex stage, if any
+		const VkSpecializationInfo* fragSpecializationInfo = nullptr; // Specialization constants of the fragment stage, if any
 		VkPipelineLayout pipelineLayout = nullptr;
 		VkRenderPass renderPass = nullptr;
 		uint32_t subpass = 0;
@@ -37,19 +39,90 @@ namespace OmniV {
 
 		void bind(VkCommandBuffer commandBuffer);
 
+		uint32_t getPipelineID() const { return m_pipelineID; }
+
 		static void defaultPipelineConfigInfo(PipelineConfigInfo& configInfo);
 		static void enableAlphaBlending(PipelineConfigInfo& configInfo);
 
-	private:
 		static std::vector<char> readFile(const std::string& filename);
 
+	private:
+
 		void createGraphicsPipeline(const PipelineConfigInfo& configInfo, const std::string& vertFilepath, const std::string& fragFilepath);
 
 		void createShaderModule(const std::vector<char>& code, VkShaderModule* shaderModule);
 
 		Device& m_device;
+		uint32_t m_pipelineID;
 		VkPipeline m_graphicsPipeline;
 		VkShaderModule m_vertShaderModule = VK_NULL_HANDLE;
 		VkShaderModule m_fragShaderModule = VK_NULL_HANDLE;
 	};
+
+	// Specialization constant values of one shader stage. Only 32 bit constants (uint, int, float bits, bool)
+	class SpecializationConstants {
+	public:
+		// Adds or replaces the value of "constantID"
+		SpecializationConstants& set(uint32_t constantID, uint32_t value);
+
+		bool empty() const { return m_entries.empty(); }
+
+		// Points into this object, valid as long as it isn't modified
+		VkSpecializationInfo getInfo() const;
+
+		// Appends the id/value pairs to "key", identifying the permutation
+		void appendKey(std::vector<uint32_t>& key) const;
+
+	private:
+		std::vector<VkSpecializationMapEntry> m_entries; // Sorted by constant id
+		std::vector<uint32_t> m_data;
+	};
+
+	/// <summary>
+	/// <para> Variants of a pipeline which only differ by their specialization constants, created the first time they are requested.
+	/// Requesting them during a frame stalls it on the compilation, so render systems request the permutations they can use when created </para>
+	/// <para> Lets shaders compile out uniform branches (features a scene doesn't use) without writing one pipeline per combination.
+	/// Permutations are keyed by their constant values, so asking again for the same values returns the same pipeline </para>
+	/// </summary>
+	class PipelinePermutations {
+	public:
+		PipelinePermutations(Device& device, const std::string& vertFilepath, const std::string& fragFilepath = "");
+
+		PipelinePermutations(const PipelinePermutations&) = delete;
+		PipelinePermutations& operator=(const PipelinePermutations&) = delete;
+
+		// Shared by every permutation, must be filled before the first get(). Its specialization infos are overwritten
+		PipelineConfigInfo& getConfigInfo() { return m_configInfo; }
+
+		Pipeline& get(const SpecializationConstants& vertConstants, const SpecializationConstants& fragConstants);
+
+		size_t size() const { return m_permutations.size(); }
+
+	private:
+		Device& m_device;
+		PipelineConfigInfo m_configInfo;
+		std::string m_vertFilepath;
+		std::string m_fragFilepath;
+
+		std::map<std::vector<uint32_t>, std::unique_ptr<Pipeline>> m_permutations;
+		std::vector<uint32_t> m_key; // Scratch, avoids an allocation per lookup
+	};
+
+	// Single stage pipeline for compute dispatches. The layout is owned by whoever creates the pipeline, same as with graphics pipelines
+	class ComputePipeline {
+	public:
+		ComputePipeline(Device& device, VkPipelineLayout pipelineLayout, const std::string& compFilepath, const SpecializationConstants* constants = nullptr);
+
+		~ComputePipeline();
+
+		ComputePipeline(const ComputePipeline&) = delete;
+		ComputePipeline operator=(const ComputePipeline&) = delete;
+
+		void bind(VkCommandBuffer commandBuffer);
+
+	private:
+		Device& m_device;
+		VkPipeline m_computePipeline;
+		VkShaderModule m_compShaderModule = VK_NULL_HANDLE;
+	};
 }
\ No newline at end of file
@@ -0,0 +1,477 @@
+#include "RenderGraph.hpp"
+
+// std
+#include <cassert>
+#include <numeric>
+
+namespace OmniV {
+
+	static constexpr VkAccessFlags WRITE_ACCESS = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
+		| VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+	void RenderGraph::PassBuilder::read(RenderResource resource, const ResourceUsage& usage) {
+		assert(resource < m_graph.m_resources.size() && "Unknown render graph resource");
+		m_graph.m_passes[m_passIndex].accesses.push_back({ resource, usage, false });
+	}
+
+	void RenderGraph::PassBuilder::write(RenderResource resource, const ResourceUsage& usage) {
+		assert(resource < m_graph.m_resources.size() && "Unknown render graph resource");
+		m_graph.m_passes[m_passIndex].accesses.push_back({ resource, usage, true });
+	}
+
+	void RenderGraph::PassBuilder::setSideEffects() {
+		m_graph.m_passes[m_passIndex].hasSideEffects = true;
+	}
+
+	void RenderGraph::Barrier::record(VkCommandBuffer commandBuffer) const {
+		const bool hasMemoryBarrier = memoryBarrier.srcAccessMask != 0 || memoryBarrier.dstAccessMask != 0;
+
+		vkCmdPipelineBarrier(commandBuffer, srcStages != 0 ? srcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStages != 0 ? dstStages : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+			hasMemoryBarrier ? 1 : 0, &memoryBarrier, 0, nullptr, static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+	}
+
+	RenderGraph::RenderGraph(Device& device) : m_device{ device } {}
+
+	RenderGraph::~RenderGraph() {
+		destroyTransients();
+	}
+
+	void RenderGraph::reset() {
+		m_passes.clear();
+		m_resources.clear();
+		m_transientCount = 0;
+		m_finalBarrier = Barrier{};
+		m_isCompiled = false;
+	}
+
+	RenderResource RenderGraph::importImage(const char* name, VkImage image, VkImageAspectFlags aspect, const ResourceUsage& lastUsage) {
+		Resource resource{ name, false };
+		resource.image = image;
+		resource.aspect = aspect;
+		resource.lastUsage = lastUsage;
+
+		m_resources.push_back(resource);
+		return static_cast<RenderResource>(m_resources.size() - 1);
+	}
+
+	RenderResource RenderGraph::importBuffer(const char* name, VkBuffer buffer, const ResourceUsage& lastUsage) {
+		Resource resource{ name, true };
+		resource.buffer = buffer;
+		resource.lastUsage = lastUsage;
+
+		m_resources.push_back(resource);
+		return static_cast<RenderResource>(m_resources.size() - 1);
+	}
+
+	RenderResource RenderGraph::createImage(const char* name, const TransientImageDesc& desc) {
+		assert(desc.extent.width > 0 && desc.extent.height > 0 && "Transient images can't be empty");
+
+		Resource resource{ name, false };
+		resource.aspect = desc.aspect;
+		resource.desc = desc;
+		resource.transientIndex = m_transientCount++;
+
+		m_resources.push_back(resource);
+		return static_cast<RenderResource>(m_resources.size() - 1);
+	}
+
+	void RenderGraph::markOutput(RenderResource resource, const ResourceUsage& finalUsage) {
+		assert(resource < m_resources.size() && "Unknown render graph resource");
+
+		m_resources[resource].isOutput = true;
+		m_resources[resource].finalUsage = finalUsage;
+	}
+
+	void RenderGraph::addPass(const char* name, const SetupFunction& setup, RecordFunction record) {
+		assert(!m_isCompiled && "Passes can't be added to a compiled render graph");
+
+		Pass pass{};
+		pass.name = name;
+		pass.record = std::move(record);
+		m_passes.push_back(std::move(pass));
+
+		PassBuilder builder{ *this, static_cast<uint32>(m_passes.size() - 1) };
+		setup(builder);
+	}
+
+	void RenderGraph::compile() {
+		assert(!m_isCompiled && "Render graph compiled twice, reset() it first");
+
+		cullPasses();
+
+		// Lifetimes of the transient images, as indices of the passes using them
+		std::vector<TransientSlot> slots(m_transientCount, TransientSlot{ {}, ~0u, 0 });
+		for (const Resource& resource : m_resources)
+			if (resource.transientIndex != NOT_TRANSIENT)
+				slots[resource.transientIndex].desc = resource.desc;
+
+		for (uint32 passIndex = 0; passIndex < m_passes.size(); passIndex++) {
+			if (m_passes[passIndex].isCulled)
+				continue;
+
+			for (const Access& access : m_passes[passIndex].accesses) {
+				uint32 transientIndex = m_resources[access.resource].transientIndex;
+				if (transientIndex == NOT_TRANSIENT)
+					continue;
+
+				slots[transientIndex].firstPass = std::min(slots[transientIndex].firstPass, passIndex);
+				slots[transientIndex].lastPass = std::max(slots[transientIndex].lastPass, passIndex);
+			}
+		}
+
+		if (slots != m_allocatedSlots)
+			allocateTransients(slots);
+
+		// Imported resources start from their last usage, transient ones from nothing
+		std::vector<ResourceState> states(m_resources.size());
+		for (size_t i = 0; i < m_resources.size(); i++) {
+			const Resource& resource = m_resources[i];
+			if (resource.transientIndex != NOT_TRANSIENT)
+				continue;
+
+			const ResourceUsage& lastUsage = resource.lastUsage;
+			ResourceState& state = states[i];
+			state.layout = lastUsage.finalLayout != VK_IMAGE_LAYOUT_UNDEFINED ? lastUsage.finalLayout : lastUsage.layout;
+
+			if ((lastUsage.access & WRITE_ACCESS) != 0 && !lastUsage.internallySynchronized) {
+				state.writeStages = lastUsage.stages;
+				state.writeAccess = lastUsage.access & WRITE_ACCESS;
+			}
+			else if (!lastUsage.internallySynchronized) {
+				state.readStages = lastUsage.stages;
+			}
+		}
+
+		// Everything a transient image was used for in the frame, handed over to the next image of its memory block
+		std::vector<VkPipelineStageFlags> transientStages(m_transientCount, 0);
+		std::vector<VkAccessFlags> transientWriteAccess(m_transientCount, 0);
+
+		m_stats.passes = 0;
+		m_stats.culledPasses = 0;
+		m_stats.barriers = 0;
+		m_stats.imageBarriers = 0;
+
+		for (uint32 passIndex = 0; passIndex < m_passes.size(); passIndex++) {
+			Pass& pass = m_passes[passIndex];
+			pass.barrier = Barrier{};
+
+			if (pass.isCulled) {
+				m_stats.culledPasses++;
+				continue;
+			}
+
+			for (const Access& access : pass.accesses) {
+				uint32 transientIndex = m_resources[access.resource].transientIndex;
+				if (transientIndex != NOT_TRANSIENT) {
+					if (slots[transientIndex].firstPass == passIndex && transientStages[transientIndex] == 0)
+						addAliasingBarrier(pass.barrier, transientIndex, access.usage);
+
+					transientStages[transientIndex] |= access.usage.stages;
+					transientWriteAccess[transientIndex] |= access.usage.access & WRITE_ACCESS;
+				}
+
+				addBarrier(pass.barrier, access.resource, states[access.resource], access.usage);
+			}
+
+			// Transient images used for the last time hand their memory block over
+			for (uint32 i = 0; i < m_transientCount; i++) {
+				if (slots[i].lastPass != passIndex || slots[i].firstPass == ~0u)
+					continue;
+
+				MemoryBlock& block = m_memoryBlocks[m_transientImages[i].block];
+				block.lastImage = i;
+				block.lastStages = transientStages[i];
+				block.lastWriteAccess = transientWriteAccess[i];
+			}
+
+			m_stats.passes++;
+			if (!pass.barrier.isEmpty()) {
+				m_stats.barriers++;
+				m_stats.imageBarriers += static_cast<uint32>(pass.barrier.imageBarriers.size());
+			}
+		}
+
+		for (size_t i = 0; i < m_resources.size(); i++)
+			if (m_resources[i].isOutput && m_resources[i].finalUsage.stages != 0)
+				addBarrier(m_finalBarrier, static_cast<RenderResource>(i), states[i], m_resources[i].finalUsage);
+
+		if (!m_finalBarrier.isEmpty()) {
+			m_stats.barriers++;
+			m_stats.imageBarriers += static_cast<uint32>(m_finalBarrier.imageBarriers.size());
+		}
+
+		m_isCompiled = true;
+	}
+
+	void RenderGraph::cullPasses() {
+		// Walking backward from the outputs: a pass is needed if it writes something a needed pass (or the outputs) read
+		std::vector<bool> isNeeded(m_resources.size(), false);
+		for (size_t i = 0; i < m_resources.size(); i++)
+			isNeeded[i] = m_resources[i].isOutput;
+
+		for (auto it = m_passes.rbegin(); it != m_passes.rend(); ++it) {
+			Pass& pass = *it;
+
+			bool isUsed = pass.hasSideEffects;
+			for (const Access& access : pass.accesses)
+				if (access.isWrite && isNeeded[access.resource])
+					isUsed = true;
+
+			pass.isCulled = !isUsed;
+			if (pass.isCulled)
+				continue;
+
+			// Read-modify-write accesses need the previous contents as well
+			for (const Access& access : pass.accesses)
+				if (!access.isWrite || (access.usage.access & ~WRITE_ACCESS) != 0)
+					isNeeded[access.resource] = true;
+		}
+	}
+
+	void RenderGraph::addBarrier(Barrier& barrier, RenderResource resource, ResourceState& state, const ResourceUsage& usage) {
+		const Resource& graphResource = m_resources[resource];
+		const VkImageLayout finalLayout = usage.finalLayout != VK_IMAGE_LAYOUT_UNDEFINED ? usage.finalLayout : usage.layout;
+
+		assert((graphResource.isBuffer || finalLayout != VK_IMAGE_LAYOUT_UNDEFINED) && "Image usage without layout");
+
+		if (usage.internallySynchronized) {
+			state = ResourceState{};
+			state.layout = finalLayout;
+			return;
+		}
+
+		const bool isWrite = (usage.access & WRITE_ACCESS) != 0;
+		const bool needsTransition = !graphResource.isBuffer && usage.layout != VK_IMAGE_LAYOUT_UNDEFINED && usage.layout != state.layout;
+		const bool readAfterWrite = state.writeStages != 0 && (usage.stages & ~state.visibleStages) != 0;
+		const bool writeAfterRead = (isWrite || needsTransition) && state.readStages != 0;
+
+		if (needsTransition || readAfterWrite || writeAfterRead) {
+			VkPipelineStageFlags srcStages = state.writeStages;
+			if (isWrite || needsTransition)
+				srcStages |= state.readStages;
+
+			barrier.srcStages |= srcStages;
+			barrier.dstStages |= usage.stages;
+
+			if (needsTransition) {
+				VkImageMemoryBarrier imageBarrier{};
+				imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+				imageBarrier.oldLayout = state.layout;
+				imageBarrier.newLayout = usage.layout;
+				imageBarrier.srcAccessMask = state.writeAccess;
+				imageBarrier.dstAccessMask = usage.access;
+				imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				imageBarrier.image = getImage(resource);
+				imageBarrier.subresourceRange = { graphResource.aspect, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS };
+				barrier.imageBarriers.push_back(imageBarrier);
+			}
+			else {
+				barrier.memoryBarrier.srcAccessMask |= state.writeAccess;
+				barrier.memoryBarrier.dstAccessMask |= usage.access;
+			}
+		}
+
+		if (isWrite || needsTransition) {
+			// A layout transition is a write of its own, made visible to the stages of its barrier
+			state.writeStages = usage.stages;
+			state.writeAccess = usage.access & WRITE_ACCESS;
+			state.visibleStages = isWrite ? 0 : usage.stages;
+			state.readStages = isWrite ? 0 : usage.stages;
+		}
+		else {
+			if (readAfterWrite)
+				state.visibleStages |= usage.stages;
+			state.readStages |= usage.stages;
+		}
+
+		if (!graphResource.isBuffer)
+			state.layout = finalLayout;
+	}
+
+	void RenderGraph::addAliasingBarrier(Barrier& barrier, uint32 transientIndex, const ResourceUsage& usage) {
+		const MemoryBlock& block = m_memoryBlocks[m_transientImages[transientIndex].block];
+
+		// Fresh memory, or the same image as last frame within a render pass that orders its own reuse
+		if (block.lastImage == NOT_TRANSIENT || (block.lastImage == transientIndex && usage.internallySynchronized))
+			return;
+
+		barrier.srcStages |= block.lastStages;
+		barrier.dstStages |= usage.stages;
+		barrier.memoryBarrier.srcAccessMask |= block.lastWriteAccess;
+		barrier.memoryBarrier.dstAccessMask |= usage.access;
+	}
+
+	void RenderGraph::allocateTransients(const std::vector<TransientSlot>& slots) {
+		// Previous frames may still be using the current images, the device destroys them once they are finished
+		destroyTransients();
+
+		m_transientImages.resize(slots.size());
+		std::vector<VkMemoryRequirements> requirements(slots.size());
+
+		for (size_t i = 0; i < slots.size(); i++) {
+			const TransientImageDesc& desc = slots[i].desc;
+
+			VkImageCreateInfo imageInfo{};
+			imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+			imageInfo.imageType = VK_IMAGE_TYPE_2D;
+			imageInfo.extent.width = desc.extent.width;
+			imageInfo.extent.height = desc.extent.height;
+			imageInfo.extent.depth = 1;
+			imageInfo.mipLevels = 1;
+			imageInfo.arrayLayers = 1;
+			imageInfo.format = desc.format;
+			imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			imageInfo.usage = desc.usage;
+			imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+			imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			imageInfo.flags = 0;
+
+			if (vkCreateImage(m_device.device(), &imageInfo, nullptr, &m_transientImages[i].image) != VK_SUCCESS) {
+				throw std::runtime_error("failed to create transient image!");
+			}
+
+			vkGetImageMemoryRequirements(m_device.device(), m_transientImages[i].image, &requirements[i]);
+		}
+
+		// In order of first use, each image goes into the first block that is no longer used by then and has a compatible memory type
+		std::vector<uint32> order(slots.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(), [&slots](uint32 a, uint32 b) { return slots[a].firstPass < slots[b].firstPass; });
+
+		VkDeviceSize requiredBytes = 0;
+		for (uint32 i : order) {
+			const TransientSlot& slot = slots[i];
+			const VkMemoryRequirements& imageRequirements = requirements[i];
+			requiredBytes += imageRequirements.size;
+
+			uint32 blockIndex = 0;
+			while (blockIndex < m_memoryBlocks.size()) {
+				const MemoryBlock& block = m_memoryBlocks[blockIndex];
+				if (block.lastPass < slot.firstPass && (block.memoryTypeBits & imageRequirements.memoryTypeBits) != 0)
+					break;
+				blockIndex++;
+			}
+
+			if (blockIndex == m_memoryBlocks.size())
+				m_memoryBlocks.emplace_back();
+
+			// Images are all bound at offset 0, which satisfies any alignment
+			MemoryBlock& block = m_memoryBlocks[blockIndex];
+			block.size = std::max(block.size, imageRequirements.size);
+			block.memoryTypeBits &= imageRequirements.memoryTypeBits;
+			block.lastPass = std::max(block.lastPass, slot.lastPass);
+
+			m_transientImages[i].block = blockIndex;
+		}
+
+		m_stats.transientBytes = 0;
+		for (MemoryBlock& block : m_memoryBlocks) {
+			VkMemoryAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+			allocInfo.allocationSize = block.size;
+			allocInfo.memoryTypeIndex = m_device.findMemoryType(block.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+			if (vkAllocateMemory(m_device.device(), &allocInfo, nullptr, &block.memory) != VK_SUCCESS) {
+				throw std::runtime_error("failed to allocate transient image memory!");
+			}
+
+			m_stats.transientBytes += block.size;
+		}
+
+		m_stats.aliasedBytes = requiredBytes - m_stats.transientBytes;
+
+		for (size_t i = 0; i < slots.size(); i++) {
+			TransientImage& transientImage = m_transientImages[i];
+
+			if (vkBindImageMemory(m_device.device(), transientImage.image, m_memoryBlocks[transientImage.block].memory, 0) != VK_SUCCESS) {
+				throw std::runtime_error("failed to bind transient image memory!");
+			}
+
+			VkImageViewCreateInfo viewInfo{};
+			viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			viewInfo.image = transientImage.image;
+			viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			viewInfo.format = slots[i].desc.format;
+			viewInfo.subresourceRange = { slots[i].desc.aspect, 0, 1, 0, 1 };
+
+			if (vkCreateImageView(m_device.device(), &viewInfo, nullptr, &transientImage.imageView) != VK_SUCCESS) {
+				throw std::runtime_error("failed to create transient image view!");
+			}
+		}
+
+		m_allocatedSlots = slots;
+	}
+
+	void RenderGraph::destroyTransients() {
+		std::vector<VkImageView> imageViews;
+		std::vector<VkImage> images;
+		for (TransientImage& transientImage : m_transientImages) {
+			imageViews.push_back(transientImage.imageView);
+			images.push_back(transientImage.image);
+		}
+		m_transientImages.clear();
+
+		std::vector<VkDeviceMemory> memories;
+		for (MemoryBlock& block : m_memoryBlocks)
+			memories.push_back(block.memory);
+		m_memoryBlocks.clear();
+
+		m_device.deferDestruction([device = m_device.device(), imageViews = std::move(imageViews), images = std::move(images), memories = std::move(memories)]() {
+			for (VkImageView imageView : imageViews)
+				vkDestroyImageView(device, imageView, nullptr);
+			for (VkImage image : images)
+				vkDestroyImage(device, image, nullptr);
+			for (VkDeviceMemory memory : memories)
+				vkFreeMemory(device, memory, nullptr);
+		});
+
+		m_allocatedSlots.clear();
+	}
+
+	VkImage RenderGraph::getImage(RenderResource resource) const {
+		assert(resource < m_resources.size() && "Unknown render graph resource");
+
+		const Resource& graphResource = m_resources[resource];
+		assert(!graphResource.isBuffer && "Render graph resource is not an image");
+
+		if (graphResource.transientIndex == NOT_TRANSIENT)
+			return graphResource.image;
+
+		assert(graphResource.transientIndex < m_transientImages.size() && "Transient images only exist once the render graph is compiled");
+		return m_transientImages[graphResource.transientIndex].image;
+	}
+
+	VkImageView RenderGraph::getImageView(RenderResource resource) const {
+		assert(resource < m_resources.size() && "Unknown render graph resource");
+
+		const Resource& graphResource = m_resources[resource];
+		assert(graphResource.transientIndex != NOT_TRANSIENT && "Only transient images have views owned by the render graph");
+		assert(m_isCompiled && "Transient images only exist once the render graph is compiled");
+
+		return m_transientImages[graphResource.transientIndex].imageView;
+	}
+
+	void RenderGraph::execute(CommandRecorder& recorder) {
+		assert(m_isCompiled && "Render graph must be compiled before being executed");
+
+		for (Pass& pass : m_passes) {
+			if (pass.isCulled)
+				continue;
+
+			if (!pass.barrier.isEmpty()) {
+				const Barrier* barrier = &pass.barrier;
+				recorder.addPrimary([barrier](VkCommandBuffer primary) { barrier->record(primary); });
+			}
+
+			if (pass.record)
+				pass.record(recorder);
+		}
+
+		if (!m_finalBarrier.isEmpty()) {
+			const Barrier* barrier = &m_finalBarrier;
+			recorder.addPrimary([barrier](VkCommandBuffer primary) { barrier->record(primary); });
+		}
+	}
+}
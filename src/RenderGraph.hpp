@@ -0,0 +1,216 @@
+#pragma once
+
+#include "CommandRecorder.hpp"
+#include "Device.hpp"
+
+// std
+#include <functional>
+
+namespace OmniV {
+
+	using RenderResource = uint32; // Resource of a RenderGraph, valid until its next reset()
+
+	// How a pass accesses a resource
+	struct ResourceUsage {
+		VkPipelineStageFlags stages = 0;
+		VkAccessFlags access = 0;
+		VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED; // Images only. UNDEFINED when the pass doesn't need the previous contents
+
+		// Render pass attachments: layout the image is left in once the pass ends. UNDEFINED if the pass keeps "layout"
+		VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		// The pass synchronizes the resource itself, through the dependencies of its render pass or its own barriers
+		// (e.g. per layer transitions of the shadow atlas). The graph records nothing for it and only follows its final layout
+		bool internallySynchronized = false;
+	};
+
+	// Images that only live within a frame
+	struct TransientImageDesc {
+		VkFormat format = VK_FORMAT_UNDEFINED;
+		VkExtent2D extent{ 0, 0 };
+		VkImageUsageFlags usage = 0;
+		VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+
+		bool operator==(const TransientImageDesc& other) const {
+			return format == other.format && extent.width == other.extent.width && extent.height == other.extent.height
+				&& usage == other.usage && aspect == other.aspect;
+		}
+	};
+
+	// Of the last compile()
+	struct RenderGraphStats {
+		uint32 passes = 0; // Executed
+		uint32 culledPasses = 0;
+		uint32 barriers = 0; // vkCmdPipelineBarrier calls
+		uint32 imageBarriers = 0; // Layout transitions
+		VkDeviceSize transientBytes = 0; // Memory allocated for the transient images
+		VkDeviceSize aliasedBytes = 0; // Saved by aliasing, compared to one allocation per transient image
+	};
+
+	/// <summary>
+	/// <para> Frame described as passes declaring the resources they read and write, rebuilt every frame: reset(), import or create the
+	/// resources, add the passes, compile(), then execute() them into a CommandRecorder </para>
+	/// <para> compile() culls the passes whose writes nothing ends up reading (passes with side effects and outputs are kept), then derives
+	/// the barriers between the remaining ones from their declared usages: layout transitions, read after write, and write after read.
+	/// The barriers needed before a pass are merged into a single vkCmdPipelineBarrier </para>
+	/// <para> Passes run in the order they were added, which is a valid order by construction as a pass can only use resources that
+	/// earlier passes produced </para>
+	/// <para> Transient images are owned by the graph. Images whose lifetimes (first to last pass using them) don't overlap share the same
+	/// memory. Their allocations are kept from one frame to the next, and only redone when the transient images or their lifetimes change </para>
+	/// </summary>
+	class RenderGraph {
+	public:
+		class PassBuilder {
+		public:
+			void read(RenderResource resource, const ResourceUsage& usage);
+			void write(RenderResource resource, const ResourceUsage& usage);
+
+			// Kept even if nothing reads what it writes (e.g. readbacks)
+			void setSideEffects();
+
+		private:
+			friend class RenderGraph;
+
+			PassBuilder(RenderGraph& graph, uint32 passIndex) : m_graph{ graph }, m_passIndex{ passIndex } {}
+
+			RenderGraph& m_graph;
+			uint32 m_passIndex;
+		};
+
+		using SetupFunction = std::function<void(PassBuilder&)>;
+		using RecordFunction = std::function<void(CommandRecorder&)>;
+
+		explicit RenderGraph(Device& device);
+		~RenderGraph();
+
+		RenderGraph(const RenderGraph&) = delete;
+		RenderGraph& operator=(const RenderGraph&) = delete;
+
+		// Forgets the passes and resources of the previous frame. Transient allocations are kept for the next compile()
+		void reset();
+
+		// Resources owned outside the graph. "lastUsage" is how they were accessed before the graph runs (previous frame, upload...)
+		RenderResource importImage(const char* name, VkImage image, VkImageAspectFlags aspect, const ResourceUsage& lastUsage = {});
+		RenderResource importBuffer(const char* name, VkBuffer buffer, const ResourceUsage& lastUsage = {});
+
+		RenderResource createImage(const char* name, const TransientImageDesc& desc);
+
+		// Read after the graph: passes producing it are never culled. "finalUsage" is how it will be accessed (e.g. host readback),
+		// its barrier is recorded after the last pass
+		void markOutput(RenderResource resource, const ResourceUsage& finalUsage = {});
+
+		// "setup" declares the resources of the pass right away, "record" adds its commands during execute()
+		void addPass(const char* name, const SetupFunction& setup, RecordFunction record);
+
+		void compile();
+
+		// Transient images exist once compiled
+		VkImage getImage(RenderResource resource) const;
+		VkImageView getImageView(RenderResource resource) const;
+
+		// Barriers and pass commands, in order. The recorder must record the frame before the next reset()
+		void execute(CommandRecorder& recorder);
+
+		const RenderGraphStats& getStats() const { return m_stats; }
+
+	private:
+		struct Access {
+			RenderResource resource;
+			ResourceUsage usage;
+			bool isWrite;
+		};
+
+		struct Barrier {
+			VkPipelineStageFlags srcStages = 0;
+			VkPipelineStageFlags dstStages = 0;
+			VkMemoryBarrier memoryBarrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER }; // Buffers, and images that keep their layout
+			std::vector<VkImageMemoryBarrier> imageBarriers;
+
+			bool isEmpty() const { return srcStages == 0 && dstStages == 0; }
+			void record(VkCommandBuffer commandBuffer) const;
+		};
+
+		struct Pass {
+			const char* name;
+			RecordFunction record;
+			std::vector<Access> accesses;
+			bool hasSideEffects = false;
+			bool isCulled = false;
+			Barrier barrier; // Recorded before the pass
+		};
+
+		struct Resource {
+			const char* name;
+			bool isBuffer;
+			VkImage image = VK_NULL_HANDLE;
+			VkBuffer buffer = VK_NULL_HANDLE;
+			VkImageAspectFlags aspect = 0;
+			ResourceUsage lastUsage;
+			TransientImageDesc desc;
+			uint32 transientIndex = NOT_TRANSIENT;
+			bool isOutput = false;
+			ResourceUsage finalUsage;
+		};
+
+		// Accesses the next barrier has to wait for
+		struct ResourceState {
+			VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			VkPipelineStageFlags writeStages = 0; // Last write, or layout transition
+			VkAccessFlags writeAccess = 0;
+			VkPipelineStageFlags visibleStages = 0; // Stages the last write was already made visible to
+			VkPipelineStageFlags readStages = 0; // Since the last write
+		};
+
+		// Transient image as required by the frame, compared with the allocated ones to know when to reallocate
+		struct TransientSlot {
+			TransientImageDesc desc;
+			uint32 firstPass;
+			uint32 lastPass;
+
+			bool operator==(const TransientSlot& other) const {
+				return desc == other.desc && firstPass == other.firstPass && lastPass == other.lastPass;
+			}
+		};
+
+		struct TransientImage {
+			VkImage image = VK_NULL_HANDLE;
+			VkImageView imageView = VK_NULL_HANDLE;
+			uint32 block;
+		};
+
+		struct MemoryBlock {
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			VkDeviceSize size = 0;
+			uint32 memoryTypeBits = ~0u;
+			uint32 lastPass = 0; // While assigning the images
+
+			// Last transient image that used the block and its accesses, which the next image placed in it has to wait for
+			uint32 lastImage = NOT_TRANSIENT;
+			VkPipelineStageFlags lastStages = 0;
+			VkAccessFlags lastWriteAccess = 0;
+		};
+
+		static constexpr uint32 NOT_TRANSIENT = ~0u;
+
+		void cullPasses();
+		void allocateTransients(const std::vector<TransientSlot>& slots);
+		void destroyTransients();
+		void addBarrier(Barrier& barrier, RenderResource resource, ResourceState& state, const ResourceUsage& usage);
+		void addAliasingBarrier(Barrier& barrier, uint32 transientIndex, const ResourceUsage& usage);
+
+		Device& m_device;
+
+		std::vector<Pass> m_passes;
+		std::vector<Resource> m_resources;
+		uint32 m_transientCount = 0;
+		Barrier m_finalBarrier; // Toward the outputs' final usages
+		bool m_isCompiled = false;
+
+		// Kept across frames
+		std::vector<TransientSlot> m_allocatedSlots;
+		std::vector<TransientImage> m_transientImages;
+		std::vector<MemoryBlock> m_memoryBlocks;
+
+		RenderGraphStats m_stats;
+	};
+}
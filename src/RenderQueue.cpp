@@ -0,0 +1,180 @@
+#include "RenderQueue.hpp"
+#include "Camera.hpp"
+
+// std
+#include <cassert>
+#include <cstring>
+
+namespace OmniV {
+
+	uint64 RenderQueue::makeSortKey(uint32 pipelineID, uint32 materialID, uint32 modelID, uint32 depthBucket) {
+		assert(pipelineID < (1u << PIPELINE_BITS) && "Pipeline ID does not fit in the sort key");
+		assert(materialID < (1u << MATERIAL_BITS) && "Material ID does not fit in the sort key");
+		assert(modelID < (1u << MODEL_BITS) && "Model ID does not fit in the sort key");
+		assert(depthBucket < (1u << DEPTH_BITS) && "Depth bucket does not fit in the sort key");
+
+		return (static_cast<uint64>(pipelineID) << (MATERIAL_BITS + MODEL_BITS + DEPTH_BITS))
+			| (static_cast<uint64>(materialID) << (MODEL_BITS + DEPTH_BITS))
+			| (static_cast<uint64>(modelID) << DEPTH_BITS)
+			| static_cast<uint64>(depthBucket);
+	}
+
+	void RenderQueue::build(GameObject::Map& gameObjects, const Camera& camera, uint32 pipelineID) {
+		m_commandBufferStates.clear();
+
+		// Packets + radix sort scratch + culled flags, so that nothing grows mid-frame
+		m_arena.reset();
+		m_arena.reserve(2 * gameObjects.size() * sizeof(DrawPacket) + gameObjects.size() + alignof(DrawPacket));
+
+		m_packets = m_arena.allocate<DrawPacket>(gameObjects.size());
+		m_packetCount = 0;
+
+		const glm::vec3 camPos = camera.getPosition();
+		const glm::vec3 camForward = camera.getForward();
+		const float maxDepthBucket = static_cast<float>((1u << DEPTH_BITS) - 1);
+
+		for (auto& kv : gameObjects) {
+			auto& obj = kv.second;
+
+			if (obj.m_model == nullptr)
+				continue;
+
+			// Objects behind the camera go to bucket 0, they are most likely culled anyway
+			float viewDepth = glm::dot(obj.m_transform.position - camPos, camForward);
+			float normalizedDepth = glm::clamp(viewDepth / camera.getFar(), 0.0f, 1.0f);
+			uint32 depthBucket = static_cast<uint32>(normalizedDepth * maxDepthBucket);
+
+			// There are no materials yet, every object uses material 0
+			DrawPacket& packet = m_packets[m_packetCount++];
+			packet.sortKey = makeSortKey(pipelineID, 0, obj.m_model->getModelID(), depthBucket);
+			packet.object = &obj;
+			packet.model = obj.m_model.get();
+		}
+
+		DrawPacket* scratch = m_arena.allocate<DrawPacket>(m_packetCount);
+		radixSort(m_packets, scratch, m_packetCount);
+
+		m_culled = m_arena.allocate<uint8>(m_packetCount);
+		memset(m_culled, 0, m_packetCount);
+	}
+
+	// LSD radix sort, 8 bits per pass. Stable, so objects with equal keys keep the order they were submitted in
+	// Passes in which every key has the same byte are skipped, which is the common case for the pipeline and material bytes
+	void RenderQueue::radixSort(DrawPacket* packets, DrawPacket* scratch, uint32 count) {
+		if (count < 2)
+			return;
+
+		constexpr uint32 RADIX_BITS = 8;
+		constexpr uint32 BUCKET_COUNT = 1u << RADIX_BITS;
+		constexpr uint32 PASS_COUNT = 64 / RADIX_BITS;
+
+		// All histograms are built in a single read of the keys
+		uint32 histograms[PASS_COUNT][BUCKET_COUNT];
+		memset(histograms, 0, sizeof(histograms));
+
+		for (uint32 i = 0; i < count; i++) {
+			uint64 key = packets[i].sortKey;
+			for (uint32 pass = 0; pass < PASS_COUNT; pass++)
+				histograms[pass][(key >> (pass * RADIX_BITS)) & (BUCKET_COUNT - 1)]++;
+		}
+
+		DrawPacket* src = packets;
+		DrawPacket* dst = scratch;
+
+		for (uint32 pass = 0; pass < PASS_COUNT; pass++) {
+			uint32* histogram = histograms[pass];
+			uint32 shift = pass * RADIX_BITS;
+
+			// Every key falls in the same bucket, this pass would not change the order
+			if (histogram[(src[0].sortKey >> shift) & (BUCKET_COUNT - 1)] == count)
+				continue;
+
+			// Exclusive prefix sum -> write offsets
+			uint32 offset = 0;
+			for (uint32 b = 0; b < BUCKET_COUNT; b++) {
+				uint32 bucketCount = histogram[b];
+				histogram[b] = offset;
+				offset += bucketCount;
+			}
+
+			for (uint32 i = 0; i < count; i++)
+				dst[histogram[(src[i].sortKey >> shift) & (BUCKET_COUNT - 1)]++] = src[i];
+
+			std::swap(src, dst);
+		}
+
+		// Odd amount of executed passes, the result ended up in the scratch buffer
+		if (src != packets)
+			memcpy(packets, src, sizeof(DrawPacket) * count);
+	}
+
+	void RenderQueue::resetBindState(VkCommandBuffer commandBuffer) {
+		for (CommandBufferState& state : m_commandBufferStates) {
+			if (state.commandBuffer == commandBuffer) {
+				state.boundPipeline = nullptr;
+				state.boundModel = nullptr;
+				return;
+			}
+		}
+
+		CommandBufferState& state = m_commandBufferStates.emplace_back();
+		state.commandBuffer = commandBuffer;
+	}
+
+	RenderQueue::CommandBufferState& RenderQueue::getState(VkCommandBuffer commandBuffer) {
+		for (CommandBufferState& state : m_commandBufferStates)
+			if (state.commandBuffer == commandBuffer)
+				return state;
+
+		assert(false && "Command buffer was not registered with resetBindState");
+		return m_commandBufferStates.front();
+	}
+
+	RenderStats RenderQueue::getStats() const {
+		RenderStats stats;
+		for (const CommandBufferState& state : m_commandBufferStates) {
+			stats.drawCalls += state.stats.drawCalls;
+			stats.pipelineBinds += state.stats.pipelineBinds;
+			stats.pipelineBindsSkipped += state.stats.pipelineBindsSkipped;
+			stats.modelBinds += state.stats.modelBinds;
+			stats.modelBindsSkipped += state.stats.modelBindsSkipped;
+		}
+		return stats;
+	}
+
+	bool RenderQueue::bindPipeline(VkCommandBuffer commandBuffer, Pipeline& pipeline) {
+		CommandBufferState& state = getState(commandBuffer);
+		if (state.boundPipeline == &pipeline) {
+			state.stats.pipelineBindsSkipped++;
+			return false;
+		}
+
+		pipeline.bind(commandBuffer);
+		state.boundPipeline = &pipeline;
+		state.stats.pipelineBinds++;
+		return true;
+	}
+
+	bool RenderQueue::bindModel(VkCommandBuffer commandBuffer, Model& model) {
+		CommandBufferState& state = getState(commandBuffer);
+		if (state.boundModel == &model) {
+			state.stats.modelBindsSkipped++;
+			return false;
+		}
+
+		model.bind(commandBuffer);
+		state.boundModel = &model;
+		state.stats.modelBinds++;
+		return true;
+	}
+
+	void RenderQueue::draw(VkCommandBuffer commandBuffer, Model& model, uint32_t instanceCount, uint32_t firstInstance) {
+		model.draw(commandBuffer, instanceCount, firstInstance);
+		getState(commandBuffer).stats.drawCalls++;
+	}
+
+	void RenderQueue::drawIndirect(VkCommandBuffer commandBuffer, Model& model, VkBuffer buffer, VkDeviceSize offset) {
+		model.drawIndirect(commandBuffer, buffer, offset);
+		getState(commandBuffer).stats.drawCalls++;
+	}
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "FrameArena.hpp"
+#include "GameObject.hpp"
+#include "Pipeline.hpp"
+
+namespace OmniV {
+
+	class Camera;
+
+	// One draw of one object. Render systems consume these in sort key order
+	struct DrawPacket {
+		uint64 sortKey;
+		GameObject* object;
+		Model* model;
+	};
+
+	// Counters of the binds/draws recorded during a frame
+	struct RenderStats {
+		uint32 drawCalls = 0;
+		uint32 pipelineBinds = 0;
+		uint32 pipelineBindsSkipped = 0;
+		uint32 modelBinds = 0;
+		uint32 modelBindsSkipped = 0;
+
+		void reset() { *this = RenderStats{}; }
+	};
+
+	/// <summary>
+	/// <para> Collects the draw packets of a frame and sorts them by a 64-bit key, so that consecutive draws share as much state as possible </para>
+	/// <para> Key layout (most significant first): pipeline (8 bits) | material (16 bits) | model (24 bits) | depth bucket (16 bits) </para>
+	/// <para> Render systems walk the sorted packets and use bindPipeline/bindModel, which skip the bind if that state is already bound in the command buffer </para>
+	/// <para> Bind state and counters are kept per command buffer, so that secondary command buffers can record from the queue in parallel </para>
+	/// </summary>
+	class RenderQueue {
+	public:
+		static constexpr uint32 PIPELINE_BITS = 8;
+		static constexpr uint32 MATERIAL_BITS = 16;
+		static constexpr uint32 MODEL_BITS = 24;
+		static constexpr uint32 DEPTH_BITS = 16;
+
+		RenderQueue() = default;
+
+		RenderQueue(const RenderQueue&) = delete;
+		RenderQueue& operator=(const RenderQueue&) = delete;
+
+		static uint64 makeSortKey(uint32 pipelineID, uint32 materialID, uint32 modelID, uint32 depthBucket);
+
+		// Fills the queue with every object that has a model, and sorts it
+		// Depth buckets go front to back, so that opaque geometry benefits from early depth rejection
+		void build(GameObject::Map& gameObjects, const Camera& camera, uint32 pipelineID);
+
+		const DrawPacket* begin() const { return m_packets; }
+		const DrawPacket* end() const { return m_packets + m_packetCount; }
+		uint32 size() const { return m_packetCount; }
+
+		// Packets hidden from the camera (e.g. by occlusion culling). Camera passes skip them, shadow passes still draw them
+		void setCulled(uint32 index) { m_culled[index] = 1; }
+		bool isCulled(uint32 index) const { return m_culled[index] != 0; }
+
+		// Must be called once a new command buffer starts recording, as bound state does not carry over between command buffers
+		// Also after executing secondary command buffers, which leave the primary's state undefined
+		// Not thread safe: every command buffer recorded in parallel is registered before the recording starts. Binds and draws are then thread safe
+		void resetBindState(VkCommandBuffer commandBuffer);
+
+		// For systems binding their own vertex buffers: the next bindModel() has to rebind
+		void invalidateModelBinding(VkCommandBuffer commandBuffer) { getState(commandBuffer).boundModel = nullptr; }
+
+		// Return true if the bind was actually recorded
+		bool bindPipeline(VkCommandBuffer commandBuffer, Pipeline& pipeline);
+		bool bindModel(VkCommandBuffer commandBuffer, Model& model);
+		void draw(VkCommandBuffer commandBuffer, Model& model, uint32_t instanceCount = 1, uint32_t firstInstance = 0);
+		void drawIndirect(VkCommandBuffer commandBuffer, Model& model, VkBuffer buffer, VkDeviceSize offset);
+
+		RenderStats getStats() const; // Summed over the command buffers of the frame
+
+	private:
+		// Bind state of a command buffer being recorded
+		struct CommandBufferState {
+			VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+			const Pipeline* boundPipeline = nullptr;
+			const Model* boundModel = nullptr;
+			RenderStats stats;
+		};
+
+		CommandBufferState& getState(VkCommandBuffer commandBuffer);
+
+		static void radixSort(DrawPacket* packets, DrawPacket* scratch, uint32 count);
+
+		FrameArena m_arena;
+		DrawPacket* m_packets = nullptr;
+		uint8* m_culled = nullptr;
+		uint32 m_packetCount = 0;
+
+		// A few entries per frame (primary, and secondaries when recording in parallel), searched linearly
+		std::vector<CommandBufferState> m_commandBufferStates;
+	};
+}
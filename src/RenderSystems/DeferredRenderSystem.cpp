@@ -0,0 +1,120 @@
+#include "DeferredRenderSystem.hpp"
+
+// libs
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+// std
+#include <cassert>
+
+namespace OmniV {
+
+	DeferredRenderSystem::DeferredRenderSystem(Device& device, GBuffer& gBuffer, VkDescriptorSetLayout globalSetLayout, ShadowFilter shadowFilter, bool debugCascades)
+		: RenderSystem(device), m_gBuffer{ gBuffer } {
+		createPipelineLayouts(globalSetLayout);
+		createGeometryPipeline();
+
+		// Fullscreen triangle, no vertex input
+		m_lightingPermutations = std::make_unique<PipelinePermutations>(m_device, "deferred_lighting.vert.spv", "deferred_lighting.frag.spv");
+
+		PipelineConfigInfo& lightingConfig = m_lightingPermutations->getConfigInfo();
+		lightingConfig.stagesCount = 2;
+		lightingConfig.attributeDescriptions.clear();
+		lightingConfig.bindingDescriptions.clear();
+		lightingConfig.rasterizationInfo.cullMode = VK_CULL_MODE_NONE;
+		lightingConfig.depthStencilInfo.depthTestEnable = VK_FALSE;
+		lightingConfig.depthStencilInfo.depthWriteEnable = VK_FALSE;
+		lightingConfig.renderPass = m_gBuffer.getRenderPass();
+		lightingConfig.subpass = static_cast<uint32_t>(DeferredSubpass::Lighting);
+		lightingConfig.pipelineLayout = m_lightingPipelineLayout;
+
+		initLightingConstants(m_fragConstants, shadowFilter, debugCascades);
+		createLightingPermutations(*m_lightingPermutations, m_vertConstants, m_fragConstants);
+	}
+
+	DeferredRenderSystem::~DeferredRenderSystem() {
+		vkDestroyPipelineLayout(m_device.device(), m_lightingPipelineLayout, nullptr);
+	}
+
+	void DeferredRenderSystem::createPipelineLayouts(VkDescriptorSetLayout globalSetLayout) {
+		// Geometry: global set only, scene.vert reads the transforms from the frame's object data
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = 1;
+		pipelineLayoutInfo.pSetLayouts = &globalSetLayout;
+		pipelineLayoutInfo.pushConstantRangeCount = 0;
+		pipelineLayoutInfo.pPushConstantRanges = nullptr;
+		if (vkCreatePipelineLayout(m_device.device(), &pipelineLayoutInfo, nullptr, &m_pipelineLayout) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create pipeline layout!");
+		}
+
+		// Lighting: global set + G-buffer inputs
+		std::vector<VkDescriptorSetLayout> lightingSetLayouts{ globalSetLayout, m_gBuffer.getInputSetLayout() };
+
+		pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(lightingSetLayouts.size());
+		pipelineLayoutInfo.pSetLayouts = lightingSetLayouts.data();
+		pipelineLayoutInfo.pushConstantRangeCount = 0;
+		pipelineLayoutInfo.pPushConstantRanges = nullptr;
+		if (vkCreatePipelineLayout(m_device.device(), &pipelineLayoutInfo, nullptr, &m_lightingPipelineLayout) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create pipeline layout!");
+		}
+	}
+
+	void DeferredRenderSystem::createGeometryPipeline() {
+		assert(m_pipelineLayout != nullptr && "Cannot create pipeline before pipeline layout");
+
+		PipelineConfigInfo pipelineConfig{};
+		Pipeline::defaultPipelineConfigInfo(pipelineConfig);
+
+		// Albedo and normal, no blending
+		std::array<VkPipelineColorBlendAttachmentState, 2> blendAttachments{ pipelineConfig.colorBlendAttachment, pipelineConfig.colorBlendAttachment };
+		pipelineConfig.colorBlendInfo.attachmentCount = static_cast<uint32_t>(blendAttachments.size());
+		pipelineConfig.colorBlendInfo.pAttachments = blendAttachments.data();
+
+		pipelineConfig.stagesCount = 2;
+		pipelineConfig.renderPass = m_gBuffer.getRenderPass();
+		pipelineConfig.subpass = static_cast<uint32_t>(DeferredSubpass::Geometry);
+		pipelineConfig.pipelineLayout = m_pipelineLayout;
+		m_pipeline = std::make_unique<Pipeline>(m_device, pipelineConfig, "scene.vert.spv", "gbuffer.frag.spv");
+	}
+
+	void DeferredRenderSystem::prepare(FrameInfo& frameInfo) {
+		updateLightingConstants(m_fragConstants, frameInfo);
+		m_activeLightingPipeline = &m_lightingPermutations->get(m_vertConstants, m_fragConstants);
+	}
+
+	void DeferredRenderSystem::render(FrameInfo& frameInfo) {
+		assert(frameInfo.renderQueue != nullptr && "DeferredRenderSystem needs a render queue");
+		RenderQueue& renderQueue = *frameInfo.renderQueue;
+
+		renderQueue.bindPipeline(frameInfo.commandBuffer, *m_pipeline);
+
+		vkCmdBindDescriptorSets(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &frameInfo.globalDescriptorSet, GLOBAL_DYNAMIC_OFFSET_COUNT, frameInfo.globalOffsets.data());
+
+		const uint32 lastPacket = std::min(frameInfo.lastPacket, renderQueue.size());
+		for (uint32 i = frameInfo.firstPacket; i < lastPacket; i++) {
+			if (renderQueue.isCulled(i))
+				continue;
+
+			const DrawPacket& packet = renderQueue.begin()[i];
+
+			renderQueue.bindModel(frameInfo.commandBuffer, *packet.model);
+			renderQueue.draw(frameInfo.commandBuffer, *packet.model, 1, i);
+		}
+	}
+
+	void DeferredRenderSystem::renderLighting(FrameInfo& frameInfo) {
+		assert(frameInfo.renderQueue != nullptr && "DeferredRenderSystem needs a render queue");
+
+		assert(m_activeLightingPipeline != nullptr && "DeferredRenderSystem was not prepared");
+
+		frameInfo.renderQueue->bindPipeline(frameInfo.commandBuffer, *m_activeLightingPipeline);
+
+		std::array<VkDescriptorSet, 2> descriptorSets{ frameInfo.globalDescriptorSet, m_gBuffer.getInputSet() };
+		vkCmdBindDescriptorSets(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_lightingPipelineLayout, 0,
+			static_cast<uint32_t>(descriptorSets.size()), descriptorSets.data(), GLOBAL_DYNAMIC_OFFSET_COUNT, frameInfo.globalOffsets.data());
+
+		vkCmdDraw(frameInfo.commandBuffer, 3, 1, 0, 0);
+	}
+}
@@ -0,0 +1,42 @@
+﻿#pragma once
+
+#include "RenderSystem.hpp"
+#include "GBuffer.hpp"
+
+namespace OmniV {
+
+	/// <summary>
+	/// <para> Deferred shading: opaque objects fill the G-buffer (render()), then a fullscreen pass lights every pixel once (renderLighting()) </para>
+	/// <para> Lighting cost no longer depends on overdraw: each visible pixel evaluates the directional lights, the shadow cascades
+	/// and the point lights of its light cluster (the same clusters as forward shading), whatever the number of objects drawn over it </para>
+	/// </summary>
+	class DeferredRenderSystem final : public RenderSystem {
+	public:
+		DeferredRenderSystem(Device& device, GBuffer& gBuffer, VkDescriptorSetLayout globalSetLayout, ShadowFilter shadowFilter = ShadowFilter::Gather, bool debugCascades = false);
+		~DeferredRenderSystem();
+
+		DeferredRenderSystem(const DeferredRenderSystem&) = delete;
+		DeferredRenderSystem& operator=(const DeferredRenderSystem&) = delete;
+
+		void prepare(FrameInfo& frameInfo) override;
+
+		// Geometry subpass
+		void render(FrameInfo& frameInfo) override;
+
+		// Lighting subpass
+		void renderLighting(FrameInfo& frameInfo);
+
+	private:
+		void createPipelineLayouts(VkDescriptorSetLayout globalSetLayout);
+		void createGeometryPipeline();
+
+		GBuffer& m_gBuffer;
+
+		// Lighting pass, specialized per frame like scene.frag
+		VkPipelineLayout m_lightingPipelineLayout = VK_NULL_HANDLE;
+		std::unique_ptr<PipelinePermutations> m_lightingPermutations;
+		SpecializationConstants m_vertConstants;
+		SpecializationConstants m_fragConstants;
+		Pipeline* m_activeLightingPipeline = nullptr; // Permutation of the frame, picked by prepare()
+	};
+}
@@ -0,0 +1,83 @@
+#include "DepthPrepassRenderSystem.hpp"
+#include "OcclusionCuller.hpp"
+
+// libs
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+// std
+#include <cassert>
+
+namespace OmniV {
+
+	// offscreen.vert's CAMERA_VIEW
+	static constexpr uint32_t CAMERA_VIEW_ID = 0;
+
+	DepthPrepassRenderSystem::DepthPrepassRenderSystem(Device& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout)
+		: RenderSystem(device) {
+		createPipelineLayout(globalSetLayout);
+
+		SpecializationConstants vertConstants;
+		vertConstants.set(CAMERA_VIEW_ID, VK_TRUE);
+		VkSpecializationInfo vertSpecializationInfo = vertConstants.getInfo();
+
+		// Same subpass as the main pass, which has a color attachment: it is kept but never written
+		PipelineConfigInfo pipelineConfig{};
+		Pipeline::defaultPipelineConfigInfo(pipelineConfig);
+		pipelineConfig.stagesCount = 1;
+		pipelineConfig.colorBlendAttachment.colorWriteMask = 0;
+		pipelineConfig.renderPass = renderPass;
+		pipelineConfig.pipelineLayout = m_pipelineLayout;
+		pipelineConfig.vertSpecializationInfo = &vertSpecializationInfo;
+		m_pipeline = std::make_unique<Pipeline>(m_device, pipelineConfig, "offscreen.vert.spv");
+	}
+
+	DepthPrepassRenderSystem::~DepthPrepassRenderSystem() {}
+
+	void DepthPrepassRenderSystem::createPipelineLayout(VkDescriptorSetLayout globalSetLayout) {
+		// Same layout as offscreen.vert's shadow cascades, whose cascade index the camera view ignores
+		VkPushConstantRange pushConstantRange{};
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(uint32_t);
+
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = 1;
+		pipelineLayoutInfo.pSetLayouts = &globalSetLayout;
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+		if (vkCreatePipelineLayout(m_device.device(), &pipelineLayoutInfo, nullptr, &m_pipelineLayout) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create pipeline layout!");
+		}
+	}
+
+	void DepthPrepassRenderSystem::render(FrameInfo& frameInfo) {
+		assert(frameInfo.renderQueue != nullptr && "DepthPrepassRenderSystem needs a render queue");
+		RenderQueue& renderQueue = *frameInfo.renderQueue;
+
+		renderQueue.bindPipeline(frameInfo.commandBuffer, *m_pipeline);
+
+		vkCmdBindDescriptorSets(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &frameInfo.globalDescriptorSet, GLOBAL_DYNAMIC_OFFSET_COUNT, frameInfo.globalOffsets.data());
+
+		// Exactly the draws of the opaque system, including the culler's, so that every pixel it shades has a matching depth
+		OcclusionCuller* culler = frameInfo.occlusionCuller;
+		VkBuffer drawCommandBuffer = culler ? culler->getDrawCommandBuffer(frameInfo.frameIndex) : VK_NULL_HANDLE;
+
+		const uint32 lastPacket = std::min(frameInfo.lastPacket, renderQueue.size());
+		for (uint32 i = frameInfo.firstPacket; i < lastPacket; i++) {
+			if (renderQueue.isCulled(i))
+				continue;
+
+			const DrawPacket& packet = renderQueue.begin()[i];
+
+			renderQueue.bindModel(frameInfo.commandBuffer, *packet.model);
+
+			if (culler)
+				renderQueue.drawIndirect(frameInfo.commandBuffer, *packet.model, drawCommandBuffer, culler->getDrawCommandOffset(frameInfo.cullPhase, i));
+			else
+				renderQueue.draw(frameInfo.commandBuffer, *packet.model, 1, i);
+		}
+	}
+}
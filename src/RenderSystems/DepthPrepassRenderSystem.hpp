@@ -0,0 +1,26 @@
+﻿#pragma once
+
+#include "RenderSystem.hpp"
+
+namespace OmniV {
+
+	/// <summary>
+	/// <para> Depth only pass over the opaque queue, drawn in the main pass before the opaque system </para>
+	/// <para> The main pass then tests depth for equality without writing it, so the lighting and PCF fragment shader only runs on the visible
+	/// fragment of each pixel. Worth it when overdraw costs more than drawing the geometry twice </para>
+	/// <para> Uses the shadow casters' position only shader (offscreen.vert), specialized to project with the camera </para>
+	/// </summary>
+	class DepthPrepassRenderSystem final : public RenderSystem {
+	public:
+		DepthPrepassRenderSystem(Device& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout);
+		~DepthPrepassRenderSystem();
+
+		DepthPrepassRenderSystem(const DepthPrepassRenderSystem&) = delete;
+		DepthPrepassRenderSystem& operator=(const DepthPrepassRenderSystem&) = delete;
+
+		void render(FrameInfo& frameInfo);
+
+	private:
+		void createPipelineLayout(VkDescriptorSetLayout globalSetLayout);
+	};
+}
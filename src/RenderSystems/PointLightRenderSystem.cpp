@@ -7,17 +7,12 @@
 #include <glm/gtc/constants.hpp>
 
 // std
+#include <algorithm>
 #include <cassert>
 
 namespace OmniV {
 
-	struct PointLightPushConstants {
-		glm::vec4 position{};
-		glm::vec4 color{};
-		float radius;
-	};
-
-	PointLightRenderSystem::PointLightRenderSystem(Device& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout)
+	PointLightRenderSystem::PointLightRenderSystem(Device& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout, uint32_t subpass)
 		: RenderSystem(device) {
 		createPipelineLayout(globalSetLayout);
 
@@ -25,28 +20,34 @@ namespace OmniV {
 		Pipeline::defaultPipelineConfigInfo(pipelineConfig);
 		Pipeline::enableAlphaBlending(pipelineConfig);
 		pipelineConfig.stagesCount = 2;
-		pipelineConfig.attributeDescriptions.clear();
-		pipelineConfig.bindingDescriptions.clear();
+
+		// One instance per billboard, the quad corners come from gl_VertexIndex
+		pipelineConfig.bindingDescriptions = { { 0, sizeof(BillboardInstance), VK_VERTEX_INPUT_RATE_INSTANCE } };
+		pipelineConfig.attributeDescriptions = {
+			{ 0, 0, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(BillboardInstance, positionRadius) },
+			{ 1, 0, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(BillboardInstance, color) } };
+
 		pipelineConfig.renderPass = renderPass;
+		pipelineConfig.subpass = subpass;
+		if (subpass != 0)
+			pipelineConfig.depthStencilInfo.depthWriteEnable = VK_FALSE;
 		createPipeline(pipelineConfig, "pointLightBillboard.vert.spv", "pointLightBillboard.frag.spv");
+
+		m_instances.reserve(MAX_LIGHTS);
+		m_sortEntries.reserve(MAX_LIGHTS);
 	}
 
 	PointLightRenderSystem::~PointLightRenderSystem() {}
 
 	void PointLightRenderSystem::createPipelineLayout(VkDescriptorSetLayout globalSetLayout) {
-		VkPushConstantRange pushConstantRange{};
-		pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
-		pushConstantRange.offset = 0;
-		pushConstantRange.size = sizeof(PointLightPushConstants);
-
 		std::vector<VkDescriptorSetLayout> descriptorSetLayouts{ globalSetLayout };
 
 		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
 		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 		pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
 		pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
-		pipelineLayoutInfo.pushConstantRangeCount = 1;
-		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+		pipelineLayoutInfo.pushConstantRangeCount = 0;
+		pipelineLayoutInfo.pPushConstantRanges = nullptr;
 		if (vkCreatePipelineLayout(m_device.device(), &pipelineLayoutInfo, nullptr, &m_pipelineLayout) !=
 			VK_SUCCESS) {
 			throw std::runtime_error("failed to create pipeline layout!");
@@ -60,38 +61,61 @@ namespace OmniV {
 		m_pipeline = std::make_unique<Pipeline>(m_device, pipelineConfig, vertFilepath, fragFilepath);
 	}
 
-	void PointLightRenderSystem::render(FrameInfo& frameInfo) {
-		// sort lights
-		std::map<float, GameObject::id_t> sorted;
+	void PointLightRenderSystem::prepare(FrameInfo& frameInfo) {
+		assert(frameInfo.gpuArena != nullptr && "PointLightRenderSystem needs the GPU frame arena");
+
+		m_instances.clear();
+		m_sortEntries.clear();
+		m_instanceAllocation = {};
+		m_instanceCount = 0;
+
+		const glm::vec3 cameraPosition = frameInfo.camera.getPosition();
 
 		for (auto& kv : frameInfo.gameObjects) {
 			auto& obj = kv.second;
 			if (obj.m_pointLight == nullptr || !obj.m_pointLight->drawBillboard) continue;
 
-			// calculate distance
-			auto offset = frameInfo.camera.getPosition() - obj.m_transform.position;
-			float disSquared = glm::dot(offset, offset);
-			sorted[disSquared] = obj.getObjectID();
+			assert(m_instances.size() < MAX_LIGHTS && "Exceeded maximum number of light billboards");
+
+			glm::vec3 offset = cameraPosition - obj.m_transform.position;
+			m_sortEntries.push_back({ glm::dot(offset, offset), static_cast<uint32>(m_instances.size()) });
+
+			BillboardInstance& instance = m_instances.emplace_back();
+			instance.positionRadius = glm::vec4(obj.m_transform.position, obj.m_transform.scale.x);
+			instance.color = glm::vec4(obj.m_color, obj.m_pointLight->lightIntensity);
 		}
 
-		m_pipeline->bind(frameInfo.commandBuffer);
+		if (m_instances.empty())
+			return;
 
-		vkCmdBindDescriptorSets(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &frameInfo.globalDescriptorSet, 0, nullptr);
+		// Back to front for blending. Lights at the same distance are all kept
+		std::sort(m_sortEntries.begin(), m_sortEntries.end(),
+			[](const SortEntry& a, const SortEntry& b) { return a.distanceSquared > b.distanceSquared; });
 
-		// iterate through sorted lights in reverse order
-		for (auto it = sorted.rbegin(); it != sorted.rend(); ++it) {
-			// use game obj id to find light object
-			auto& obj = frameInfo.gameObjects.at(it->second);
+		m_instanceCount = static_cast<uint32>(m_instances.size());
+		m_instanceAllocation = frameInfo.gpuArena->allocate<BillboardInstance>(m_instanceCount);
+		BillboardInstance* instances = static_cast<BillboardInstance*>(m_instanceAllocation.data);
+		for (size_t i = 0; i < m_sortEntries.size(); i++)
+			instances[i] = m_instances[m_sortEntries[i].instance];
+	}
 
-			PointLightPushConstants push{};
-			push.position = glm::vec4(obj.m_transform.position, 1.f);
-			push.color = glm::vec4(obj.m_color, obj.m_pointLight->lightIntensity);
-			push.radius = obj.m_transform.scale.x;
+	void PointLightRenderSystem::render(FrameInfo& frameInfo) {
+		if (m_instanceCount == 0)
+			return;
 
-			vkCmdPushConstants(frameInfo.commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PointLightPushConstants), &push);
+		// Goes through the queue so that its bind state stays in sync with the command buffer
+		if (frameInfo.renderQueue)
+			frameInfo.renderQueue->bindPipeline(frameInfo.commandBuffer, *m_pipeline);
+		else
+			m_pipeline->bind(frameInfo.commandBuffer);
 
-			vkCmdDraw(frameInfo.commandBuffer, 6, 1, 0, 0);
-		}
+		vkCmdBindDescriptorSets(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &frameInfo.globalDescriptorSet, GLOBAL_DYNAMIC_OFFSET_COUNT, frameInfo.globalOffsets.data());
+
+		vkCmdBindVertexBuffers(frameInfo.commandBuffer, 0, 1, &m_instanceAllocation.buffer, &m_instanceAllocation.offset);
+		if (frameInfo.renderQueue)
+			frameInfo.renderQueue->invalidateModelBinding(frameInfo.commandBuffer);
+
+		vkCmdDraw(frameInfo.commandBuffer, 6, m_instanceCount, 0, 0);
 	}
 
 }
\ No newline at end of file
@@ -1,20 +1,45 @@
 ﻿#pragma once
 
 #include "RenderSystem.hpp"
+#include "GpuFrameArena.hpp"
 
 namespace OmniV {
+
+	// Billboards of the point lights flagged drawbillboard. prepare() sorts them back to front into instance data allocated from the GPU frame arena,
+	// and render() draws them all with a single instanced draw
 	class PointLightRenderSystem final : public RenderSystem {
 	public:
-		PointLightRenderSystem(Device& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout);
+		// Subpasses other than the first (deferred lighting) only have read only depth, billboards are then depth tested without writing it
+		PointLightRenderSystem(Device& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout, uint32_t subpass = 0);
 		~PointLightRenderSystem();
 
 		PointLightRenderSystem(const PointLightRenderSystem&) = delete;
 		PointLightRenderSystem& operator=(const PointLightRenderSystem&) = delete;
 
-		void render(FrameInfo& frameInfo);
+		void prepare(FrameInfo& frameInfo) override;
+		void render(FrameInfo& frameInfo) override;
 
 	private:
 		void createPipelineLayout(VkDescriptorSetLayout globalSetLayout);
 		void createPipeline(PipelineConfigInfo& pipelineConfig, const std::string& vertFilepath, const std::string& fragFilepath = "");
+
+		// Must match pointLightBillboard.vert's instance attributes
+		struct BillboardInstance {
+			glm::vec4 positionRadius{}; // xyz position, w radius
+			glm::vec4 color{}; // w is intensity
+		};
+
+		struct SortEntry {
+			float distanceSquared;
+			uint32 instance;
+		};
+
+		// Reserved up front, so that gathering and sorting never allocate
+		std::vector<BillboardInstance> m_instances;
+		std::vector<SortEntry> m_sortEntries;
+
+		// Sorted instances of the frame, written by prepare()
+		GpuAllocation m_instanceAllocation;
+		uint32 m_instanceCount = 0;
 	};
 }
\ No newline at end of file
@@ -5,20 +5,70 @@
 #include "FrameInfo.hpp"
 #include "GameObject.hpp"
 #include "Pipeline.hpp"
+#include "RenderQueue.hpp"
 
 // std
+#include <cassert>
 #include <memory>
 #include <vector>
 
 namespace OmniV {
+
+	// Specialization constant ids of the lighting shaders (scene.frag, deferred_lighting.frag)
+	enum LightingConstantID : uint32_t {
+		SHADOW_FILTER_ID = 0,
+		SHADOWS_ENABLED_ID = 1,
+		POINT_LIGHTS_ENABLED_ID = 2,
+		MAX_DIRECTIONAL_LIGHTS_ID = 3,
+		DEBUG_CASCADES_ID = 4,
+	};
+
 	class RenderSystem {
 	public:
 		explicit RenderSystem(Device& device) : m_device(device) {}
-		~RenderSystem() { vkDestroyPipelineLayout(m_device.device(), m_pipelineLayout, nullptr); }
+		// Systems are owned through RenderSystem pointers, and their members (pipeline permutations...) must be destroyed too
+		virtual ~RenderSystem() { vkDestroyPipelineLayout(m_device.device(), m_pipelineLayout, nullptr); }
+
+		// Per frame state (e.g. pipeline permutations), resolved once before the frame is recorded
+		// render() must leave the system untouched afterwards, as chunks of the frame can be recorded on several threads at once
+		virtual void prepare(FrameInfo& frameInfo) {}
 
 		virtual void render(FrameInfo& frameInfo) { std::cerr << "Render function not implemented" << std::endl; };
 
+		virtual uint32_t getPipelineID() const { return m_pipeline->getPipelineID(); }
+
 	protected:
+		// Lighting constants fixed for the lifetime of the system
+		static void initLightingConstants(SpecializationConstants& constants, ShadowFilter shadowFilter, bool debugCascades) {
+			constants.set(SHADOW_FILTER_ID, static_cast<uint32_t>(shadowFilter))
+				.set(DEBUG_CASCADES_ID, debugCascades ? VK_TRUE : VK_FALSE);
+		}
+
+		// Compiles out the lighting paths this frame doesn't use. One directional light gets its own permutation, as the common case,
+		// more than one leaves the loop bounded by the UBO count alone
+		static void updateLightingConstants(SpecializationConstants& constants, const FrameInfo& frameInfo) {
+			uint32_t maxDirectionalLights = frameInfo.directionalLightCount <= 1 ? frameInfo.directionalLightCount : ~0u;
+
+			constants.set(SHADOWS_ENABLED_ID, frameInfo.shadows ? VK_TRUE : VK_FALSE)
+				.set(POINT_LIGHTS_ENABLED_ID, frameInfo.pointLightCount > 0 ? VK_TRUE : VK_FALSE)
+				.set(MAX_DIRECTIONAL_LIGHTS_ID, maxDirectionalLights);
+		}
+
+		// Creates every permutation updateLightingConstants() can pick, when the system is created, so that a frame meeting a new
+		// combination of lights and shadows never waits for a pipeline to compile
+		static void createLightingPermutations(PipelinePermutations& permutations, const SpecializationConstants& vertConstants, SpecializationConstants fragConstants) {
+			for (VkBool32 shadows : { VK_FALSE, VK_TRUE }) {
+				for (VkBool32 pointLights : { VK_FALSE, VK_TRUE }) {
+					for (uint32_t maxDirectionalLights : { 0u, 1u, ~0u }) {
+						fragConstants.set(SHADOWS_ENABLED_ID, shadows)
+							.set(POINT_LIGHTS_ENABLED_ID, pointLights)
+							.set(MAX_DIRECTIONAL_LIGHTS_ID, maxDirectionalLights);
+						permutations.get(vertConstants, fragConstants);
+					}
+				}
+			}
+		}
+
 		Device& m_device;
 
 		std::unique_ptr<Pipeline> m_pipeline;
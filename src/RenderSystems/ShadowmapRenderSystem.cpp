@@ -11,14 +11,14 @@
 
 namespace OmniV {
 
-	struct SimplePushConstantData {
-		glm::mat4 modelMat{ 1.f };
-		glm::mat4 normalMat{ 1.f };
-		uint32_t cascadeIndex = 0;
+	// Pushed once per pass, transforms are read from the frame's object data. Must match offscreen.vert and the single pass shaders
+	struct ShadowPushConstantData {
+		uint32_t cascadeIndex = 0; // Mask of the cascades to draw into for the single pass shaders
 	};
 
-	ShadowmapRenderSystem::ShadowmapRenderSystem(Device& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout)
-		: RenderSystem(device) {
+	ShadowmapRenderSystem::ShadowmapRenderSystem(Device& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout,
+		VkRenderPass allCascadesRenderPass, ShadowLayering layering)
+		: RenderSystem(device), m_layering{ layering } {
 		createPipelineLayout(globalSetLayout);
 
 		PipelineConfigInfo pipelineConfig{};
@@ -36,15 +36,23 @@ namespace OmniV {
 		pipelineConfig.dynamicStateInfo.dynamicStateCount = static_cast<uint32_t>(pipelineConfig.dynamicStateEnables.size());
 		pipelineConfig.dynamicStateInfo.flags = 0;
 		createPipeline(pipelineConfig, "offscreen.vert.spv");
+
+		if (m_layering != ShadowLayering::None) {
+			assert(allCascadesRenderPass != VK_NULL_HANDLE && "Single pass shadows need the AllCascades render pass");
+
+			pipelineConfig.renderPass = allCascadesRenderPass;
+			const char* vertFilepath = m_layering == ShadowLayering::Multiview ? "shadow_multiview.vert.spv" : "shadow_layered.vert.spv";
+			m_allCascadesPipeline = std::make_unique<Pipeline>(m_device, pipelineConfig, vertFilepath, "");
+		}
 	}
 
 	ShadowmapRenderSystem::~ShadowmapRenderSystem() {}
 
 	void ShadowmapRenderSystem::createPipelineLayout(VkDescriptorSetLayout globalSetLayout) {
 		VkPushConstantRange pushConstantRange{};
-		pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 		pushConstantRange.offset = 0;
-		pushConstantRange.size = sizeof(SimplePushConstantData);
+		pushConstantRange.size = sizeof(ShadowPushConstantData);
 
 		std::vector<VkDescriptorSetLayout> descriptorSetLayouts{ globalSetLayout };
 
@@ -66,26 +74,36 @@ namespace OmniV {
 		m_pipeline = std::make_unique<Pipeline>(m_device, pipelineConfig, vertFilepath, fragFilepath);
 	}
 
-	void ShadowmapRenderSystem::render(FrameInfo& frameInfo) {
-		m_pipeline->bind(frameInfo.commandBuffer);
+	void ShadowmapRenderSystem::render(FrameInfo& frameInfo, const ShadowCasterPass& pass) {
+		assert(frameInfo.renderQueue != nullptr && "ShadowmapRenderSystem needs a render queue");
+		RenderQueue& renderQueue = *frameInfo.renderQueue;
 
-		vkCmdBindDescriptorSets(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &frameInfo.globalDescriptorSet, 0, nullptr);
+		const bool allCascades = pass.cascadeMask != 0;
+		assert((!allCascades || m_allCascadesPipeline) && "Single pass shadows were not set up");
 
-		for (auto& kv : frameInfo.gameObjects) {
-			auto& obj = kv.second;
+		// Instanced layering draws every caster once per cascade, multiview replicates the draw by itself
+		const uint32_t instanceCount = allCascades && m_layering == ShadowLayering::Instanced ? SHADOWMAP_CASCADE_COUNT : 1;
 
-			if (obj.m_model == nullptr)
-				continue;
+		renderQueue.bindPipeline(frameInfo.commandBuffer, allCascades ? *m_allCascadesPipeline : *m_pipeline);
 
-			SimplePushConstantData push{};
-			push.modelMat = obj.m_transform.mat4();
-			push.normalMat = obj.m_transform.normalMatrix();
-			push.cascadeIndex = m_activeCascadeIndex;
+		vkCmdBindDescriptorSets(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &frameInfo.globalDescriptorSet, GLOBAL_DYNAMIC_OFFSET_COUNT, frameInfo.globalOffsets.data());
 
-			vkCmdPushConstants(frameInfo.commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(SimplePushConstantData), &push);
+		ShadowPushConstantData push{};
+		push.cascadeIndex = allCascades ? pass.cascadeMask : pass.cascadeIndex;
+
+		vkCmdPushConstants(frameInfo.commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(ShadowPushConstantData), &push);
+
+		// Same sorted stream as the main pass. The depth bucket is the lowest part of the key, so draws are still grouped by model
+		// Instances start at the packet index, times the cascade count for instanced layering (shadow_layered.vert splits them back)
+		for (uint32 i = 0; i < renderQueue.size(); i++) {
+			const DrawPacket& packet = renderQueue.begin()[i];
+			auto& obj = *packet.object;
+
+			if ((pass.casterFilter == ShadowCasterFilter::Static && !obj.m_isStatic) || (pass.casterFilter == ShadowCasterFilter::Dynamic && obj.m_isStatic))
+				continue;
 
-			obj.m_model->bind(frameInfo.commandBuffer);
-			obj.m_model->draw(frameInfo.commandBuffer);
+			renderQueue.bindModel(frameInfo.commandBuffer, *packet.model);
+			renderQueue.draw(frameInfo.commandBuffer, *packet.model, instanceCount, i * instanceCount);
 		}
 	}
 
@@ -1,22 +1,44 @@
 ﻿#pragma once
 
 #include "RenderSystem.hpp"
+#include "ShadowmapRenderer.hpp"
 
 namespace OmniV {
+
+	// Subset of the shadow casters drawn by a pass
+	enum class ShadowCasterFilter {
+		All,
+		Static, // Only objects flagged static, for the cached layer
+		Dynamic, // Everything else
+	};
+
+	// What a shadow pass draws. Passed to render() rather than kept in the system, so that passes can be recorded in parallel
+	struct ShadowCasterPass {
+		uint32_t cascadeIndex = 0;
+		ShadowCasterFilter casterFilter = ShadowCasterFilter::All;
+
+		// When not 0, draws into every cascade of the mask at once (AllCascades pass), and cascadeIndex is ignored
+		uint32_t cascadeMask = 0;
+	};
+
 	class ShadowmapRenderSystem final : public RenderSystem {
 	public:
-		ShadowmapRenderSystem(Device& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout);
+		// "allCascadesRenderPass" is only needed for single pass rendering, with the technique given by "layering"
+		ShadowmapRenderSystem(Device& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout,
+			VkRenderPass allCascadesRenderPass = VK_NULL_HANDLE, ShadowLayering layering = ShadowLayering::None);
 		~ShadowmapRenderSystem();
 
 		ShadowmapRenderSystem(const ShadowmapRenderSystem&) = delete;
 		ShadowmapRenderSystem& operator=(const ShadowmapRenderSystem&) = delete;
 
-		void render(FrameInfo& frameInfo);
-
-		uint32_t m_activeCascadeIndex = 0;
+		void render(FrameInfo& frameInfo, const ShadowCasterPass& pass);
 
 	private:
 		void createPipelineLayout(VkDescriptorSetLayout globalSetLayout);
 		void createPipeline(PipelineConfigInfo& pipelineConfig, const std::string& vertFilepath, const std::string& fragFilepath = "");
+
+		// Multiview render passes are not compatible with the per cascade ones, so the single pass needs its own pipeline
+		std::unique_ptr<Pipeline> m_allCascadesPipeline;
+		ShadowLayering m_layering;
 	};
 }
\ No newline at end of file
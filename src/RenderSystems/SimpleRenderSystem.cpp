@@ -1,4 +1,5 @@
 #include "SimpleRenderSystem.hpp"
+#include "OcclusionCuller.hpp"
 
 // libs
 #define GLM_FORCE_RADIANS
@@ -11,70 +12,78 @@
 
 namespace OmniV {
 
-	struct SimplePushConstantData {
-		glm::mat4 modelMat{ 1.f };
-		glm::mat4 normalMat{ 1.f };
-	};
-
-	SimpleRenderSystem::SimpleRenderSystem(Device& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout)
+	SimpleRenderSystem::SimpleRenderSystem(Device& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout, ShadowFilter shadowFilter, bool debugCascades,
+		bool depthPrepass)
 		: RenderSystem(device) {
 		createPipelineLayout(globalSetLayout);
 
-		PipelineConfigInfo pipelineConfig{};
-		Pipeline::defaultPipelineConfigInfo(pipelineConfig);
+		m_permutations = std::make_unique<PipelinePermutations>(m_device, "scene.vert.spv", "scene.frag.spv");
+
+		PipelineConfigInfo& pipelineConfig = m_permutations->getConfigInfo();
 		pipelineConfig.stagesCount = 2;
 		pipelineConfig.renderPass = renderPass;
-		createPipeline(pipelineConfig, "scene.vert.spv", "scene.frag.spv");
+		pipelineConfig.pipelineLayout = m_pipelineLayout;
+
+		if (depthPrepass) {
+			pipelineConfig.depthStencilInfo.depthCompareOp = VK_COMPARE_OP_EQUAL;
+			pipelineConfig.depthStencilInfo.depthWriteEnable = VK_FALSE;
+		}
+
+		// The scene dependent constants are set every frame, to one of the permutations created here
+		initLightingConstants(m_fragConstants, shadowFilter, debugCascades);
+		createLightingPermutations(*m_permutations, m_vertConstants, m_fragConstants);
 	}
 
 	SimpleRenderSystem::~SimpleRenderSystem() {}
 
 	void SimpleRenderSystem::createPipelineLayout(VkDescriptorSetLayout globalSetLayout) {
-		VkPushConstantRange pushConstantRange{};
-		pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
-		pushConstantRange.offset = 0;
-		pushConstantRange.size = sizeof(SimplePushConstantData);
-
+		// No push constants, transforms and light lists are read from the frame's object data
 		std::vector<VkDescriptorSetLayout> descriptorSetLayouts{ globalSetLayout };
 
 		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
 		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 		pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
 		pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
-		pipelineLayoutInfo.pushConstantRangeCount = 1;
-		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+		pipelineLayoutInfo.pushConstantRangeCount = 0;
+		pipelineLayoutInfo.pPushConstantRanges = nullptr;
 		if (vkCreatePipelineLayout(m_device.device(), &pipelineLayoutInfo, nullptr, &m_pipelineLayout) !=
 			VK_SUCCESS) {
 			throw std::runtime_error("failed to create pipeline layout!");
 		}
 	}
 
-	void SimpleRenderSystem::createPipeline(PipelineConfigInfo& pipelineConfig, const std::string& vertFilepath, const std::string& fragFilepath) {
-		assert(m_pipelineLayout != nullptr && "Cannot create pipeline before pipeline layout");
-
-		pipelineConfig.pipelineLayout = m_pipelineLayout;
-		m_pipeline = std::make_unique<Pipeline>(m_device, pipelineConfig, vertFilepath, fragFilepath);
+	void SimpleRenderSystem::prepare(FrameInfo& frameInfo) {
+		updateLightingConstants(m_fragConstants, frameInfo);
+		m_activePipeline = &m_permutations->get(m_vertConstants, m_fragConstants);
 	}
 
 	void SimpleRenderSystem::render(FrameInfo& frameInfo) {
-		m_pipeline->bind(frameInfo.commandBuffer);
+		assert(frameInfo.renderQueue != nullptr && "SimpleRenderSystem needs a render queue");
+		assert(m_activePipeline != nullptr && "SimpleRenderSystem was not prepared");
+		RenderQueue& renderQueue = *frameInfo.renderQueue;
+
+		renderQueue.bindPipeline(frameInfo.commandBuffer, *m_activePipeline);
 
-		vkCmdBindDescriptorSets(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &frameInfo.globalDescriptorSet, 0, nullptr);
+		vkCmdBindDescriptorSets(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &frameInfo.globalDescriptorSet, GLOBAL_DYNAMIC_OFFSET_COUNT, frameInfo.globalOffsets.data());
 
-		for (auto& kv : frameInfo.gameObjects) {
-			auto& obj = kv.second;
+		OcclusionCuller* culler = frameInfo.occlusionCuller;
+		VkBuffer drawCommandBuffer = culler ? culler->getDrawCommandBuffer(frameInfo.frameIndex) : VK_NULL_HANDLE;
 
-			if (obj.m_model == nullptr)
+		// Packets are sorted by model, so consecutive draws of the same model skip the vertex/index buffer binds
+		const uint32 lastPacket = std::min(frameInfo.lastPacket, renderQueue.size());
+		for (uint32 i = frameInfo.firstPacket; i < lastPacket; i++) {
+			if (renderQueue.isCulled(i))
 				continue;
 
-			SimplePushConstantData push{};
-			push.modelMat = obj.m_transform.mat4();
-			push.normalMat = obj.m_transform.normalMatrix();
+			const DrawPacket& packet = renderQueue.begin()[i];
 
-			vkCmdPushConstants(frameInfo.commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(SimplePushConstantData), &push);
+			renderQueue.bindModel(frameInfo.commandBuffer, *packet.model);
 
-			obj.m_model->bind(frameInfo.commandBuffer);
-			obj.m_model->draw(frameInfo.commandBuffer);
+			// With culling, the instance count of the command (0 or 1) was decided on the GPU. Either way the first instance is the packet index
+			if (culler)
+				renderQueue.drawIndirect(frameInfo.commandBuffer, *packet.model, drawCommandBuffer, culler->getDrawCommandOffset(frameInfo.cullPhase, i));
+			else
+				renderQueue.draw(frameInfo.commandBuffer, *packet.model, 1, i);
 		}
 	}
 
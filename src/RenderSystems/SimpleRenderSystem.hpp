@@ -3,20 +3,33 @@
 #include "RenderSystem.hpp"
 
 namespace OmniV {
+	// Draws the opaque queue with scene.vert/scene.frag. The fragment shader is specialized per frame for the lights and shadows in use,
+	// every reachable permutation being created with the system
+	// "depthPrepass": depth was already written by DepthPrepassRenderSystem, only the fragments matching it are shaded
 	class SimpleRenderSystem final : public RenderSystem {
 	public:
-		SimpleRenderSystem(Device& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout);
+		SimpleRenderSystem(Device& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout, ShadowFilter shadowFilter = ShadowFilter::Gather, bool debugCascades = false,
+			bool depthPrepass = false);
 		~SimpleRenderSystem();
 
 		SimpleRenderSystem(const SimpleRenderSystem&) = delete;
 		SimpleRenderSystem& operator=(const SimpleRenderSystem&) = delete;
 
-		void render(FrameInfo& frameInfo);
+		void prepare(FrameInfo& frameInfo) override;
+		void render(FrameInfo& frameInfo) override;
+
+		// Of the frame's permutation, prepare() has to be called first
+		uint32_t getPipelineID() const override {
+			assert(m_activePipeline != nullptr && "SimpleRenderSystem was not prepared");
+			return m_activePipeline->getPipelineID();
+		}
 
 	private:
 		void createPipelineLayout(VkDescriptorSetLayout globalSetLayout);
-		void createPipeline(PipelineConfigInfo& pipelineConfig, const std::string& vertFilepath, const std::string& fragFilepath = "");
 
-		std::unique_ptr<Pipeline> m_offscreenPipeline;
+		std::unique_ptr<PipelinePermutations> m_permutations;
+		SpecializationConstants m_vertConstants;
+		SpecializationConstants m_fragConstants;
+		Pipeline* m_activePipeline = nullptr; // Permutation of the frame, picked by prepare()
 	};
 }
\ No newline at end of file
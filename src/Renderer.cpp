@@ -1,6 +1,7 @@
 #include "Renderer.hpp"
 
 // std
+#include <algorithm>
 #include <cassert>
 
 namespace OmniV {
@@ -17,25 +18,59 @@ namespace OmniV {
         auto extent = m_window.getExtent();
         while (extent.width == 0 || extent.height == 0) {
             extent = m_window.getExtent();
-            glfwWaitEvents();
+            m_window.waitEvents();
         }
-        vkDeviceWaitIdle(m_device.device());
 
         if (m_swapChain == nullptr) {
-            m_swapChain = std::make_unique<SwapChain>(m_device, extent);
+            m_swapChain = std::make_unique<SwapChain>(m_device, extent, m_settings);
         }
         else {
+            // No device wait: the frames in flight still use the old swapchain, it is retired until they are finished
             std::shared_ptr<SwapChain> oldSwapChain = std::move(m_swapChain);
-            m_swapChain = std::make_unique<SwapChain>(m_device, extent, oldSwapChain);
+            m_swapChain = std::make_unique<SwapChain>(m_device, extent, m_settings, oldSwapChain);
 
             if (!oldSwapChain->compareSwapFormats(*m_swapChain.get())) {
                 throw std::runtime_error("Swap chain image(or depth) format has changed!");
             }
+
+            // Frame fences don't cover vkQueuePresentKHR, so the old images may still be queued for presentation once the frames
+            // that rendered them are finished. Without VK_EXT_swapchain_maintenance1 there is no present fence: the old swapchain
+            // also waits out one acquire cycle of the new one (as many frames as it has images). The presentation engine processes
+            // the presents of a queue in order, so by the time every image of the new swapchain went through a finished frame, the
+            // presents of the old images that were queued before them are done
+            const uint64_t acquireCycle = m_swapChain->imageCount();
+            m_retiredSwapChains.push_back({ std::move(oldSwapChain), m_device.getSubmittedFrames() + acquireCycle });
+        }
+
+        m_swapChainGeneration++;
+    }
+
+    void Renderer::destroyRetiredSwapChains(uint64_t finishedFrames) {
+        auto isFinished = [finishedFrames](const RetiredSwapChain& retired) { return retired.releaseFrames <= finishedFrames; };
+        m_retiredSwapChains.erase(std::remove_if(m_retiredSwapChains.begin(), m_retiredSwapChains.end(), isFinished), m_retiredSwapChains.end());
+    }
+
+    void Renderer::setSwapChainSettings(const SwapChainSettings& settings) {
+        assert(!m_isFrameStarted && "Can't change the swapchain settings while a frame is in progress");
+
+        // The command buffers and sync objects may be reallocated, so nothing can be in flight
+        vkDeviceWaitIdle(m_device.device());
+
+        bool framesInFlightChanged = settings.framesInFlight != m_settings.framesInFlight;
+        m_settings = settings;
+        recreateSwapChain();
+        destroyRetiredSwapChains(UINT64_MAX); // The queue is idle, its presents included
+        m_device.flushDeferredDestruction();
+
+        if (framesInFlightChanged) {
+            freeCommandBuffers();
+            createCommandBuffers();
+            m_currentFrameIndex = 0;
         }
     }
 
     void Renderer::createCommandBuffers() {
-        m_commandBuffers.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
+        m_commandBuffers.resize(m_settings.framesInFlight);
 
         VkCommandBufferAllocateInfo allocInfo{};
         allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -62,6 +97,14 @@ namespace OmniV {
         assert(!m_isFrameStarted && "Can't call beginFrame while already in progress");
 
         auto result = m_swapChain->acquireNextImage(&m_currentImageIndex);
+
+        // The fence of this frame slot was waited on: every frame submitted framesInFlight frames ago or earlier is finished
+        const uint64_t framesInFlight = m_settings.framesInFlight;
+        const uint64_t submittedFrames = m_device.getSubmittedFrames();
+        const uint64_t finishedFrames = submittedFrames + 1 > framesInFlight ? submittedFrames + 1 - framesInFlight : 0;
+        destroyRetiredSwapChains(finishedFrames);
+        m_device.releaseFinishedFrames(finishedFrames);
+
         if (result == VK_ERROR_OUT_OF_DATE_KHR) {
             recreateSwapChain();
             return nullptr;
@@ -91,6 +134,7 @@ namespace OmniV {
         }
 
         auto result = m_swapChain->submitCommandBuffers(&commandBuffer, &m_currentImageIndex);
+        m_device.addSubmittedFrame();
         if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR ||
             m_window.wasWindowResized()) {
             m_window.resetWindowResizedFlag();
@@ -101,10 +145,10 @@ namespace OmniV {
         }
 
         m_isFrameStarted = false;
-        m_currentFrameIndex = (m_currentFrameIndex + 1) % SwapChain::MAX_FRAMES_IN_FLIGHT;
+        m_currentFrameIndex = (m_currentFrameIndex + 1) % m_settings.framesInFlight;
     }
 
-    void Renderer::beginRenderPass(VkCommandBuffer commandBuffer) {
+    void Renderer::beginRenderPass(VkCommandBuffer commandBuffer, MainPassType type, VkSubpassContents contents) {
         assert(m_isFrameStarted && "Can't call beginSwapChainRenderPass if frame is not in progress");
         assert(commandBuffer == getCurrentCommandBuffer() && "Can't begin render pass on command buffer from a different frame");
 
@@ -114,7 +158,7 @@ namespace OmniV {
 
         VkRenderPassBeginInfo renderPassInfo{};
         renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        renderPassInfo.renderPass = m_swapChain->getRenderPass();
+        renderPassInfo.renderPass = m_swapChain->getRenderPass(type);
         renderPassInfo.framebuffer = m_swapChain->getFrameBuffer(m_currentImageIndex);
 
         renderPassInfo.renderArea.offset = { 0, 0 };
@@ -123,8 +167,13 @@ namespace OmniV {
         renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
         renderPassInfo.pClearValues = clearValues.data();
 
-        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, contents);
+
+        if (contents == VK_SUBPASS_CONTENTS_INLINE)
+            recordPassState(commandBuffer);
+    }
 
+    void Renderer::recordPassState(VkCommandBuffer commandBuffer) const {
         VkViewport viewport{};
         viewport.x = 0.0f;
         viewport.y = 0.0f;
@@ -16,7 +16,26 @@ namespace OmniV {
         Renderer(const Renderer&) = delete;
         Renderer& operator=(const Renderer&) = delete;
 
-        VkRenderPass getRenderPass() const { return m_swapChain->getRenderPass(); }
+        VkRenderPass getRenderPass(MainPassType type = MainPassType::Single) const { return m_swapChain->getRenderPass(type); }
+        VkExtent2D getSwapChainExtent() const { return m_swapChain->getSwapChainExtent(); }
+        size_t getSwapChainImageCount() const { return m_swapChain->imageCount(); }
+        VkImage getImage(int imageIndex) const { return m_swapChain->getImage(imageIndex); }
+        VkImage getDepthImage(int imageIndex) const { return m_swapChain->getDepthImage(imageIndex); }
+        VkImageView getDepthImageView(int imageIndex) const { return m_swapChain->getDepthImageView(imageIndex); }
+        VkImageView getImageView(int imageIndex) const { return m_swapChain->getImageView(imageIndex); }
+        VkFormat getSwapChainImageFormat() const { return m_swapChain->getSwapChainImageFormat(); }
+        VkFormat getDepthFormat() const { return m_swapChain->findDepthFormat(); }
+
+        // Per frame resources are indexed by getFrameIndex(), so they must be sized from this count
+        uint32_t getFramesInFlight() const { return m_settings.framesInFlight; }
+        VkPresentModeKHR getPresentMode() const { return m_swapChain->getPresentMode(); } // The one actually used, after fallbacks
+
+        // Recreates the swapchain with these settings. Can't be called during a frame
+        // Other systems size their per frame resources when they are created, so the number of frames in flight should only change before that
+        void setSwapChainSettings(const SwapChainSettings& settings);
+
+        // Increased every time the swapchain is recreated, so that resources tied to its images know when to rebuild
+        uint32_t getSwapChainGeneration() const { return m_swapChainGeneration; }
 
         float getAspectRatio() const { return m_swapChain->extentAspectRatio(); }
         bool isFrameInProgress() const { return m_isFrameStarted; }
@@ -31,22 +50,40 @@ namespace OmniV {
             return m_currentFrameIndex;
         }
 
+        uint32_t getImageIndex() const {
+            assert(m_isFrameStarted && "Cannot get image index when frame not in progress");
+            return m_currentImageIndex;
+        }
+
         VkCommandBuffer beginFrame();
         void endFrame();
-        void beginRenderPass(VkCommandBuffer commandBuffer);
+        // With secondary contents, the secondary command buffers record the pass state themselves (recordPassState)
+        void beginRenderPass(VkCommandBuffer commandBuffer, MainPassType type = MainPassType::Single, VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
+        void recordPassState(VkCommandBuffer commandBuffer) const; // Viewport & scissor over the swapchain image
         void endRenderPass(VkCommandBuffer commandBuffer);
 
     private:
         void createCommandBuffers();
         void freeCommandBuffers();
         void recreateSwapChain();
+        void destroyRetiredSwapChains(uint64_t finishedFrames);
+
+        // Swapchain replaced while frames rendered with it were in flight, with its framebuffers and depth images
+        // Owned here rather than by the device's deferred destruction, which only holds handles
+        struct RetiredSwapChain {
+            std::shared_ptr<SwapChain> swapChain;
+            uint64_t releaseFrames; // Destroyed once that many frames are finished: those submitted before it was retired, plus an acquire cycle
+        };
 
         Window& m_window;
         Device& m_device;
         std::unique_ptr<SwapChain> m_swapChain = nullptr;
-        std::vector<VkCommandBuffer> m_commandBuffers;
+        std::vector<RetiredSwapChain> m_retiredSwapChains;
+        SwapChainSettings m_settings;
+        std::vector<VkCommandBuffer> m_commandBuffers; // One per frame in flight
 
         uint32_t m_currentImageIndex;
+        uint32_t m_swapChainGeneration = 0;
         int m_currentFrameIndex = 0;
         bool m_isFrameStarted = false;
     };
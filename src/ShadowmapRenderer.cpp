@@ -1,30 +1,139 @@
 #include "ShadowmapRenderer.hpp"
 
 // std
+#include <algorithm>
 #include <cassert>
+#include <numeric>
 
 namespace OmniV {
 
-	ShadowmapRenderer::ShadowmapRenderer(Device& device, Renderer& renderer)
-		: m_device{ device }, m_renderer{ renderer } {
+	ShadowmapRenderer::ShadowmapRenderer(Device& device, Renderer& renderer, const ShadowmapSettings& settings, bool staticCache)
+		: m_device{ device }, m_renderer{ renderer }, m_hasStaticCache{ staticCache } {
+		m_depthFormat = settings.compactDepth
+			? m_device.findSupportedFormat({ VK_FORMAT_D16_UNORM, VK_FORMAT_D32_SFLOAT, VK_FORMAT_D24_UNORM_S8_UINT }, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)
+			: m_device.findSupportedFormat({ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT }, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+
+		// Of the format actually picked, compact depth falls back to 32 bits when D16 isn't supported
+		m_depthBias = m_depthFormat == VK_FORMAT_D16_UNORM ? settings.compactDepthBias : settings.depthBias;
+
+		packAtlas(settings);
+
+		// Multiview renders view i into layer i, so it needs every cascade to fill the layer of the same index
+		bool layerPerCascade = true;
+		for (uint32_t i = 0; i < SHADOWMAP_CASCADE_COUNT; i++)
+			layerPerCascade &= m_regions[i].layer == i && m_regions[i].resolution == m_layerResolution;
+
+		if (m_device.supportsMultiview() && layerPerCascade)
+			m_layering = ShadowLayering::Multiview;
+		else if (m_device.supportsShaderLayer() && m_device.supportsClipDistance())
+			m_layering = ShadowLayering::Instanced;
+
 		createResources();
-		createRenderPass();
+		createRenderPasses();
+		createFramebuffers();
+		initializeLayouts();
+
+		OV_DEBUG_LOG("Shadow atlas: " << m_layerCount << " layers of " << m_layerResolution << ", " << (getMemorySize() >> 20) << " MB");
 	}
 
 	ShadowmapRenderer::~ShadowmapRenderer() {
-		vkDestroySampler(m_device.device(), m_shadowmapSampler, nullptr);
+		// Frames in flight may still render into or sample the atlas, its handles are copied out for the deferred destruction
+		std::vector<VkFramebuffer> framebuffers{ m_allCascadesFramebuffer };
+		std::vector<VkImageView> imageViews{ m_depthImageView };
+		for (uint32_t i = 0; i < m_layerCount; i++) {
+			framebuffers.push_back(m_depthFramebuffers[i]);
+			framebuffers.push_back(m_staticFramebuffers[i]);
+			imageViews.push_back(m_layerDepthImageViews[i]);
+			imageViews.push_back(m_staticImageViews[i]);
+		}
 
-		for (uint32_t i = 0; i < SHADOWMAP_CASCADE_COUNT; i++)
-			vkDestroyFramebuffer(m_device.device(), m_depthFramebuffers[i], nullptr);
+		m_device.deferDestruction([device = m_device.device(), sampler = m_shadowmapSampler, framebuffers = std::move(framebuffers),
+			imageViews = std::move(imageViews), depthImage = m_depthImage, depthImageMemory = m_depthImageMemory, staticImage = m_staticImage,
+			staticImageMemory = m_staticImageMemory, renderPasses = m_renderPasses]() {
+			vkDestroySampler(device, sampler, nullptr);
 
-		vkDestroyImageView(m_device.device(), m_depthImageView, nullptr);
-		vkDestroyImage(m_device.device(), m_depthImage, nullptr);
-		vkFreeMemory(m_device.device(), m_depthImageMemory, nullptr);
+			for (VkFramebuffer framebuffer : framebuffers)
+				vkDestroyFramebuffer(device, framebuffer, nullptr);
+			for (VkImageView imageView : imageViews)
+				vkDestroyImageView(device, imageView, nullptr);
 
-		vkDestroyRenderPass(m_device.device(), m_renderPass, nullptr);
+			vkDestroyImage(device, depthImage, nullptr);
+			vkFreeMemory(device, depthImageMemory, nullptr);
+
+			vkDestroyImage(device, staticImage, nullptr);
+			vkFreeMemory(device, staticImageMemory, nullptr);
+
+			for (VkRenderPass renderPass : renderPasses)
+				vkDestroyRenderPass(device, renderPass, nullptr);
+		});
 	}
 
-	void ShadowmapRenderer::beginShadowmapRenderPass(VkCommandBuffer commandBuffer, uint32_t cascadeIndex) {
+	void ShadowmapRenderer::packAtlas(const ShadowmapSettings& settings) {
+		const auto& resolutions = settings.cascadeResolutions;
+		m_layerResolution = *std::max_element(resolutions.begin(), resolutions.end());
+		m_layerCount = 0;
+
+		// Largest cascades first. Each one takes the smallest free square that fits it, split in quarters down to its size
+		// Resolutions are powers of two, so squares always split evenly
+		std::array<uint32_t, SHADOWMAP_CASCADE_COUNT> order;
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return resolutions[a] > resolutions[b]; });
+
+		std::vector<ShadowAtlasRegion> freeSquares;
+		for (uint32_t cascadeIndex : order) {
+			uint32_t resolution = resolutions[cascadeIndex];
+
+			auto best = freeSquares.end();
+			for (auto it = freeSquares.begin(); it != freeSquares.end(); it++) {
+				if (it->resolution >= resolution && (best == freeSquares.end() || it->resolution < best->resolution))
+					best = it;
+			}
+
+			ShadowAtlasRegion square;
+			if (best == freeSquares.end()) {
+				square = { m_layerCount++, { 0, 0 }, m_layerResolution };
+			}
+			else {
+				square = *best;
+				freeSquares.erase(best);
+			}
+
+			while (square.resolution > resolution) {
+				int32_t half = static_cast<int32_t>(square.resolution / 2);
+				freeSquares.push_back({ square.layer, { square.offset.x + half, square.offset.y }, square.resolution / 2 });
+				freeSquares.push_back({ square.layer, { square.offset.x, square.offset.y + half }, square.resolution / 2 });
+				freeSquares.push_back({ square.layer, { square.offset.x + half, square.offset.y + half }, square.resolution / 2 });
+				square.resolution /= 2;
+			}
+
+			m_regions[cascadeIndex] = square;
+		}
+	}
+
+	glm::vec4 ShadowmapRenderer::getCascadeAtlasRect(uint32_t cascadeIndex) const {
+		const ShadowAtlasRegion& region = m_regions[cascadeIndex];
+		float layerResolution = static_cast<float>(m_layerResolution);
+
+		return glm::vec4(region.offset.x / layerResolution, region.offset.y / layerResolution, region.resolution / layerResolution, region.resolution / layerResolution);
+	}
+
+	VkRect2D ShadowmapRenderer::getCascadeRect(uint32_t cascadeIndex) const {
+		const ShadowAtlasRegion& region = m_regions[cascadeIndex];
+		return VkRect2D{ region.offset, { region.resolution, region.resolution } };
+	}
+
+	VkDeviceSize ShadowmapRenderer::getMemorySize() const {
+		VkDeviceSize texelSize = 4;
+		if (m_depthFormat == VK_FORMAT_D16_UNORM)
+			texelSize = 2;
+		else if (m_depthFormat == VK_FORMAT_D32_SFLOAT_S8_UINT)
+			texelSize = 8;
+
+		VkDeviceSize imageSize = texelSize * m_layerResolution * m_layerResolution * m_layerCount;
+		return m_hasStaticCache ? 2 * imageSize : imageSize;
+	}
+
+	void ShadowmapRenderer::beginShadowmapRenderPass(VkCommandBuffer commandBuffer, uint32_t cascadeIndex, ShadowPassType type, VkSubpassContents contents) {
 		assert(m_renderer.isFrameInProgress() && "Can't call beginShadowmapRenderPass if frame is not in progress");
 		assert(commandBuffer == m_renderer.getCurrentCommandBuffer() && "Can't begin render pass on command buffer from a different frame");
 
@@ -33,31 +142,73 @@ namespace OmniV {
 
 		VkRenderPassBeginInfo renderPassInfo{};
 		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassInfo.renderPass = getShadowmapRenderPass();
-		renderPassInfo.framebuffer = getFrameBuffer(cascadeIndex);
+		renderPassInfo.renderPass = getShadowmapRenderPass(type);
 
-		renderPassInfo.renderArea.offset = { 0, 0 };
-		renderPassInfo.renderArea.extent = getShadowmapExtent();
+		if (type == ShadowPassType::AllCascades) {
+			assert(m_layering != ShadowLayering::None && "Single pass shadows are not supported by this device");
+			renderPassInfo.framebuffer = m_allCascadesFramebuffer;
+		}
+		else {
+			uint32_t layer = m_regions[cascadeIndex].layer;
+			renderPassInfo.framebuffer = type == ShadowPassType::StaticCache ? m_staticFramebuffers[layer] : m_depthFramebuffers[layer];
+		}
+
+		renderPassInfo.renderArea = getPassRenderArea(cascadeIndex, type);
 
 		renderPassInfo.clearValueCount = 1;
 		renderPassInfo.pClearValues = clearValues.data();
 
-		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, contents);
+
+		if (contents != VK_SUBPASS_CONTENTS_INLINE) {
+			assert(m_pendingClearMask == 0 && "This pass clears its cascades, it can't be recorded in secondary command buffers");
+			return;
+		}
+
+		recordPassState(commandBuffer, cascadeIndex, type);
+
+		// Cascades that share layers can't be cleared as whole images, only their rects are
+		if (type == ShadowPassType::AllCascades && m_pendingClearMask != 0) {
+			VkClearAttachment clearAttachment{};
+			clearAttachment.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+			clearAttachment.clearValue.depthStencil = { 1.0f, 0 };
+
+			std::array<VkClearRect, SHADOWMAP_CASCADE_COUNT> clearRects{};
+			uint32_t clearRectCount = 0;
+			for (uint32_t i = 0; i < SHADOWMAP_CASCADE_COUNT; i++) {
+				if (m_pendingClearMask & (1u << i))
+					clearRects[clearRectCount++] = { getCascadeRect(i), m_regions[i].layer, 1 };
+			}
+
+			vkCmdClearAttachments(commandBuffer, 1, &clearAttachment, clearRectCount, clearRects.data());
+			m_pendingClearMask = 0;
+		}
+	}
+
+	void ShadowmapRenderer::recordPassState(VkCommandBuffer commandBuffer, uint32_t cascadeIndex, ShadowPassType type) const {
+		VkRect2D renderArea = getPassRenderArea(cascadeIndex, type);
 
 		VkViewport viewport{};
-		viewport.x = 0.0f;
-		viewport.y = 0.0f;
-		viewport.width = static_cast<float>(getShadowmapExtent().width);
-		viewport.height = static_cast<float>(getShadowmapExtent().height);
+		viewport.x = static_cast<float>(renderArea.offset.x);
+		viewport.y = static_cast<float>(renderArea.offset.y);
+		viewport.width = static_cast<float>(renderArea.extent.width);
+		viewport.height = static_cast<float>(renderArea.extent.height);
 		viewport.minDepth = 0.0f;
 		viewport.maxDepth = 1.0f;
-		VkRect2D scissor{ {0, 0}, getShadowmapExtent() };
 		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+		vkCmdSetScissor(commandBuffer, 0, 1, &renderArea);
 
 		// Set depth bias (aka "Polygon offset")
 		// Required to avoid shadow mapping artifacts
-		vkCmdSetDepthBias(commandBuffer, 1.25f, 0.0f, 1.75f);
+		vkCmdSetDepthBias(commandBuffer, m_depthBias.constantFactor, 0.0f, m_depthBias.slopeFactor);
+	}
+
+	// Single cascade passes are restricted to the cascade's region, so that clears leave the other cascades of the layer alone
+	VkRect2D ShadowmapRenderer::getPassRenderArea(uint32_t cascadeIndex, ShadowPassType type) const {
+		if (type == ShadowPassType::AllCascades)
+			return { { 0, 0 }, getLayerExtent() };
+
+		return getCascadeRect(cascadeIndex);
 	}
 
 	void ShadowmapRenderer::endCurrentRenderPass(VkCommandBuffer commandBuffer) {
@@ -67,25 +218,194 @@ namespace OmniV {
 		vkCmdEndRenderPass(commandBuffer);
 	}
 
-	void ShadowmapRenderer::createResources() {
-		// Shadowmap depth buffer
+	bool ShadowmapRenderer::updateStaticCache(uint32_t cascadeIndex, const glm::mat4& cascadeMat, uint64 staticCastersHash) {
+		assert(m_hasStaticCache && "The static cache was not allocated");
+		StaticCacheState& state = m_staticCacheStates[cascadeIndex];
+
+		// Cascades are snapped to texels, so the matrix only really changes when the light rotates or the cascade moves by whole texels
+		// The tolerance absorbs float noise from recomputing the same matrix
+		bool matrixChanged = false;
+		for (int column = 0; column < 4; column++)
+			matrixChanged |= glm::any(glm::greaterThan(glm::abs(cascadeMat[column] - state.cascadeMat[column]), glm::vec4(1e-5f)));
+
+		if (state.valid && !matrixChanged && state.staticCastersHash == staticCastersHash)
+			return false;
+
+		state.cascadeMat = cascadeMat;
+		state.staticCastersHash = staticCastersHash;
+		state.valid = true;
+
+		return true;
+	}
+
+	void ShadowmapRenderer::copyStaticLayer(VkCommandBuffer commandBuffer, uint32_t cascadeIndex) {
+		// The layer was last sampled by the main pass, or written by another cascade's pass this frame
+		transitionLayers(commandBuffer, m_depthImage, 1u << m_regions[cascadeIndex].layer,
+			VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+
+		copyStaticRegion(commandBuffer, cascadeIndex);
+	}
+
+	void ShadowmapRenderer::copyStaticRegion(VkCommandBuffer commandBuffer, uint32_t cascadeIndex) {
+		assert(m_staticCacheStates[cascadeIndex].valid && "Static cache region was never rendered");
+
+		const ShadowAtlasRegion& region = m_regions[cascadeIndex];
+
+		VkImageSubresourceLayers layer{};
+		layer.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+		layer.mipLevel = 0;
+		layer.baseArrayLayer = region.layer;
+		layer.layerCount = 1;
+
+		VkImageCopy copyRegion{};
+		copyRegion.srcSubresource = layer;
+		copyRegion.srcOffset = { region.offset.x, region.offset.y, 0 };
+		copyRegion.dstSubresource = layer;
+		copyRegion.dstOffset = copyRegion.srcOffset;
+		copyRegion.extent = { region.resolution, region.resolution, 1 };
+
+		vkCmdCopyImage(commandBuffer, m_staticImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, m_depthImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+	}
+
+	void ShadowmapRenderer::prepareAllCascades(VkCommandBuffer commandBuffer, uint32_t cascadeMask, bool fromStaticCache) {
+		const uint32_t allLayers = (1u << m_layerCount) - 1;
+
+		uint32_t updatedLayers = 0;
+		for (uint32_t i = 0; i < SHADOWMAP_CASCADE_COUNT; i++)
+			if (cascadeMask & (1u << i))
+				updatedLayers |= 1u << m_regions[i].layer;
+
+		// Copies go through transfers. So do clears with multiview, where each cascade owns its layer. Otherwise clears happen in the pass
+		uint32_t transferredLayers = 0;
+		if (fromStaticCache || m_layering == ShadowLayering::Multiview) {
+			transitionLayers(commandBuffer, m_depthImage, updatedLayers,
+				VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+
+			for (uint32_t i = 0; i < SHADOWMAP_CASCADE_COUNT; i++) {
+				if (!(cascadeMask & (1u << i)))
+					continue;
+
+				if (fromStaticCache) {
+					copyStaticRegion(commandBuffer, i);
+				}
+				else {
+					VkImageSubresourceRange range{ VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, m_regions[i].layer, 1 };
+					VkClearDepthStencilValue clearValue{ 1.0f, 0 };
+					vkCmdClearDepthStencilImage(commandBuffer, m_depthImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clearValue, 1, &range);
+				}
+			}
+
+			transferredLayers = updatedLayers;
+		}
+		else {
+			m_pendingClearMask = cascadeMask;
+		}
+
+		transitionLayers(commandBuffer, m_depthImage, transferredLayers,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT);
+
+		transitionLayers(commandBuffer, m_depthImage, allLayers & ~transferredLayers,
+			VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+			VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT);
+	}
+
+	void ShadowmapRenderer::transitionLayers(VkCommandBuffer commandBuffer, VkImage image, uint32_t layerMask, VkImageLayout oldLayout, VkImageLayout newLayout,
+		VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+		std::array<VkImageMemoryBarrier, SHADOWMAP_CASCADE_COUNT> barriers{};
+		uint32_t barrierCount = 0;
+
+		for (uint32_t layer = 0; layer < m_layerCount; layer++) {
+			if (!(layerMask & (1u << layer)))
+				continue;
+
+			VkImageMemoryBarrier& barrier = barriers[barrierCount++];
+			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			barrier.srcAccessMask = srcAccess;
+			barrier.dstAccessMask = dstAccess;
+			barrier.oldLayout = oldLayout;
+			barrier.newLayout = newLayout;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.image = image;
+			barrier.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, layer, 1 };
+		}
+
+		if (barrierCount > 0)
+			vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, barrierCount, barriers.data());
+	}
+
+	// Cascades share layers, so no pass can start from an undefined layout and discard its neighbours: layers are given their resting layout once
+	void ShadowmapRenderer::initializeLayouts() {
+		const uint32_t allLayers = (1u << m_layerCount) - 1;
+
+		VkCommandBuffer commandBuffer = m_device.beginSingleTimeCommands();
+
+		transitionLayers(commandBuffer, m_depthImage, allLayers, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+		if (m_hasStaticCache) {
+			transitionLayers(commandBuffer, m_staticImage, allLayers, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, 0);
+		}
+
+		m_device.endSingleTimeCommands(commandBuffer);
+	}
+
+	void ShadowmapRenderer::createDepthImage(VkImageUsageFlags usage, VkImage& image, VkDeviceMemory& imageMemory) {
 		VkImageCreateInfo imageInfo{};
 		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
 		imageInfo.imageType = VK_IMAGE_TYPE_2D;
-		imageInfo.extent.width = SHADOWMAP_RES;
-		imageInfo.extent.height = SHADOWMAP_RES;
+		imageInfo.extent.width = m_layerResolution;
+		imageInfo.extent.height = m_layerResolution;
 		imageInfo.extent.depth = 1;
 		imageInfo.mipLevels = 1;
-		imageInfo.arrayLayers = SHADOWMAP_CASCADE_COUNT;
+		imageInfo.arrayLayers = m_layerCount;
 		imageInfo.format = findDepthFormat();
 		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
 		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		imageInfo.usage = usage;
 		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
 		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 		imageInfo.flags = 0;
 
-		m_device.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_depthImage, m_depthImageMemory);
+		m_device.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, imageMemory);
+	}
+
+	// Image view of a single layer of the depth array, used to render to that layer
+	VkImageView ShadowmapRenderer::createLayerImageView(VkImage image, uint32_t layer) {
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = findDepthFormat();
+		viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+		viewInfo.subresourceRange.baseMipLevel = 0;
+		viewInfo.subresourceRange.levelCount = 1;
+		viewInfo.subresourceRange.baseArrayLayer = layer;
+		viewInfo.subresourceRange.layerCount = 1;
+
+		VkImageView imageView;
+		if (vkCreateImageView(m_device.device(), &viewInfo, nullptr, &imageView) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create texture image view!");
+		}
+
+		return imageView;
+	}
+
+	void ShadowmapRenderer::createResources() {
+		// Shadowmap depth buffer. Transfer dst for the copies from the static cache and the clears
+		createDepthImage(VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, m_depthImage, m_depthImageMemory);
+
+		// Static casters cache
+		if (m_hasStaticCache)
+			createDepthImage(VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, m_staticImage, m_staticImageMemory);
 
 		VkImageViewCreateInfo viewInfo{};
 		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -96,38 +416,28 @@ namespace OmniV {
 		viewInfo.subresourceRange.baseMipLevel = 0;
 		viewInfo.subresourceRange.levelCount = 1;
 		viewInfo.subresourceRange.baseArrayLayer = 0;
-		viewInfo.subresourceRange.layerCount = SHADOWMAP_CASCADE_COUNT;
+		viewInfo.subresourceRange.layerCount = m_layerCount;
 
 		if (vkCreateImageView(m_device.device(), &viewInfo, nullptr, &m_depthImageView) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create texture image view!");
 		}
 
-		// One image per cascade
-		for (uint32_t i = 0; i < SHADOWMAP_CASCADE_COUNT; i++) {
-			// Image view for this cascade's layer (inside the depth map)
-			// This view is used to render to that specific depth image layer
-			VkImageViewCreateInfo viewInfo{};
-			viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-			viewInfo.image = m_depthImage;
-			viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-			viewInfo.format = findDepthFormat();
-			viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-			viewInfo.subresourceRange.baseMipLevel = 0;
-			viewInfo.subresourceRange.levelCount = 1;
-			viewInfo.subresourceRange.baseArrayLayer = i;
-			viewInfo.subresourceRange.layerCount = 1;
-
-			if (vkCreateImageView(m_device.device(), &viewInfo, nullptr, &m_cascadesDepthImageViews[i]) != VK_SUCCESS) {
-				throw std::runtime_error("failed to create texture image view!");
-			}
+		// One view per layer
+		for (uint32_t i = 0; i < m_layerCount; i++) {
+			m_layerDepthImageViews[i] = createLayerImageView(m_depthImage, i);
+			if (m_hasStaticCache)
+				m_staticImageViews[i] = createLayerImageView(m_staticImage, i);
 		}
 
 		// Create sampler to sample from to depth attachment
-		// Used to sample in the fragment shader for shadowed rendering
+		// Used to sample in the fragment shader for shadowed rendering. Comparison sampler: linear filtering blends the results
+		// of the 4 nearest comparisons (hardware 2x2 PCF)
+		VkFilter filter = m_device.isFormatSupported(m_depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+
 		VkSamplerCreateInfo samplerInfo{};
 		samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-		samplerInfo.magFilter = VK_FILTER_NEAREST; // Choosing linear or nearest depending on if DEPTH_FORMAT supports linear or not
-		samplerInfo.minFilter = VK_FILTER_NEAREST;
+		samplerInfo.magFilter = filter;
+		samplerInfo.minFilter = filter;
 		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
 		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
 		samplerInfo.addressModeV = samplerInfo.addressModeU;
@@ -137,23 +447,41 @@ namespace OmniV {
 		samplerInfo.minLod = 0.0f;
 		samplerInfo.maxLod = 1.0f;
 		samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+		samplerInfo.compareEnable = VK_TRUE;
+		samplerInfo.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL; // Lit if the fragment is not further than the stored depth
 
 		if (vkCreateSampler(m_device.device(), &samplerInfo, nullptr, &m_shadowmapSampler) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create sampler!");
 		}
 	}
 
-	void ShadowmapRenderer::createRenderPass() {
-		// Attachments
+	void ShadowmapRenderer::createRenderPasses() {
+		for (size_t i = 0; i < m_renderPasses.size(); i++) {
+			ShadowPassType type = static_cast<ShadowPassType>(i);
+			m_renderPasses[i] = type == ShadowPassType::AllCascades && m_layering == ShadowLayering::None ? VK_NULL_HANDLE : createRenderPass(type);
+		}
+	}
+
+	VkRenderPass ShadowmapRenderer::createRenderPass(ShadowPassType type) {
+		const bool loadContents = type == ShadowPassType::Dynamic || type == ShadowPassType::AllCascades;
+		const bool toTransfer = type == ShadowPassType::StaticCache;
+
+		// Attachments. Layers are never in an undefined layout (see initializeLayouts), and clears only touch the render area
 		VkAttachmentDescription depthAttachment{};
 		depthAttachment.format = findDepthFormat();
 		depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-		depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		depthAttachment.loadOp = loadContents ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
 		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 		depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+		depthAttachment.finalLayout = toTransfer ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+		switch (type) {
+		case ShadowPassType::StaticCache: depthAttachment.initialLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL; break;
+		case ShadowPassType::Dynamic: depthAttachment.initialLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL; break;
+		case ShadowPassType::AllCascades: depthAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL; break; // Set by prepareAllCascades()
+		default: depthAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL; break;
+		}
 
 		VkAttachmentReference depthAttachmentRef{};
 		depthAttachmentRef.attachment = 0;
@@ -168,12 +496,13 @@ namespace OmniV {
 		// Dependencies
 		std::array<VkSubpassDependency, 2> dependencies;
 
+		// Previous readers (main pass) and writers (other cascades of the same layer)
 		dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
 		dependencies[0].dstSubpass = 0;
-		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-		dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-		dependencies[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
-		dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependencies[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 		dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
 		dependencies[1].srcSubpass = 0;
@@ -184,6 +513,31 @@ namespace OmniV {
 		dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 		dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
+		// The static cache is written after (and copied from by) previous frames' transfers, and copied from right after
+		if (toTransfer) {
+			dependencies[0].srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+			dependencies[0].srcAccessMask = 0;
+			dependencies[0].dependencyFlags = 0;
+
+			dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+			dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			dependencies[1].dependencyFlags = 0;
+		}
+
+		// Dynamic casters go on top of the copied static region
+		if (type == ShadowPassType::Dynamic) {
+			dependencies[0].srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+			dependencies[0].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			dependencies[0].dependencyFlags = 0;
+		}
+
+		// prepareAllCascades() already synchronizes with the transfers and the previous main pass
+		if (type == ShadowPassType::AllCascades) {
+			dependencies[0].srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+			dependencies[0].srcAccessMask = 0;
+			dependencies[0].dependencyFlags = 0;
+		}
+
 		VkRenderPassCreateInfo renderPassInfo = {};
 		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
 		renderPassInfo.attachmentCount = 1;
@@ -193,30 +547,70 @@ namespace OmniV {
 		renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
 		renderPassInfo.pDependencies = dependencies.data();
 
-		if (vkCreateRenderPass(m_device.device(), &renderPassInfo, nullptr, &m_renderPass) != VK_SUCCESS) {
+		// Every view renders into the layer of the same index
+		const uint32_t viewMask = (1u << SHADOWMAP_CASCADE_COUNT) - 1;
+		VkRenderPassMultiviewCreateInfo multiviewInfo{};
+		multiviewInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO;
+		multiviewInfo.subpassCount = 1;
+		multiviewInfo.pViewMasks = &viewMask;
+
+		if (type == ShadowPassType::AllCascades && m_layering == ShadowLayering::Multiview)
+			renderPassInfo.pNext = &multiviewInfo;
+
+		VkRenderPass renderPass;
+		if (vkCreateRenderPass(m_device.device(), &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create render pass!");
 		}
 
+		return renderPass;
+	}
+
+	void ShadowmapRenderer::createFramebuffers() {
 		// Create shadowmap depth FBO
-		// One framebuffer per cascade
-		for (uint32_t i = 0; i < SHADOWMAP_CASCADE_COUNT; i++) {
+		// One framebuffer per atlas layer, plus one per static cache layer
+		for (uint32_t i = 0; i < m_layerCount; i++) {
 			VkFramebufferCreateInfo framebufferInfo = {};
 			framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-			framebufferInfo.renderPass = m_renderPass;
+			framebufferInfo.renderPass = getShadowmapRenderPass();
 			framebufferInfo.attachmentCount = 1;
-			framebufferInfo.pAttachments = &m_cascadesDepthImageViews[i];
-			framebufferInfo.width = SHADOWMAP_RES;
-			framebufferInfo.height = SHADOWMAP_RES;
+			framebufferInfo.pAttachments = &m_layerDepthImageViews[i];
+			framebufferInfo.width = m_layerResolution;
+			framebufferInfo.height = m_layerResolution;
 			framebufferInfo.layers = 1;
 
 			if (vkCreateFramebuffer(m_device.device(), &framebufferInfo, nullptr, &m_depthFramebuffers[i]) != VK_SUCCESS) {
 				throw std::runtime_error("failed to create framebuffer!");
 			}
+
+			if (!m_hasStaticCache)
+				continue;
+
+			framebufferInfo.renderPass = getShadowmapRenderPass(ShadowPassType::StaticCache);
+			framebufferInfo.pAttachments = &m_staticImageViews[i];
+
+			if (vkCreateFramebuffer(m_device.device(), &framebufferInfo, nullptr, &m_staticFramebuffers[i]) != VK_SUCCESS) {
+				throw std::runtime_error("failed to create framebuffer!");
+			}
+		}
+
+		// Whole array. Multiview framebuffers have a single layer, the views map to the attachment's layers
+		if (m_layering != ShadowLayering::None) {
+			VkFramebufferCreateInfo framebufferInfo = {};
+			framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+			framebufferInfo.renderPass = getShadowmapRenderPass(ShadowPassType::AllCascades);
+			framebufferInfo.attachmentCount = 1;
+			framebufferInfo.pAttachments = &m_depthImageView;
+			framebufferInfo.width = m_layerResolution;
+			framebufferInfo.height = m_layerResolution;
+			framebufferInfo.layers = m_layering == ShadowLayering::Multiview ? 1 : m_layerCount;
+
+			if (vkCreateFramebuffer(m_device.device(), &framebufferInfo, nullptr, &m_allCascadesFramebuffer) != VK_SUCCESS) {
+				throw std::runtime_error("failed to create framebuffer!");
+			}
 		}
 	}
 
 	VkFormat ShadowmapRenderer::findDepthFormat() {
-		return m_device.findSupportedFormat({ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT },
-			VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+		return m_depthFormat;
 	}
 }
\ No newline at end of file
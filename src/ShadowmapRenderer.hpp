@@ -2,51 +2,152 @@
 
 #include "Renderer.hpp"
 #include "Device.hpp"
+#include "FrameInfo.hpp"
 #include "Window.hpp"
 
 // std
 #include <cassert>
 
 namespace OmniV {
+
+    // Render passes over a cascade. Apart from AllCascades with multiview, they are all compatible, so the shadowmap pipeline works with any of them
+    enum class ShadowPassType {
+        Full = 0, // Clears the cascade and draws every caster
+        StaticCache, // Clears the cascade's static cache region, left ready to be copied
+        Dynamic, // Loads the cascade after copyStaticLayer(), to draw the dynamic casters on top
+        AllCascades, // Loads every cascade after prepareAllCascades(), to draw them all at once (see ShadowLayering)
+        Count
+    };
+
+    // How the AllCascades pass reaches each cascade, depending on what the device supports
+    enum class ShadowLayering {
+        None, // No single pass support, one pass per cascade
+        Multiview, // One view per cascade, the vertex shader picks the cascade matrix with gl_ViewIndex. Needs one atlas layer per cascade
+        Instanced, // One instance per cascade, the vertex shader writes gl_Layer and moves the cascade into its region (clip distances keep it there)
+    };
+
+    // Where a cascade lives in the shadow atlas
+    struct ShadowAtlasRegion {
+        uint32_t layer = 0;
+        VkOffset2D offset{ 0, 0 };
+        uint32_t resolution = 0;
+    };
+
+    /// <summary>
+    /// <para> Renders the shadow cascades into a depth atlas </para>
+    /// <para> Each cascade has its own resolution. They are packed into the layers of a depth array, each layer being as large as the largest cascade,
+    /// so that e.g. 2048/2048/1024/1024 cascades use 3 layers of 2048 instead of 4 layers of the largest resolution </para>
+    /// <para> Static casters can be cached: each cascade keeps a second depth region with only the static casters, which is re-rendered
+    /// when the cascade matrix or the static casters change. Every frame that region is copied into the cascade, and only the dynamic casters are drawn </para>
+    /// <para> Where the device allows it, all cascades can also be drawn in a single pass over the whole array, which submits each caster once instead of once per cascade </para>
+    /// </summary>
     class ShadowmapRenderer {
     public:
-        ShadowmapRenderer(Device& device, Renderer& renderer);
+        // "staticCache": allocates the static casters cache (only worth it if some casters are static)
+        ShadowmapRenderer(Device& device, Renderer& renderer, const ShadowmapSettings& settings, bool staticCache);
         ~ShadowmapRenderer();
 
         ShadowmapRenderer(const ShadowmapRenderer&) = delete;
         ShadowmapRenderer& operator=(const ShadowmapRenderer&) = delete;
 
-        VkRenderPass getShadowmapRenderPass() const { return m_renderPass; }
+        VkRenderPass getShadowmapRenderPass(ShadowPassType type = ShadowPassType::Full) const { return m_renderPasses[static_cast<size_t>(type)]; }
 
+        VkImage getShadowmapImage() const { return m_depthImage; }
+        VkImage getStaticCacheImage() const { return m_staticImage; } // VK_NULL_HANDLE without static cache
         VkImageView getShadowmapImageView() const { return m_depthImageView; }
         VkSampler getShadowmapSampler() const { return m_shadowmapSampler; }
 
-        void beginShadowmapRenderPass(VkCommandBuffer commandBuffer, uint32_t cascadeIndex);
+        ShadowLayering getLayering() const { return m_layering; }
+
+        const ShadowAtlasRegion& getCascadeRegion(uint32_t cascadeIndex) const { return m_regions[cascadeIndex]; }
+        glm::vec4 getCascadeAtlasRect(uint32_t cascadeIndex) const; // uv offset (xy) and scale (zw) of the cascade in its layer
+
+        VkDeviceSize getMemorySize() const; // Bytes of depth images
+
+        // "cascadeIndex" is ignored by the AllCascades pass
+        // With secondary contents, the secondary command buffers record the pass state themselves (recordPassState). The AllCascades pass
+        // without multiview clears its cascades in the pass, so it has to be recorded inline
+        void beginShadowmapRenderPass(VkCommandBuffer commandBuffer, uint32_t cascadeIndex, ShadowPassType type = ShadowPassType::Full,
+            VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
+        void recordPassState(VkCommandBuffer commandBuffer, uint32_t cascadeIndex, ShadowPassType type) const; // Viewport, scissor & depth bias
         void endCurrentRenderPass(VkCommandBuffer commandBuffer);
 
+        // Returns true if the static cache of "cascadeIndex" is out of date for this cascade matrix and set of static casters ("staticCastersHash"),
+        // in which case it must be re-rendered (StaticCache pass) this frame
+        bool updateStaticCache(uint32_t cascadeIndex, const glm::mat4& cascadeMat, uint64 staticCastersHash);
+
+        // Copies the static cache region into the cascade. Must be followed by a Dynamic pass over the same cascade
+        void copyStaticLayer(VkCommandBuffer commandBuffer, uint32_t cascadeIndex);
+
+        // Resets the cascades of "cascadeMask" (cleared, or copied from their static cache region), and transitions the atlas for the AllCascades pass
+        // Cascades outside of the mask keep their contents
+        void prepareAllCascades(VkCommandBuffer commandBuffer, uint32_t cascadeMask, bool fromStaticCache);
+
         VkFormat findDepthFormat();
-    
+
     private:
+        void packAtlas(const ShadowmapSettings& settings);
+
         void createResources();
-        void createRenderPass();
+        void createRenderPasses();
+        VkRenderPass createRenderPass(ShadowPassType type);
+        void createFramebuffers();
 
-        VkFramebuffer getFrameBuffer(int cascadeIndex) { return m_depthFramebuffers[cascadeIndex]; }
-        VkExtent2D getShadowmapExtent() { return VkExtent2D{ SHADOWMAP_RES, SHADOWMAP_RES }; }
+        void createDepthImage(VkImageUsageFlags usage, VkImage& image, VkDeviceMemory& imageMemory);
+        VkImageView createLayerImageView(VkImage image, uint32_t layer);
+        void initializeLayouts();
+
+        // Moves every layer of "layerMask" between layouts, as a whole (cascades sharing a layer are transitioned together)
+        void transitionLayers(VkCommandBuffer commandBuffer, VkImage image, uint32_t layerMask, VkImageLayout oldLayout, VkImageLayout newLayout,
+            VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+        void copyStaticRegion(VkCommandBuffer commandBuffer, uint32_t cascadeIndex);
+
+        VkRect2D getCascadeRect(uint32_t cascadeIndex) const;
+        VkRect2D getPassRenderArea(uint32_t cascadeIndex, ShadowPassType type) const;
+        VkExtent2D getLayerExtent() const { return VkExtent2D{ m_layerResolution, m_layerResolution }; }
 
         Device& m_device;
         Renderer& m_renderer;
 
-        // Shadowmap pass
-        VkRenderPass m_renderPass;
+        ShadowLayering m_layering = ShadowLayering::None;
+        VkFormat m_depthFormat;
+        DepthBias m_depthBias; // Of m_depthFormat
+
+        // Atlas layout
+        std::array<ShadowAtlasRegion, SHADOWMAP_CASCADE_COUNT> m_regions;
+        uint32_t m_layerResolution = 0;
+        uint32_t m_layerCount = 0;
 
-        // Shadowmap pass resources
-        VkFramebuffer m_depthFramebuffers[SHADOWMAP_CASCADE_COUNT];
+        // Shadowmap passes
+        std::array<VkRenderPass, static_cast<size_t>(ShadowPassType::Count)> m_renderPasses;
+
+        // Shadowmap pass resources, one framebuffer per atlas layer
+        VkFramebuffer m_depthFramebuffers[SHADOWMAP_CASCADE_COUNT]{};
+        VkFramebuffer m_allCascadesFramebuffer = VK_NULL_HANDLE; // Over the whole array
 
         VkImage m_depthImage;
         VkDeviceMemory m_depthImageMemory;
         VkImageView m_depthImageView;
-        VkImageView m_cascadesDepthImageViews[SHADOWMAP_CASCADE_COUNT];
+        VkImageView m_layerDepthImageViews[SHADOWMAP_CASCADE_COUNT]{};
 
         VkSampler m_shadowmapSampler;
+
+        // AllCascades pass without multiview: cascades are cleared in the pass, only within their region
+        uint32_t m_pendingClearMask = 0;
+
+        // Static casters cache, same layout as the atlas. Always in TRANSFER_SRC_OPTIMAL outside of its render pass
+        bool m_hasStaticCache;
+        VkFramebuffer m_staticFramebuffers[SHADOWMAP_CASCADE_COUNT]{};
+
+        VkImage m_staticImage = VK_NULL_HANDLE;
+        VkDeviceMemory m_staticImageMemory = VK_NULL_HANDLE;
+        VkImageView m_staticImageViews[SHADOWMAP_CASCADE_COUNT]{};
+
+        struct StaticCacheState {
+            glm::mat4 cascadeMat{ 0.f };
+            uint64 staticCastersHash = 0;
+            bool valid = false;
+        };
+        std::array<StaticCacheState, SHADOWMAP_CASCADE_COUNT> m_staticCacheStates;
     };
 }
\ No newline at end of file
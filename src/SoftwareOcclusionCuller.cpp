@@ -0,0 +1,345 @@
+#include "SoftwareOcclusionCuller.hpp"
+#include "Utils.hpp"
+
+// std
+#include <cassert>
+#include <atomic>
+#include <chrono>
+#include <numeric>
+#include <tuple>
+
+namespace OmniV {
+
+	// Vertices closer than this to the camera plane can't be projected. Skipping their triangles only makes culling less aggressive
+	static constexpr float MIN_CLIP_W = 1e-4f;
+
+	// Objects tested per job
+	static constexpr uint32 CULL_BATCH_SIZE = 256;
+
+	SoftwareOcclusionCuller::SoftwareOcclusionCuller(JobSystem& jobSystem) : m_jobSystem{ jobSystem } {
+		static_assert(WIDTH % TILE_WIDTH == 0 && HEIGHT % TILE_HEIGHT == 0, "Depth buffer has to be made of whole tiles");
+		static_assert(TILE_WIDTH % LANES == 0, "Tile rows have to be made of whole lane groups");
+
+		m_depth.resize(WIDTH * HEIGHT, 1.0f);
+		m_tileMaxDepth.fill(1.0f);
+	}
+
+	void SoftwareOcclusionCuller::rasterizeOccluders(GameObject::Map& gameObjects, const glm::mat4& viewProjMat) {
+		const auto startTime = std::chrono::high_resolution_clock::now();
+
+		m_triangles.clear();
+		for (auto& bin : m_tileBins)
+			bin.clear();
+
+		// Transform + bin on this thread, occluders are expected to be a few low poly meshes
+		for (auto& kv : gameObjects) {
+			auto& obj = kv.second;
+
+			if (!obj.m_isOccluder || obj.m_model == nullptr)
+				continue;
+
+			const std::vector<glm::vec3>& positions = obj.m_model->getCpuPositions();
+			const std::vector<uint32_t>& indices = obj.m_model->getCpuIndices();
+
+			assert(!positions.empty() && "Occluder models have to be created with keepCpuGeometry");
+
+			glm::mat4 mvpMat = viewProjMat * obj.m_transform.mat4();
+
+			m_clipW.resize(positions.size());
+			m_screenVertices.resize(positions.size());
+			for (size_t i = 0; i < positions.size(); i++) {
+				glm::vec4 clip = mvpMat * glm::vec4(positions[i], 1.f);
+				m_clipW[i] = clip.w;
+
+				if (clip.w < MIN_CLIP_W)
+					continue;
+
+				glm::vec3 ndc = glm::vec3(clip) / clip.w;
+				m_screenVertices[i] = glm::vec3((ndc.x * 0.5f + 0.5f) * WIDTH, (ndc.y * 0.5f + 0.5f) * HEIGHT, ndc.z);
+			}
+
+			findInteriorEdges(positions, indices);
+
+			for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+				if (!isProjected(indices, static_cast<uint32>(i / 3)))
+					continue;
+
+				binTriangle({ m_screenVertices[indices[i]], m_screenVertices[indices[i + 1]], m_screenVertices[indices[i + 2]], m_interiorEdges[i / 3] });
+			}
+		}
+
+		m_stats.occluderTriangles = static_cast<uint32>(m_triangles.size());
+
+		rasterizeBins();
+
+		const auto endTime = std::chrono::high_resolution_clock::now();
+		m_stats.rasterizationTime = std::chrono::duration<float, std::chrono::milliseconds::period>(endTime - startTime).count();
+	}
+
+	bool SoftwareOcclusionCuller::isProjected(const std::vector<uint32_t>& indices, uint32 triangle) const {
+		return m_clipW[indices[triangle * 3]] >= MIN_CLIP_W && m_clipW[indices[triangle * 3 + 1]] >= MIN_CLIP_W && m_clipW[indices[triangle * 3 + 2]] >= MIN_CLIP_W;
+	}
+
+	void SoftwareOcclusionCuller::findInteriorEdges(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices) {
+		// Vertices are matched by position, meshes duplicate them along their UV and normal seams
+		m_vertexIds.resize(positions.size());
+		m_sortedVertices.resize(positions.size());
+		std::iota(m_sortedVertices.begin(), m_sortedVertices.end(), 0u);
+		std::sort(m_sortedVertices.begin(), m_sortedVertices.end(), [&](uint32 a, uint32 b) {
+			return std::tie(positions[a].x, positions[a].y, positions[a].z) < std::tie(positions[b].x, positions[b].y, positions[b].z);
+		});
+
+		for (size_t i = 0; i < m_sortedVertices.size(); i++) {
+			const uint32 vertex = m_sortedVertices[i];
+			const uint32 previous = i > 0 ? m_sortedVertices[i - 1] : vertex;
+			m_vertexIds[vertex] = (i > 0 && positions[previous] == positions[vertex]) ? m_vertexIds[previous] : vertex;
+		}
+
+		// Every edge, keyed by its two vertex IDs. Edge e of a triangle is the one opposite to its vertex e
+		const uint32 triangleCount = static_cast<uint32>(indices.size() / 3);
+		m_edges.clear();
+		for (uint32 t = 0; t < triangleCount; t++) {
+			for (uint32 e = 0; e < 3; e++) {
+				const uint64 a = m_vertexIds[indices[t * 3 + (e + 1) % 3]];
+				const uint64 b = m_vertexIds[indices[t * 3 + (e + 2) % 3]];
+				m_edges.push_back({ (std::min(a, b) << 32) | std::max(a, b), t * 3 + e });
+			}
+		}
+		std::sort(m_edges.begin(), m_edges.end());
+
+		// An edge is interior when exactly two projected triangles share it and lie on either side of it on screen.
+		// Edges on a fold of the silhouette, on the border of the mesh or shared by more triangles are left to erosion
+		m_interiorEdges.assign(triangleCount, 0);
+		for (size_t first = 0; first < m_edges.size();) {
+			size_t end = first + 1;
+			while (end < m_edges.size() && m_edges[end].first == m_edges[first].first)
+				end++;
+
+			if (end - first == 2) {
+				const uint32 t0 = m_edges[first].second / 3, e0 = m_edges[first].second % 3;
+				const uint32 t1 = m_edges[first + 1].second / 3, e1 = m_edges[first + 1].second % 3;
+
+				if (t0 != t1 && isProjected(indices, t0) && isProjected(indices, t1)) {
+					const glm::vec2 a = m_screenVertices[indices[t0 * 3 + (e0 + 1) % 3]];
+					const glm::vec2 b = m_screenVertices[indices[t0 * 3 + (e0 + 2) % 3]];
+					const glm::vec2 c0 = glm::vec2(m_screenVertices[indices[t0 * 3 + e0]]) - a;
+					const glm::vec2 c1 = glm::vec2(m_screenVertices[indices[t1 * 3 + e1]]) - a;
+
+					const float side0 = (b.x - a.x) * c0.y - (b.y - a.y) * c0.x;
+					const float side1 = (b.x - a.x) * c1.y - (b.y - a.y) * c1.x;
+					if ((side0 > 0.0f && side1 < 0.0f) || (side0 < 0.0f && side1 > 0.0f)) {
+						m_interiorEdges[t0] |= 1u << e0;
+						m_interiorEdges[t1] |= 1u << e1;
+					}
+				}
+			}
+
+			first = end;
+		}
+	}
+
+	void SoftwareOcclusionCuller::binTriangle(const ScreenTriangle& triangle) {
+		glm::vec2 boundsMin = glm::min(glm::vec2(triangle.v0), glm::min(glm::vec2(triangle.v1), glm::vec2(triangle.v2)));
+		glm::vec2 boundsMax = glm::max(glm::vec2(triangle.v0), glm::max(glm::vec2(triangle.v1), glm::vec2(triangle.v2)));
+
+		// Completely off-screen
+		if (boundsMax.x < 0.0f || boundsMax.y < 0.0f || boundsMin.x >= WIDTH || boundsMin.y >= HEIGHT)
+			return;
+
+		// Degenerate (or smaller than what the buffer can resolve)
+		float doubleArea = (triangle.v1.x - triangle.v0.x) * (triangle.v2.y - triangle.v0.y) - (triangle.v1.y - triangle.v0.y) * (triangle.v2.x - triangle.v0.x);
+		if (std::abs(doubleArea) < 1e-6f)
+			return;
+
+		int tileMinX = glm::clamp(static_cast<int>(boundsMin.x) / static_cast<int>(TILE_WIDTH), 0, static_cast<int>(TILES_X) - 1);
+		int tileMinY = glm::clamp(static_cast<int>(boundsMin.y) / static_cast<int>(TILE_HEIGHT), 0, static_cast<int>(TILES_Y) - 1);
+		int tileMaxX = glm::clamp(static_cast<int>(boundsMax.x) / static_cast<int>(TILE_WIDTH), 0, static_cast<int>(TILES_X) - 1);
+		int tileMaxY = glm::clamp(static_cast<int>(boundsMax.y) / static_cast<int>(TILE_HEIGHT), 0, static_cast<int>(TILES_Y) - 1);
+
+		uint32 triangleIndex = static_cast<uint32>(m_triangles.size());
+		m_triangles.push_back(triangle);
+
+		for (int ty = tileMinY; ty <= tileMaxY; ty++)
+			for (int tx = tileMinX; tx <= tileMaxX; tx++)
+				m_tileBins[ty * TILES_X + tx].push_back(triangleIndex);
+	}
+
+	void SoftwareOcclusionCuller::rasterizeBins() {
+		// Every tile is owned by a single job, so no synchronization is needed on the depth buffer
+		JobCounter rasterization;
+		m_jobSystem.parallelFor(TILE_COUNT, 1, [this](uint32 firstTile, uint32 endTile) {
+			for (uint32 tile = firstTile; tile < endTile; tile++)
+				rasterizeTile(tile);
+		}, rasterization, "Rasterize occluder tiles");
+
+		m_jobSystem.wait(rasterization);
+	}
+
+	void SoftwareOcclusionCuller::rasterizeTile(uint32 tileIndex) {
+		float* depth = getTileDepth(tileIndex);
+		std::fill(depth, depth + TILE_SIZE, 1.0f);
+
+		const int tileX = static_cast<int>((tileIndex % TILES_X) * TILE_WIDTH);
+		const int tileY = static_cast<int>((tileIndex / TILES_X) * TILE_HEIGHT);
+
+		for (uint32 triangleIndex : m_tileBins[tileIndex]) {
+			ScreenTriangle t = m_triangles[triangleIndex];
+
+			// Occluders are rasterized double sided: flip clockwise triangles so that the inside of every edge is positive
+			float area = (t.v1.x - t.v0.x) * (t.v2.y - t.v0.y) - (t.v1.y - t.v0.y) * (t.v2.x - t.v0.x);
+			if (area < 0.0f) {
+				std::swap(t.v1, t.v2);
+				t.interiorEdges = (t.interiorEdges & 1u) | ((t.interiorEdges & 2u) << 1) | ((t.interiorEdges & 4u) >> 1);
+				area = -area;
+			}
+
+			// Edge functions E(x, y) = A * x + B * y + C. Edge i is the one opposite to vertex i
+			const float a0 = t.v1.y - t.v2.y, b0 = t.v2.x - t.v1.x, c0 = -(a0 * t.v1.x + b0 * t.v1.y);
+			const float a1 = t.v2.y - t.v0.y, b1 = t.v0.x - t.v2.x, c1 = -(a1 * t.v2.x + b1 * t.v2.y);
+			const float a2 = t.v0.y - t.v1.y, b2 = t.v1.x - t.v0.x, c2 = -(a2 * t.v0.x + b2 * t.v0.y);
+
+			// Coverage is eroded along the silhouette: a pixel is only written when all of its area is on the inner side of the edge,
+			// so that an occludee touching the pixel can't be hidden by the part the occluder doesn't cover. A linear function is minimal
+			// over the pixel at one of its corners, i.e. at the center minus half its gradient magnitudes.
+			// Interior edges are tested at the pixel center, the triangle on the other side covers the rest of the pixel
+			const float o0 = (t.interiorEdges & 1u) ? 0.0f : 0.5f * (std::abs(a0) + std::abs(b0));
+			const float o1 = (t.interiorEdges & 2u) ? 0.0f : 0.5f * (std::abs(a1) + std::abs(b1));
+			const float o2 = (t.interiorEdges & 4u) ? 0.0f : 0.5f * (std::abs(a2) + std::abs(b2));
+
+			// Depth plane, from the barycentric weights E_i / area
+			const float invArea = 1.0f / area;
+			const float za = (t.v0.z * a0 + t.v1.z * a1 + t.v2.z * a2) * invArea;
+			const float zb = (t.v0.z * b0 + t.v1.z * b1 + t.v2.z * b2) * invArea;
+			const float zc = (t.v0.z * c0 + t.v1.z * c1 + t.v2.z * c2) * invArea;
+
+			// Same for the depth: the farthest depth of the occluder over the pixel is stored
+			const float zo = 0.5f * (std::abs(za) + std::abs(zb));
+
+			// Bounding box inside this tile. Columns start at a lane boundary, pixels outside the triangle are masked anyway
+			int minX = std::max(static_cast<int>(std::floor(std::min({ t.v0.x, t.v1.x, t.v2.x }))), tileX);
+			int maxX = std::min(static_cast<int>(std::ceil(std::max({ t.v0.x, t.v1.x, t.v2.x }))), tileX + static_cast<int>(TILE_WIDTH));
+			int minY = std::max(static_cast<int>(std::floor(std::min({ t.v0.y, t.v1.y, t.v2.y }))), tileY);
+			int maxY = std::min(static_cast<int>(std::ceil(std::max({ t.v0.y, t.v1.y, t.v2.y }))), tileY + static_cast<int>(TILE_HEIGHT));
+
+			if (minX >= maxX || minY >= maxY)
+				continue;
+
+			minX = tileX + ((minX - tileX) & ~static_cast<int>(LANES - 1));
+
+			for (int y = minY; y < maxY; y++) {
+				const float py = y + 0.5f;
+				float* row = depth + (y - tileY) * TILE_WIDTH;
+
+				for (int x = minX; x < maxX; x += LANES) {
+					float* lanes = row + (x - tileX);
+
+					for (uint32 k = 0; k < LANES; k++) {
+						const float px = x + k + 0.5f;
+						const float e0 = a0 * px + b0 * py + c0;
+						const float e1 = a1 * px + b1 * py + c1;
+						const float e2 = a2 * px + b2 * py + c2;
+						const float z = za * px + zb * py + zc + zo;
+
+						const bool inside = (e0 >= o0) & (e1 >= o1) & (e2 >= o2);
+						lanes[k] = (inside & (z < lanes[k])) ? z : lanes[k];
+					}
+				}
+			}
+		}
+
+		m_tileMaxDepth[tileIndex] = *std::max_element(depth, depth + TILE_SIZE);
+	}
+
+	void SoftwareOcclusionCuller::cull(RenderQueue& renderQueue, const glm::mat4& viewProjMat) {
+		const auto startTime = std::chrono::high_resolution_clock::now();
+
+		// Packets only flag themselves, batches never write to the same entries
+		std::atomic<uint32> testedObjects{ 0 };
+		std::atomic<uint32> culledObjects{ 0 };
+
+		JobCounter testing;
+		m_jobSystem.parallelFor(renderQueue.size(), CULL_BATCH_SIZE, [&](uint32 firstPacket, uint32 endPacket) {
+			uint32 tested = 0;
+			uint32 culled = 0;
+
+			for (uint32 i = firstPacket; i < endPacket; i++) {
+				const DrawPacket& packet = renderQueue.begin()[i];
+
+				// Occluders can't hide themselves, no need to test them
+				if (packet.object->m_isOccluder)
+					continue;
+
+				glm::vec3 boundsMin, boundsMax;
+				getWorldBounds(packet.object->m_transform.mat4(), packet.model->getBoundsMin(), packet.model->getBoundsMax(), boundsMin, boundsMax);
+
+				tested++;
+
+				if (isOccluded(boundsMin, boundsMax, viewProjMat)) {
+					renderQueue.setCulled(i);
+					culled++;
+				}
+			}
+
+			testedObjects.fetch_add(tested, std::memory_order_relaxed);
+			culledObjects.fetch_add(culled, std::memory_order_relaxed);
+		}, testing, "Test occludees");
+
+		m_jobSystem.wait(testing);
+
+		m_stats.testedObjects = testedObjects.load();
+		m_stats.culledObjects = culledObjects.load();
+
+		const auto endTime = std::chrono::high_resolution_clock::now();
+		m_stats.testTime = std::chrono::duration<float, std::chrono::milliseconds::period>(endTime - startTime).count();
+	}
+
+	bool SoftwareOcclusionCuller::isOccluded(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& viewProjMat) const {
+		glm::vec3 ndcMin{ std::numeric_limits<float>::max() };
+		glm::vec3 ndcMax{ -std::numeric_limits<float>::max() };
+
+		for (int i = 0; i < 8; i++) {
+			glm::vec3 corner{ (i & 1) ? boundsMax.x : boundsMin.x, (i & 2) ? boundsMax.y : boundsMin.y, (i & 4) ? boundsMax.z : boundsMin.z };
+			glm::vec4 clip = viewProjMat * glm::vec4(corner, 1.f);
+
+			// Box crosses the camera plane
+			if (clip.w < MIN_CLIP_W)
+				return false;
+
+			glm::vec3 ndc = glm::vec3(clip) / clip.w;
+			ndcMin = glm::min(ndcMin, ndc);
+			ndcMax = glm::max(ndcMax, ndc);
+		}
+
+		// Off-screen objects are left to frustum culling
+		if (ndcMax.x < -1.0f || ndcMax.y < -1.0f || ndcMin.x > 1.0f || ndcMin.y > 1.0f)
+			return false;
+
+		const int minX = glm::clamp(static_cast<int>(std::floor((ndcMin.x * 0.5f + 0.5f) * WIDTH)), 0, static_cast<int>(WIDTH) - 1);
+		const int minY = glm::clamp(static_cast<int>(std::floor((ndcMin.y * 0.5f + 0.5f) * HEIGHT)), 0, static_cast<int>(HEIGHT) - 1);
+		const int maxX = glm::clamp(static_cast<int>(std::floor((ndcMax.x * 0.5f + 0.5f) * WIDTH)), 0, static_cast<int>(WIDTH) - 1);
+		const int maxY = glm::clamp(static_cast<int>(std::floor((ndcMax.y * 0.5f + 0.5f) * HEIGHT)), 0, static_cast<int>(HEIGHT) - 1);
+
+		const float nearestDepth = ndcMin.z;
+
+		for (int ty = minY / static_cast<int>(TILE_HEIGHT); ty <= maxY / static_cast<int>(TILE_HEIGHT); ty++) {
+			for (int tx = minX / static_cast<int>(TILE_WIDTH); tx <= maxX / static_cast<int>(TILE_WIDTH); tx++) {
+				const uint32 tileIndex = ty * TILES_X + tx;
+
+				// Everything in this tile is closer than the object
+				if (nearestDepth > m_tileMaxDepth[tileIndex])
+					continue;
+
+				const int tileX = tx * TILE_WIDTH;
+				const int tileY = ty * TILE_HEIGHT;
+				const float* depth = getTileDepth(tileIndex);
+
+				for (int y = std::max(minY, tileY); y <= std::min(maxY, tileY + static_cast<int>(TILE_HEIGHT) - 1); y++)
+					for (int x = std::max(minX, tileX); x <= std::min(maxX, tileX + static_cast<int>(TILE_WIDTH) - 1); x++)
+						if (depth[(y - tileY) * TILE_WIDTH + (x - tileX)] >= nearestDepth)
+							return false;
+			}
+		}
+
+		return true;
+	}
+}
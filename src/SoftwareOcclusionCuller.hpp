@@ -0,0 +1,90 @@
+#pragma once
+
+#include "GameObject.hpp"
+#include "JobSystem.hpp"
+#include "RenderQueue.hpp"
+
+namespace OmniV {
+
+	struct SoftwareOcclusionStats {
+		uint32 occluderTriangles = 0;
+		uint32 testedObjects = 0;
+		uint32 culledObjects = 0;
+		float rasterizationTime = 0.0f; // ms
+		float testTime = 0.0f; // ms
+	};
+
+	/// <summary>
+	/// <para> CPU occlusion culling. The meshes flagged as occluders in the scene are rasterized into a small depth buffer,
+	/// and the bounds of every queued object are tested against it before the camera pass records its draws </para>
+	/// <para> Unlike GPU culling, results are available in the same frame, with no readback latency </para>
+	/// <para> The test is conservative: occluder silhouettes are eroded so that only the pixels they cover entirely are written,
+	/// at their farthest depth over the pixel, and an occludee is culled only if every pixel its bounds touch is closer.
+	/// An object peeking past an occluder edge is kept </para>
+	/// <para> The depth buffer is split in tiles that are rasterized in parallel by jobs (a tile is only touched by one job).
+	/// Tiles are stored contiguously and rows are processed 8 pixels at a time with branch-free masks, so that the compiler can vectorize them </para>
+	/// </summary>
+	class SoftwareOcclusionCuller {
+	public:
+		static constexpr uint32 WIDTH = 256;
+		static constexpr uint32 HEIGHT = 128;
+		static constexpr uint32 TILE_WIDTH = 32;
+		static constexpr uint32 TILE_HEIGHT = 16;
+		static constexpr uint32 TILES_X = WIDTH / TILE_WIDTH;
+		static constexpr uint32 TILES_Y = HEIGHT / TILE_HEIGHT;
+		static constexpr uint32 TILE_COUNT = TILES_X * TILES_Y;
+		static constexpr uint32 TILE_SIZE = TILE_WIDTH * TILE_HEIGHT;
+		static constexpr uint32 LANES = 8;
+
+		explicit SoftwareOcclusionCuller(JobSystem& jobSystem);
+
+		SoftwareOcclusionCuller(const SoftwareOcclusionCuller&) = delete;
+		SoftwareOcclusionCuller& operator=(const SoftwareOcclusionCuller&) = delete;
+
+		// Clears the depth buffer and rasterizes every occluder in "gameObjects"
+		void rasterizeOccluders(GameObject::Map& gameObjects, const glm::mat4& viewProjMat);
+
+		// Flags the packets of "renderQueue" that are completely hidden behind the occluders
+		void cull(RenderQueue& renderQueue, const glm::mat4& viewProjMat);
+
+		const SoftwareOcclusionStats& getStats() const { return m_stats; }
+
+	private:
+		// Vertices in depth buffer pixels, z in NDC [0, 1]
+		struct ScreenTriangle {
+			glm::vec3 v0;
+			glm::vec3 v1;
+			glm::vec3 v2;
+			uint32 interiorEdges = 0; // Bit i is set when edge i (opposite to vertex i) is shared with a triangle that covers the other side
+		};
+
+		friend class SoftwareOcclusionCullerTests;
+
+		bool isProjected(const std::vector<uint32_t>& indices, uint32 triangle) const;
+		void findInteriorEdges(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices);
+		void binTriangle(const ScreenTriangle& triangle);
+		void rasterizeBins();
+		void rasterizeTile(uint32 tileIndex);
+		bool isOccluded(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& viewProjMat) const;
+
+		float* getTileDepth(uint32 tileIndex) { return &m_depth[tileIndex * TILE_SIZE]; }
+		const float* getTileDepth(uint32 tileIndex) const { return &m_depth[tileIndex * TILE_SIZE]; }
+
+		std::vector<float> m_depth; // Tile after tile, each tile row after row
+		std::array<float, TILE_COUNT> m_tileMaxDepth;
+
+		// Scratch for the occluder being transformed
+		std::vector<float> m_clipW;
+		std::vector<glm::vec3> m_screenVertices;
+		std::vector<uint32> m_sortedVertices;
+		std::vector<uint32> m_vertexIds;
+		std::vector<std::pair<uint64, uint32>> m_edges; // Vertex IDs, triangle * 3 + edge
+		std::vector<uint8> m_interiorEdges; // Per triangle
+		std::vector<ScreenTriangle> m_triangles;
+		std::array<std::vector<uint32>, TILE_COUNT> m_tileBins; // Indices into m_triangles
+
+		JobSystem& m_jobSystem;
+
+		SoftwareOcclusionStats m_stats;
+	};
+}
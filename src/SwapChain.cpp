@@ -1,30 +1,37 @@
 #include "SwapChain.hpp"
 
 // std
+#include <cassert>
 #include <cstdlib>
 #include <cstring>
 #include <limits>
 
 namespace OmniV {
 
-	SwapChain::SwapChain(Device& device, VkExtent2D extent)
-		: m_device{ device }, m_viewExtent{ extent } {
+	SwapChain::SwapChain(Device& device, VkExtent2D extent, const SwapChainSettings& settings)
+		: m_device{ device }, m_viewExtent{ extent }, m_settings{ settings } {
 		init();
 	}
 
-	SwapChain::SwapChain(Device& device, VkExtent2D extent, std::shared_ptr<SwapChain> previous)
-		: m_device{ device }, m_viewExtent{ extent }, m_oldSwapChain{ previous } {
+	SwapChain::SwapChain(Device& device, VkExtent2D extent, const SwapChainSettings& settings, std::shared_ptr<SwapChain> previous)
+		: m_device{ device }, m_viewExtent{ extent }, m_settings{ settings }, m_oldSwapChain{ previous } {
 		init();
 		m_oldSwapChain = nullptr;
 	}
 
 	void SwapChain::init() {
+		assert(m_settings.framesInFlight >= 1 && m_settings.framesInFlight <= MAX_FRAMES_IN_FLIGHT && "Invalid number of frames in flight");
+
 		createSwapChain();
 		createImageViews();
-		createRenderPass();
+		createRenderPasses();
 		createDepthResources();
 		createFramebuffers();
-		createSyncObjects();
+
+		if (m_oldSwapChain != nullptr && m_oldSwapChain->m_settings.framesInFlight == m_settings.framesInFlight)
+			takeSyncObjects(*m_oldSwapChain);
+		else
+			createSyncObjects();
 	}
 
 	SwapChain::~SwapChain() {
@@ -48,10 +55,12 @@ namespace OmniV {
 			vkDestroyFramebuffer(m_device.device(), framebuffer, nullptr);
 		}
 
-		vkDestroyRenderPass(m_device.device(), m_renderPass, nullptr);
+		for (auto renderPass : m_renderPasses) {
+			vkDestroyRenderPass(m_device.device(), renderPass, nullptr);
+		}
 
-		// cleanup synchronization objects
-		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		// cleanup synchronization objects, unless a newer swapchain took them over
+		for (size_t i = 0; i < m_inFlightFences.size(); i++) {
 			vkDestroySemaphore(m_device.device(), m_renderFinishedSemaphores[i], nullptr);
 			vkDestroySemaphore(m_device.device(), m_imageAvailableSemaphores[i], nullptr);
 			vkDestroyFence(m_device.device(), m_inFlightFences[i], nullptr);
@@ -119,7 +128,7 @@ namespace OmniV {
 
 		auto result = vkQueuePresentKHR(m_device.presentQueue(), &presentInfo);
 
-		m_currentFrame = (m_currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+		m_currentFrame = (m_currentFrame + 1) % m_settings.framesInFlight;
 
 		return result;
 	}
@@ -131,7 +140,8 @@ namespace OmniV {
 		VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
 		VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
 
-		uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
+		// Enough images for every frame in flight to hold one, so that they don't wait on each other
+		uint32_t imageCount = std::max(swapChainSupport.capabilities.minImageCount + 1, m_settings.framesInFlight);
 		if (swapChainSupport.capabilities.maxImageCount > 0 &&
 			imageCount > swapChainSupport.capabilities.maxImageCount) {
 			imageCount = swapChainSupport.capabilities.maxImageCount;
@@ -184,6 +194,7 @@ namespace OmniV {
 
 		m_imageFormat = surfaceFormat.format;
 		m_extent = extent;
+		m_presentMode = presentMode;
 	}
 
 	void SwapChain::createImageViews() {
@@ -207,16 +218,24 @@ namespace OmniV {
 		}
 	}
 
-	void SwapChain::createRenderPass() {
+	void SwapChain::createRenderPasses() {
+		for (size_t i = 0; i < m_renderPasses.size(); i++)
+			m_renderPasses[i] = createRenderPass(static_cast<MainPassType>(i));
+	}
+
+	VkRenderPass SwapChain::createRenderPass(MainPassType type) {
+		const bool loadContents = type == MainPassType::Last;
+		const bool keepContents = type == MainPassType::First;
+
 		VkAttachmentDescription depthAttachment{};
 		depthAttachment.format = findDepthFormat();
 		depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-		depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depthAttachment.loadOp = loadContents ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+		depthAttachment.storeOp = keepContents ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
 		depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		depthAttachment.initialLayout = loadContents ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+		depthAttachment.finalLayout = keepContents ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
 		VkAttachmentReference depthAttachmentRef{};
 		depthAttachmentRef.attachment = 1;
@@ -225,12 +244,12 @@ namespace OmniV {
 		VkAttachmentDescription colorAttachment = {};
 		colorAttachment.format = getSwapChainImageFormat();
 		colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-		colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		colorAttachment.loadOp = loadContents ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
 		colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 		colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 		colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-		colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		colorAttachment.initialLayout = loadContents ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+		colorAttachment.finalLayout = keepContents ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
 		VkAttachmentReference colorAttachmentRef = {};
 		colorAttachmentRef.attachment = 0;
@@ -245,7 +264,8 @@ namespace OmniV {
 
 		// Subpasses might depend on attachments from other subpasses (or external renderpasses).
 		// Note: You can have several dependencies for just 1 subpass (if it depends on external previous passes and external later passes)
-		VkSubpassDependency dependency = {};
+		std::array<VkSubpassDependency, 2> dependencies{};
+		VkSubpassDependency& dependency = dependencies[0];
 		
 		// Dst pass depends on src pass
 		dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
@@ -259,6 +279,22 @@ namespace OmniV {
 		dependency.srcAccessMask = 0;
 		dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
+		// Loading a previous pass: wait for its attachment writes and for compute work reading its depth in between
+		if (loadContents) {
+			dependency.srcStageMask |= VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+			dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			dependency.dstAccessMask |= VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+		}
+
+		// Keeping the contents: depth will be sampled by compute (Hi-Z) before the next pass
+		VkSubpassDependency& outDependency = dependencies[1];
+		outDependency.srcSubpass = 0;
+		outDependency.dstSubpass = VK_SUBPASS_EXTERNAL;
+		outDependency.srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		outDependency.dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		outDependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		outDependency.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
 		std::array<VkAttachmentDescription, 2> attachments = { colorAttachment, depthAttachment };
 
 		VkRenderPassCreateInfo renderPassInfo = {};
@@ -267,12 +303,15 @@ namespace OmniV {
 		renderPassInfo.pAttachments = attachments.data();
 		renderPassInfo.subpassCount = 1;
 		renderPassInfo.pSubpasses = &subpass;
-		renderPassInfo.dependencyCount = 1;
-		renderPassInfo.pDependencies = &dependency;
+		renderPassInfo.dependencyCount = keepContents ? 2 : 1;
+		renderPassInfo.pDependencies = dependencies.data();
 
-		if (vkCreateRenderPass(m_device.device(), &renderPassInfo, nullptr, &m_renderPass) != VK_SUCCESS) {
+		VkRenderPass renderPass;
+		if (vkCreateRenderPass(m_device.device(), &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create render pass!");
 		}
+
+		return renderPass;
 	}
 
 	void SwapChain::createDepthResources() {
@@ -296,7 +335,8 @@ namespace OmniV {
 			imageInfo.format = depthFormat;
 			imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
 			imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-			imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+			imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT // Sampled to build the Hi-Z pyramid
+				| VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT; // Read by the deferred lighting subpass
 			imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
 			imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 			imageInfo.flags = 0;
@@ -333,7 +373,7 @@ namespace OmniV {
 			VkExtent2D swapChainExtent = getSwapChainExtent();
 			VkFramebufferCreateInfo framebufferInfo = {};
 			framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-			framebufferInfo.renderPass = m_renderPass;
+			framebufferInfo.renderPass = getRenderPass();
 			framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
 			framebufferInfo.pAttachments = attachments.data();
 			framebufferInfo.width = swapChainExtent.width;
@@ -351,9 +391,9 @@ namespace OmniV {
 	}
 
 	void SwapChain::createSyncObjects() {
-		m_imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-		m_renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-		m_inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+		m_imageAvailableSemaphores.resize(m_settings.framesInFlight);
+		m_renderFinishedSemaphores.resize(m_settings.framesInFlight);
+		m_inFlightFences.resize(m_settings.framesInFlight);
 		m_imagesInFlight.resize(imageCount(), VK_NULL_HANDLE);
 
 		VkSemaphoreCreateInfo semaphoreInfo = {};
@@ -363,7 +403,7 @@ namespace OmniV {
 		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
 		fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		for (size_t i = 0; i < m_settings.framesInFlight; i++) {
 			if (vkCreateSemaphore(m_device.device(), &semaphoreInfo, nullptr, &m_imageAvailableSemaphores[i]) !=
 				VK_SUCCESS ||
 				vkCreateSemaphore(m_device.device(), &semaphoreInfo, nullptr, &m_renderFinishedSemaphores[i]) !=
@@ -374,6 +414,21 @@ namespace OmniV {
 		}
 	}
 
+	void SwapChain::takeSyncObjects(SwapChain& previous) {
+		m_imageAvailableSemaphores = std::move(previous.m_imageAvailableSemaphores);
+		m_renderFinishedSemaphores = std::move(previous.m_renderFinishedSemaphores);
+		m_inFlightFences = std::move(previous.m_inFlightFences);
+		previous.m_imageAvailableSemaphores.clear();
+		previous.m_renderFinishedSemaphores.clear();
+		previous.m_inFlightFences.clear();
+
+		// Frames keep their slot, the renderer's frame index goes on from the previous swapchain
+		m_currentFrame = previous.m_currentFrame;
+
+		// The new images were never submitted
+		m_imagesInFlight.resize(imageCount(), VK_NULL_HANDLE);
+	}
+
 	VkSurfaceFormatKHR SwapChain::chooseSwapSurfaceFormat(
 		const std::vector<VkSurfaceFormatKHR>& availableFormats) {
 		for (const auto& availableFormat : availableFormats) {
@@ -387,7 +442,7 @@ namespace OmniV {
 	}
 
 	/// <summary>
-	/// <para> Choose between the different present modes (V-Sync) </para>
+	/// <para> Choose between the different present modes (V-Sync), the one of the settings if the surface supports it </para>
 	/// <para> ------------------------------------------------------------------------------------------------------ </para>
 	/// <para> - Immediate mode: No synchronization is performed before presenting the frame.
 	/// *LOW LATENCY* but visible *TEARING*, as the GPU is always presenting new frames. This also means *HIGH POWER CONSUMPTION* (not good for mobile devices) </para>
@@ -395,27 +450,24 @@ namespace OmniV {
 	/// *LOW LATENCY*. In order to always have the latest frame, the GPU never idles (waits), meaning *HIGH POWER CONS.* </para>
 	/// <para> - FIFO mode (ALWAYS SUPPORTED): When a new refresh cycle hits, the swapchain chooses the next back buffer in order (First In First Out).
 	/// If GPU finishes a frame early, it idles until the next refresh cycle, resulting in *LOW POWER CONS.*, but *HIGH LATENCY* as the frame presented may be a few ms old </para>
+	/// <para> - FIFO relaxed mode: FIFO, except that a frame missing its refresh cycle is presented right away (tearing) instead of waiting for the next one </para>
 	/// </summary>
 	/// <param name="availablePresentModes"></param>
 	/// <returns></returns>
 	VkPresentModeKHR SwapChain::chooseSwapPresentMode(
 		const std::vector<VkPresentModeKHR>& availablePresentModes) {
-		for (const auto& availablePresentMode : availablePresentModes) {
-			if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
-				OV_DEBUG_LOG("Present mode: Mailbox");
-				return availablePresentMode;
-			}
+		VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+		if (std::find(availablePresentModes.begin(), availablePresentModes.end(), m_settings.presentMode) != availablePresentModes.end())
+			presentMode = m_settings.presentMode;
+
+		switch (presentMode) {
+		case VK_PRESENT_MODE_IMMEDIATE_KHR: OV_DEBUG_LOG("Present mode: Immediate"); break;
+		case VK_PRESENT_MODE_MAILBOX_KHR: OV_DEBUG_LOG("Present mode: Mailbox"); break;
+		case VK_PRESENT_MODE_FIFO_RELAXED_KHR: OV_DEBUG_LOG("Present mode: Relaxed V-Sync"); break;
+		default: OV_DEBUG_LOG("Present mode: V-Sync"); break;
 		}
 
-		/*for (const auto& availablePresentMode : availablePresentModes) {
-			if (availablePresentMode == VK_PRESENT_MODE_IMMEDIATE_KHR) {
-				LOG("Present mode: Immediate");
-				return availablePresentMode;
-			}
-		}*/
-
-		OV_DEBUG_LOG("Present mode: V-Sync");
-		return VK_PRESENT_MODE_FIFO_KHR;
+		return presentMode;
 	}
 
 	VkExtent2D SwapChain::chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities) {
@@ -439,7 +491,7 @@ namespace OmniV {
 		return m_device.findSupportedFormat(
 			{ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT },
 			VK_IMAGE_TILING_OPTIMAL,
-			VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+			VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
 	}
 
 }
\ No newline at end of file
@@ -7,21 +7,43 @@
 
 namespace OmniV {
 
+	// The main pass can be split into several render passes over the same framebuffer (e.g. two-phase occlusion culling)
+	// They only differ in load/store ops and layouts, so they are all compatible and pipelines created for one work with the others
+	enum class MainPassType {
+		Single = 0, // Clears and ends ready to present
+		First, // Clears and keeps color and depth for a later pass. Depth ends up readable from shaders
+		Last, // Loads what a previous pass left and ends ready to present
+		Count
+	};
+
+	// Latency vs throughput trade-offs, applied whenever the swapchain is (re)created
+	struct SwapChainSettings {
+		uint32_t framesInFlight = 2; // Frames the CPU records ahead of the GPU, 1 to MAX_FRAMES_IN_FLIGHT. More hide stalls, fewer cut input latency
+		VkPresentModeKHR presentMode = VK_PRESENT_MODE_MAILBOX_KHR; // Falls back to FIFO (always supported) if the surface doesn't support it
+	};
+
 	class SwapChain {
 	public:
-		static constexpr int MAX_FRAMES_IN_FLIGHT = 2;
+		SwapChain(Device& device, VkExtent2D windowExtent, const SwapChainSettings& settings);
 
-		SwapChain(Device& device, VkExtent2D windowExtent);
-		SwapChain(Device& device, VkExtent2D windowExtent, std::shared_ptr<SwapChain> previous);
+		// Replaces "previous" (passed as oldSwapchain) without waiting for the device. If the number of frames in flight is the same,
+		// the frame fences and semaphores are taken over from it, as they still track the frames submitted with the previous swapchain
+		// "previous" keeps its images, framebuffers and depth images, and must be kept alive until those frames are finished
+		SwapChain(Device& device, VkExtent2D windowExtent, const SwapChainSettings& settings, std::shared_ptr<SwapChain> previous);
 		~SwapChain();
 
 		SwapChain(const SwapChain&) = delete;
 		SwapChain operator=(const SwapChain&) = delete;
 
 		VkFramebuffer getFrameBuffer(int frameIndex) { return m_framebuffers[frameIndex]; }
-		VkRenderPass getRenderPass() { return m_renderPass; }
+		VkRenderPass getRenderPass(MainPassType type = MainPassType::Single) { return m_renderPasses[static_cast<size_t>(type)]; }
+		VkImage getImage(int frameIndex) { return m_images[frameIndex]; }
+		VkImage getDepthImage(int frameIndex) { return m_depthImages[frameIndex]; }
 		VkImageView getImageView(int frameIndex) { return m_imageViews[frameIndex]; }
+		VkImageView getDepthImageView(int frameIndex) { return m_depthImageViews[frameIndex]; }
 		size_t imageCount() { return m_images.size(); }
+		uint32_t getFramesInFlight() const { return m_settings.framesInFlight; }
+		VkPresentModeKHR getPresentMode() const { return m_presentMode; }
 		VkFormat getSwapChainImageFormat() { return m_imageFormat; }
 		VkExtent2D getSwapChainExtent() { return m_extent; }
 
@@ -40,10 +62,12 @@ namespace OmniV {
 		void init();
 		void createSwapChain();
 		void createImageViews();
-		void createRenderPass();
+		void createRenderPasses();
+		VkRenderPass createRenderPass(MainPassType type);
 		void createDepthResources();
 		void createFramebuffers();
 		void createSyncObjects();
+		void takeSyncObjects(SwapChain& previous);
 
 		// Helper functions
 		VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats);
@@ -53,10 +77,11 @@ namespace OmniV {
 		VkFormat m_imageFormat;
 		VkFormat m_depthFormat;
 		VkExtent2D m_extent;
+		VkPresentModeKHR m_presentMode;
 
 		// Main pass
 		std::vector<VkFramebuffer> m_framebuffers;
-		VkRenderPass m_renderPass;
+		std::array<VkRenderPass, static_cast<size_t>(MainPassType::Count)> m_renderPasses;
 
 		// Main pass resources
 		std::vector<VkImage> m_images;
@@ -68,6 +93,7 @@ namespace OmniV {
 
 		Device& m_device;
 		VkExtent2D m_viewExtent;
+		SwapChainSettings m_settings;
 
 		VkSwapchainKHR m_swapChain;
 		std::shared_ptr<SwapChain> m_oldSwapChain = nullptr;
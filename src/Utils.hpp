@@ -29,10 +29,25 @@ namespace OmniV {
 		std::cout << "---------------------";
 	}
 
+	// Transforms a model space AABB into a world space AABB (transformed center + extents projected onto the world axes)
+	inline void getWorldBounds(const glm::mat4& modelMat, const glm::vec3& boundsMin, const glm::vec3& boundsMax, glm::vec3& outMin, glm::vec3& outMax) {
+		glm::vec3 center = 0.5f * (boundsMax + boundsMin);
+		glm::vec3 extents = 0.5f * (boundsMax - boundsMin);
+
+		glm::vec3 worldCenter = glm::vec3(modelMat * glm::vec4(center, 1.f));
+		glm::mat3 absMat = glm::mat3(glm::abs(glm::vec3(modelMat[0])), glm::abs(glm::vec3(modelMat[1])), glm::abs(glm::vec3(modelMat[2])));
+		glm::vec3 worldExtents = absMat * extents;
+
+		outMin = worldCenter - worldExtents;
+		outMax = worldCenter + worldExtents;
+	}
+
 	// Function that adjusts the boundaries of the shadowmap depth pass view matrix to fit the main camera frustum
 	// Only used for directional lights
 	// from: https://gamedev.stackexchange.com/questions/193929/how-to-move-the-shadow-map-with-the-camera
-	inline void getCascadeMatrices(glm::mat4 viewMat, const Camera& camera, float aspectRatio, glm::mat4* outViewProjMats, float* outSplitDepths) {
+	// "cascadeResolutions" are the shadowmap resolutions, which cascades are snapped to
+	inline void getCascadeMatrices(glm::mat4 viewMat, const Camera& camera, float aspectRatio, const std::array<uint32, SHADOWMAP_CASCADE_COUNT>& cascadeResolutions,
+		glm::mat4* outViewProjMats, float* outSplitDepths) {
 		float cascadeSplits[SHADOWMAP_CASCADE_COUNT];
 
 		glm::vec3 camPos = camera.getPosition();
@@ -120,8 +135,16 @@ namespace OmniV {
 			float n = -max.z;
 			float f = -min.z;
 
-			// Store split distance and matrix in cascade
 			glm::mat4 projMat = glm::ortho(l, r, b, t, n, f);
+
+			// Snap the cascade to shadowmap texels (and depth to fixed steps), so that moving the camera doesn't make shadow edges shimmer,
+			// and the matrix stays the same until the camera moved by a whole texel (static shadows can be cached meanwhile)
+			glm::vec4 origin = projMat * viewMat * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+			glm::vec3 steps = glm::vec3(cascadeResolutions[i] * 0.5f, cascadeResolutions[i] * 0.5f, 1024.0f);
+			glm::vec3 snapped = glm::round(glm::vec3(origin) * steps) / steps;
+			projMat[3] += glm::vec4(snapped - glm::vec3(origin), 0.0f);
+
+			// Store split distance and matrix in cascade
 			outViewProjMats[i] = projMat * viewMat;
 			outSplitDepths[i] = splitEnd;
 		}
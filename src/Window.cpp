@@ -27,6 +27,13 @@ namespace OmniV {
 		}
 	}
 
+	void Window::waitEvents() {
+		if (std::this_thread::get_id() == m_windowThreadID)
+			glfwWaitEvents();
+		else
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
 	void Window::framebufferResizeCallback(GLFWwindow* glfwWindow, int width, int height) {
 		auto window = reinterpret_cast<Window*>(glfwGetWindowUserPointer(glfwWindow));
 		window->m_framebufferResized = true;
@@ -5,6 +5,10 @@
 
 #include "common.hpp"
 
+// std
+#include <atomic>
+#include <thread>
+
 namespace OmniV {
 
 	class Window {
@@ -17,19 +21,26 @@ namespace OmniV {
 
 		bool shouldClose() { return glfwWindowShouldClose(m_window); }
 		VkExtent2D getExtent() { return { static_cast<uint32_t>(m_width), static_cast<uint32_t>(m_height) }; }
+		bool isMinimized() { return m_width == 0 || m_height == 0; }
 		bool wasWindowResized() { return m_framebufferResized; }
 		void resetWindowResizedFlag() { m_framebufferResized = false; }
 		GLFWwindow* getGLFWwindow() const { return m_window; }
 
+		// Waits for window events on the thread that created the window. Events can only be processed there,
+		// other threads just sleep a little while it does
+		void waitEvents();
+
 		void createWindowSurface(VkInstance instance, VkSurfaceKHR* surface);
 
 	private:
 		static void framebufferResizeCallback(GLFWwindow* window, int width, int height);
 		void initWindow();
 
-		int m_width;
-		int m_height;
-		bool m_framebufferResized = false;
+		// Written by the resize callback on the window's thread, read by the render thread
+		std::atomic<int> m_width;
+		std::atomic<int> m_height;
+		std::atomic<bool> m_framebufferResized{ false };
+		std::thread::id m_windowThreadID = std::this_thread::get_id();
 		std::string m_windowName;
 		GLFWwindow* m_window;
 	};
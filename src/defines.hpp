@@ -34,11 +34,13 @@
 #endif
 
 // global consts
-#define MAX_LIGHTS 10
+#define MAX_LIGHTS 4096 // Directional + point lights, stored in a storage buffer
 #define MAX_GAME_OBJECTS 10000
 #define MAX_CONCURRENT_RENDER_SYSTEMS 10
+#define MAX_FRAMES_IN_FLIGHT 4 // Upper bound of SwapChainSettings::framesInFlight
+#define GPU_FRAME_ARENA_SIZE (4 << 20) // Bytes of per frame GPU data (GpuFrameArena), per frame in flight
 
-#define SHADOWMAP_RES 4096
+#define SHADOWMAP_RES 4096 // Default and maximum resolution of a cascade
 #define SHADOWMAP_MAX_DIST 20
 #define SHADOWMAP_CASCADE_COUNT 4
 #define SHADOWMAP_CASCADE_LAMBDA 0.95f
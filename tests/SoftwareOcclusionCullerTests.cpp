@@ -0,0 +1,75 @@
+#include "SoftwareOcclusionCuller.hpp"
+
+// std
+#include <cstdio>
+
+namespace OmniV {
+
+	// The view-projection is the identity in these tests: world positions are NDC, and x = 0 is the middle column of the depth buffer
+	class SoftwareOcclusionCullerTests {
+	public:
+		SoftwareOcclusionCullerTests() : m_culler{ m_jobSystem } {}
+
+		int run() {
+			// Occluder covering the left half of the screen, plus half a pixel. Its right edge crosses the centers of the pixels of column 128
+			const float edgeX = 128.5f;
+			rasterizeQuad(0.0f, 0.0f, edgeX, static_cast<float>(SoftwareOcclusionCuller::HEIGHT), 0.5f);
+
+			check("Occludee behind the occluder is culled", isOccluded({ -0.5f, -0.5f, 0.6f }, { -0.1f, 0.5f, 0.7f }));
+			check("Occludee in front of the occluder is kept", !isOccluded({ -0.5f, -0.5f, 0.2f }, { -0.1f, 0.5f, 0.3f }));
+			check("Occludee ending inside the occluder is culled", isOccluded({ -0.5f, -0.5f, 0.6f }, { toNdcX(edgeX - 0.75f), 0.5f, 0.7f }));
+			check("Occludee peeking past the occluder edge is kept", !isOccluded({ -0.5f, -0.5f, 0.6f }, { toNdcX(edgeX + 0.25f), 0.5f, 0.7f }));
+
+			// Occluder sloping from 0.2 on the left to 0.8 on the right, i.e. 0.6 / 256 per pixel. An occludee inside column 64 at depth 0.352
+			// is behind the center of the pixel (0.35117) but in front of the occluder on the right of x = 64.85 (0.35200)
+			rasterizeQuad(0.0f, 0.0f, static_cast<float>(SoftwareOcclusionCuller::WIDTH), static_cast<float>(SoftwareOcclusionCuller::HEIGHT), 0.2f, 0.8f);
+			check("Occludee in front of part of a sloped occluder is kept", !isOccluded({ toNdcX(64.1f), -0.5f, 0.352f }, { toNdcX(64.9f), 0.5f, 0.36f }));
+			check("Occludee behind a sloped occluder is culled", isOccluded({ toNdcX(64.1f), -0.5f, 0.36f }, { toNdcX(64.9f), 0.5f, 0.37f }));
+
+			std::printf("%u check(s) failed\n", m_failures);
+			return m_failures == 0 ? 0 : 1;
+		}
+
+	private:
+		static float toNdcX(float pixelX) { return pixelX * 2.0f / SoftwareOcclusionCuller::WIDTH - 1.0f; }
+
+		// Pixels [minX, maxX[ x [minY, maxY[, depth from "z0" on the left to "z1" on the right
+		void rasterizeQuad(float minX, float minY, float maxX, float maxY, float z0, float z1) {
+			m_culler.m_triangles.clear();
+			for (auto& bin : m_culler.m_tileBins)
+				bin.clear();
+
+			// Two triangles sharing their diagonal, the way rasterizeOccluders() bins a mesh
+			const std::vector<glm::vec3> vertices = { { minX, minY, z0 }, { maxX, minY, z1 }, { maxX, maxY, z1 }, { minX, maxY, z0 } };
+			const std::vector<uint32_t> indices = { 0, 1, 2, 0, 2, 3 };
+
+			m_culler.m_clipW.assign(vertices.size(), 1.0f);
+			m_culler.m_screenVertices = vertices;
+			m_culler.findInteriorEdges(vertices, indices);
+
+			for (uint32 t = 0; t < 2; t++)
+				m_culler.binTriangle({ vertices[indices[t * 3]], vertices[indices[t * 3 + 1]], vertices[indices[t * 3 + 2]], m_culler.m_interiorEdges[t] });
+
+			m_culler.rasterizeBins();
+		}
+
+		void rasterizeQuad(float minX, float minY, float maxX, float maxY, float z) { rasterizeQuad(minX, minY, maxX, maxY, z, z); }
+
+		bool isOccluded(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const {
+			return m_culler.isOccluded(boundsMin, boundsMax, glm::mat4{ 1.0f });
+		}
+
+		void check(const char* name, bool passed) {
+			std::printf("%s: %s\n", passed ? "PASSED" : "FAILED", name);
+			m_failures += passed ? 0 : 1;
+		}
+
+		JobSystem m_jobSystem{ 1 };
+		SoftwareOcclusionCuller m_culler;
+		uint32 m_failures = 0;
+	};
+}
+
+int main() {
+	return OmniV::SoftwareOcclusionCullerTests().run();
+}